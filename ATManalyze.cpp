@@ -0,0 +1,514 @@
+#include "lib/ATManalyze.h"
+#include "lib/ATMlib.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr uint32_t ATM_ANALYZE_MAX_TICKS = 1u << 20;
+static constexpr uint32_t ATM_ANALYZE_MAX_CMDS_PER_TICK = 4096;
+
+// Only the fields that decide timing; effects and oscillators are ignored.
+// Laid out without padding so whole states can be compared with memcmp.
+struct AtmWalkChannel {
+    uint16_t ptr;
+    uint16_t delay;
+    uint16_t stackPointer[7];
+    uint8_t stackCounter[7];
+    uint8_t stackTrack[7];
+    uint8_t counter;
+    uint8_t track;
+    uint8_t stackIndex;
+    uint8_t repeatPoint;
+};
+
+struct AtmWalkState {
+    AtmWalkChannel ch[4];
+    uint8_t tickRate;
+    uint8_t activeMute;
+    uint8_t ended;
+    uint8_t error;
+};
+
+struct AtmWalkSong {
+    uint8_t trackCount;
+    const uint8_t* trackList;
+    const uint8_t* data;
+    size_t dataSize;
+};
+
+static inline uint16_t walk_track_offset(const AtmWalkSong* song, uint8_t track) {
+    return (uint16_t)(song->trackList[track * 2] | (song->trackList[track * 2 + 1] << 8));
+}
+
+static inline bool walk_read(const AtmWalkSong* song, AtmWalkChannel* ch, uint8_t* out) {
+    if(ch->ptr >= song->dataSize) return false;
+    *out = song->data[ch->ptr++];
+    return true;
+}
+
+static bool walk_read_vle(const AtmWalkSong* song, AtmWalkChannel* ch, uint16_t* out) {
+    uint16_t q = 0;
+    uint8_t d;
+    do {
+        if(!walk_read(song, ch, &d)) return false;
+        q <<= 7;
+        q |= (d & 0x7F);
+    } while(d & 0x80);
+    *out = q;
+    return true;
+}
+
+static bool walk_goto(const AtmWalkSong* song, AtmWalkChannel* ch, uint8_t track) {
+    if(track >= song->trackCount) return false;
+    ch->ptr = walk_track_offset(song, track);
+    return true;
+}
+
+static bool walk_channel_commands(const AtmWalkSong* song, AtmWalkState* s, uint8_t n) {
+    AtmWalkChannel* ch = &s->ch[n];
+    uint32_t budget = ATM_ANALYZE_MAX_CMDS_PER_TICK;
+    uint8_t cmd;
+    uint8_t arg;
+    uint16_t vle;
+
+    do {
+        if(!budget--) return false;
+        if(!walk_read(song, ch, &cmd)) return false;
+
+        if(cmd < 64) {
+        } else if(cmd < 160) {
+            switch(cmd - 64) {
+            case 0:
+            case 1:
+            case 4:
+            case 9:
+            case 11:
+            case 12:
+            case 18:
+            case 20:
+                if(!walk_read(song, ch, &arg)) return false;
+                break;
+
+            case 2:
+            case 5:
+            case 7:
+            case 14:
+            case 16:
+                ch->ptr = (uint16_t)(ch->ptr + 2);
+                break;
+
+            case 92:
+                if(!walk_read(song, ch, &arg)) return false;
+                s->tickRate = (uint8_t)(s->tickRate + arg);
+                if(s->tickRate < 1) s->tickRate = 1;
+                break;
+
+            case 93:
+                if(!walk_read(song, ch, &arg)) return false;
+                s->tickRate = arg;
+                if(s->tickRate < 1) s->tickRate = 1;
+                break;
+
+            case 94:
+                for(uint8_t i = 0; i < 4; i++) {
+                    if(!walk_read(song, ch, &arg)) return false;
+                    s->ch[i].repeatPoint = arg;
+                }
+                break;
+
+            case 95:
+                s->activeMute = (uint8_t)(s->activeMute ^ (1 << (n + 4)));
+                ch->delay = 0xFFFF;
+                break;
+
+            default:
+                break;
+            }
+        } else if(cmd < 224) {
+            ch->delay = (uint16_t)(cmd - 159);
+        } else if(cmd == 224) {
+            if(!walk_read_vle(song, ch, &vle)) return false;
+            ch->delay = (uint16_t)(vle + 65);
+        } else if(cmd == 252 || cmd == 253) {
+            uint8_t new_counter = 0;
+            uint8_t new_track;
+            if(cmd == 253 && !walk_read(song, ch, &new_counter)) return false;
+            if(!walk_read(song, ch, &new_track)) return false;
+
+            if(new_track != ch->track) {
+                if(ch->stackIndex >= 7) return false;
+                ch->stackCounter[ch->stackIndex] = ch->counter;
+                ch->stackTrack[ch->stackIndex] = ch->track;
+                ch->stackPointer[ch->stackIndex] = ch->ptr;
+                ch->stackIndex++;
+                ch->track = new_track;
+            }
+            ch->counter = new_counter;
+            if(!walk_goto(song, ch, ch->track)) return false;
+        } else if(cmd == 254) {
+            if(ch->counter > 0 || ch->stackIndex == 0) {
+                if(ch->counter) ch->counter--;
+                if(!walk_goto(song, ch, ch->track)) return false;
+            } else {
+                ch->stackIndex--;
+                ch->ptr = ch->stackPointer[ch->stackIndex];
+                ch->counter = ch->stackCounter[ch->stackIndex];
+                ch->track = ch->stackTrack[ch->stackIndex];
+                ch->stackPointer[ch->stackIndex] = 0;
+                ch->stackCounter[ch->stackIndex] = 0;
+                ch->stackTrack[ch->stackIndex] = 0;
+            }
+        } else if(cmd == 255) {
+            if(!walk_read_vle(song, ch, &vle)) return false;
+            ch->ptr = (uint16_t)(ch->ptr + vle);
+        }
+    } while(ch->delay == 0);
+
+    return true;
+}
+
+// Advances one tick and returns the number of logical samples until the next one.
+static uint32_t walk_tick(const AtmWalkSong* song, AtmWalkState* s) {
+    if(s->ended || s->error) return 0;
+
+    for(uint8_t n = 0; n < 4; n++) {
+        AtmWalkChannel* ch = &s->ch[n];
+
+        if(!ch->delay) {
+            if(!walk_channel_commands(song, s, n)) {
+                s->error = 1;
+                return 0;
+            }
+        }
+        if(ch->delay != 0xFFFF) ch->delay--;
+
+        if(!(s->activeMute & 0xF0)) {
+            uint8_t repeatSong = 0;
+            for(uint8_t j = 0; j < 4; j++)
+                repeatSong = (uint8_t)(repeatSong + s->ch[j].repeatPoint);
+
+            if(repeatSong) {
+                for(uint8_t k = 0; k < 4; k++) {
+                    if(!walk_goto(song, &s->ch[k], s->ch[k].repeatPoint)) {
+                        s->error = 1;
+                        return 0;
+                    }
+                    s->ch[k].delay = 0;
+                }
+                s->activeMute = 0xF0;
+            } else {
+                s->ended = 1;
+                break;
+            }
+        }
+    }
+
+    return ATM_LOGICAL_HZ / s->tickRate;
+}
+
+static inline uint32_t walk_ms(uint64_t pos) {
+    return (uint32_t)((pos * 1000) / ATM_LOGICAL_HZ);
+}
+
+bool atm_analyze_song(const uint8_t* song, size_t song_size, AtmSongInfo* out) {
+    if(!song || !out) return false;
+    memset(out, 0, sizeof(*out));
+
+    if(song_size < 1) return false;
+    AtmWalkSong ws;
+    ws.trackCount = song[0];
+    const size_t header_size = 1 + (size_t)ws.trackCount * 2 + 4;
+    if(ws.trackCount == 0 || song_size < header_size) return false;
+    ws.trackList = song + 1;
+    ws.data = song + header_size;
+    ws.dataSize = song_size - header_size;
+
+    AtmWalkState start;
+    memset(&start, 0, sizeof(start));
+    start.tickRate = 25;
+    start.activeMute = 0xF0;
+    for(uint8_t n = 0; n < 4; n++) {
+        if(!walk_goto(&ws, &start.ch[n], song[header_size - 4 + n])) return false;
+    }
+
+    // Brent's cycle detection over whole walker states: the song either reaches its end state or
+    // its state sequence becomes periodic, which gives the loop without remembering any history.
+    AtmWalkState tortoise;
+    AtmWalkState hare;
+    memcpy(&tortoise, &start, sizeof(start));
+    memcpy(&hare, &start, sizeof(start));
+
+    uint64_t hare_pos = walk_tick(&ws, &hare);
+    uint32_t ticks = 1;
+    uint32_t power = 1;
+    uint32_t lam = 1;
+
+    while(memcmp(&tortoise, &hare, sizeof(hare)) != 0) {
+        if(hare.error) return false;
+        if(hare.ended) {
+            out->duration_ms = walk_ms(hare_pos);
+            out->terminates = true;
+            return true;
+        }
+        if(++ticks > ATM_ANALYZE_MAX_TICKS) return false;
+
+        if(power == lam) {
+            memcpy(&tortoise, &hare, sizeof(hare));
+            power *= 2;
+            lam = 0;
+        }
+        hare_pos += walk_tick(&ws, &hare);
+        lam++;
+    }
+    if(hare.error) return false;
+    if(hare.ended) {
+        out->duration_ms = walk_ms(hare_pos);
+        out->terminates = true;
+        return true;
+    }
+
+    // Find where the cycle starts by running two walkers lam ticks apart until they meet.
+    memcpy(&tortoise, &start, sizeof(start));
+    memcpy(&hare, &start, sizeof(start));
+    uint64_t tortoise_pos = 0;
+    hare_pos = 0;
+    for(uint32_t i = 0; i < lam; i++)
+        hare_pos += walk_tick(&ws, &hare);
+
+    while(memcmp(&tortoise, &hare, sizeof(hare)) != 0) {
+        tortoise_pos += walk_tick(&ws, &tortoise);
+        hare_pos += walk_tick(&ws, &hare);
+    }
+
+    out->loop_start_ms = walk_ms(tortoise_pos);
+    out->loop_end_ms = walk_ms(hare_pos);
+    out->duration_ms = out->loop_end_ms;
+
+    // A song that parks every channel on an endless delay never stops the engine, but it does
+    // not loop audibly either: treat the start of the idle state as its end.
+    bool idle = true;
+    for(uint8_t n = 0; n < 4; n++) {
+        if(tortoise.ch[n].delay != 0xFFFF) idle = false;
+    }
+    if(idle) {
+        out->duration_ms = out->loop_start_ms;
+        out->loop_start_ms = 0;
+        out->loop_end_ms = 0;
+    } else {
+        out->looped = true;
+    }
+    return true;
+}
+
+// Per-track facts for atm_find_delay_free_cycle(), bit sets indexed by track.
+struct AtmCycleScan {
+    uint32_t calls[256][8];
+    uint32_t reach[8];
+    uint32_t top[8];
+    // Tracks whose body ends in RETURN or calls track 0.
+    uint32_t to_zero[8];
+    uint32_t dfree[8];
+    uint32_t live[8];
+};
+
+static inline bool bit_get(const uint32_t* set, uint8_t i) {
+    return (set[i >> 5] >> (i & 31)) & 1;
+}
+
+static inline void bit_set(uint32_t* set, uint8_t i) {
+    set[i >> 5] |= 1u << (i & 31);
+}
+
+enum AtmScanEnd : uint8_t {
+    // Reached a delay, STOP, or a call to a track that delays.
+    AtmScanDelay,
+    // Reached RETURN with no delay on the way.
+    AtmScanReturn,
+    AtmScanBad,
+};
+
+// Decodes track from its start the way a channel runs it, up to RETURN or STOP. With prefix set it
+// also stops at the first delay and passes a call only when the callee returns without delaying
+// (scan->dfree), and the calls seen go to calls; otherwise every call and GOTO_ADVANCED target
+// seen goes to scan->reach and scan->top, and scan->to_zero is updated.
+static AtmScanEnd scan_track(
+    const AtmWalkSong* song,
+    AtmCycleScan* scan,
+    uint8_t track,
+    bool prefix,
+    uint32_t* calls) {
+    AtmWalkChannel ch;
+    memset(&ch, 0, sizeof(ch));
+    if(!walk_goto(song, &ch, track)) return AtmScanBad;
+    uint8_t cmd;
+    uint8_t arg;
+    uint16_t vle;
+
+    for(size_t budget = song->dataSize + 1; budget; budget--) {
+        if(!walk_read(song, &ch, &cmd)) return AtmScanBad;
+
+        if(cmd < 64) {
+        } else if(cmd < 160) {
+            switch(cmd - 64) {
+            case 0:
+            case 1:
+            case 4:
+            case 9:
+            case 11:
+            case 12:
+            case 18:
+            case 20:
+            case 92:
+            case 93:
+                if(!walk_read(song, &ch, &arg)) return AtmScanBad;
+                break;
+
+            case 2:
+            case 5:
+            case 7:
+            case 14:
+            case 16:
+                ch.ptr = (uint16_t)(ch.ptr + 2);
+                break;
+
+            case 94: {
+                // All zero repeat points mean the song ends instead of repeating.
+                uint8_t points[4];
+                for(uint8_t i = 0; i < 4; i++) {
+                    if(!walk_read(song, &ch, &points[i])) return AtmScanBad;
+                }
+                if(!prefix && (points[0] | points[1] | points[2] | points[3])) {
+                    for(uint8_t i = 0; i < 4; i++) {
+                        bit_set(scan->reach, points[i]);
+                        bit_set(scan->top, points[i]);
+                    }
+                }
+                break;
+            }
+
+            case 95:
+                return AtmScanDelay;
+
+            default:
+                break;
+            }
+        } else if(cmd <= 224) {
+            if(prefix) return AtmScanDelay;
+            if(cmd == 224 && !walk_read_vle(song, &ch, &vle)) return AtmScanBad;
+        } else if(cmd == 252 || cmd == 253) {
+            if(cmd == 253 && !walk_read(song, &ch, &arg)) return AtmScanBad;
+            if(!walk_read(song, &ch, &arg)) return AtmScanBad;
+            if(!prefix) {
+                bit_set(scan->reach, arg);
+                if(arg == 0) bit_set(scan->to_zero, track);
+            } else {
+                bit_set(calls, arg);
+                // A call to itself restarts the track, one to a track that delays ends the prefix.
+                if(arg == track || !bit_get(scan->dfree, arg)) return AtmScanDelay;
+            }
+        } else if(cmd == 254) {
+            if(!prefix) bit_set(scan->to_zero, track);
+            return AtmScanReturn;
+        } else if(cmd == 255) {
+            if(!walk_read_vle(song, &ch, &vle)) return AtmScanBad;
+            ch.ptr = (uint16_t)(ch.ptr + vle);
+        }
+    }
+    return AtmScanBad;
+}
+
+bool atm_find_delay_free_cycle(const uint8_t* song, size_t song_size, uint8_t* out_track) {
+    *out_track = 0xFF;
+    if(!song || song_size < 1) return true;
+    AtmWalkSong ws;
+    ws.trackCount = song[0];
+    const size_t header_size = 1 + (size_t)ws.trackCount * 2 + 4;
+    if(ws.trackCount == 0 || song_size < header_size) return true;
+    ws.trackList = song + 1;
+    ws.data = song + header_size;
+    ws.dataSize = song_size - header_size;
+
+    // 8 KB of call sets is too much for a Flipper thread stack.
+    AtmCycleScan* scan = (AtmCycleScan*)calloc(1, sizeof(AtmCycleScan));
+    if(!scan) return true;
+    const uint8_t count = ws.trackCount;
+    bool bad = false;
+
+    // Tracks a channel can reach: the entry tracks and everything they call, transitively. Outside
+    // any call a channel's current track is 0, whatever it started on, so RETURN and a call to
+    // track 0 there go to the start of track 0 for good.
+    for(uint8_t n = 0; n < 4; n++) {
+        bit_set(scan->reach, song[header_size - 4 + n]);
+        bit_set(scan->top, song[header_size - 4 + n]);
+    }
+    uint32_t done[8] = {0};
+    for(bool grew = true; grew && !bad;) {
+        grew = false;
+        for(uint8_t w = 0; w < 8; w++) {
+            if(scan->top[w] & scan->to_zero[w]) {
+                bit_set(scan->reach, 0);
+                bit_set(scan->top, 0);
+            }
+        }
+        for(uint16_t t = 0; t < 256; t++) {
+            if(!bit_get(scan->reach, (uint8_t)t) || bit_get(done, (uint8_t)t)) continue;
+            bit_set(done, (uint8_t)t);
+            grew = true;
+            if(t >= count || scan_track(&ws, scan, (uint8_t)t, false, NULL) == AtmScanBad) {
+                bad = true;
+                break;
+            }
+        }
+    }
+
+    // Tracks that return without delaying, as a fixpoint: a track's prefix may pass calls only to
+    // tracks already known to return. The calls of each prefix are kept from the last round.
+    for(bool grew = !bad; grew;) {
+        grew = false;
+        for(uint8_t t = 0; t < count; t++) {
+            if(!bit_get(scan->reach, t) || bit_get(scan->dfree, t)) continue;
+            memset(scan->calls[t], 0, sizeof(scan->calls[t]));
+            if(scan_track(&ws, scan, t, true, scan->calls[t]) == AtmScanReturn) {
+                bit_set(scan->dfree, t);
+                grew = true;
+            }
+        }
+    }
+
+    // Track 0 played outside a call and returning without delaying starts over forever.
+    if(!bad && bit_get(scan->top, 0) && bit_get(scan->dfree, 0)) {
+        *out_track = 0;
+        free(scan);
+        return true;
+    }
+
+    // The others that never return are either delayed or in a call loop. Peel off the tracks whose
+    // prefix reaches a delay without calling a track that is still left; what remains loops.
+    for(uint8_t t = 0; t < count; t++) {
+        if(bit_get(scan->reach, t) && !bit_get(scan->dfree, t)) bit_set(scan->live, t);
+    }
+    for(bool shrank = !bad; shrank;) {
+        shrank = false;
+        for(uint8_t t = 0; t < count; t++) {
+            if(!bit_get(scan->live, t)) continue;
+            bool loops = false;
+            for(uint8_t w = 0; w < 8; w++) {
+                if(scan->calls[t][w] & scan->live[w]) loops = true;
+            }
+            if(!loops) {
+                scan->live[t >> 5] &= ~(1u << (t & 31));
+                shrank = true;
+            }
+        }
+    }
+
+    bool found = bad;
+    for(uint8_t t = 0; t < count && !found; t++) {
+        if(bit_get(scan->live, t)) {
+            *out_track = t;
+            found = true;
+        }
+    }
+    free(scan);
+    return found;
+}
@@ -0,0 +1,91 @@
+#include "lib/ATMcapture.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static inline void atm_capture_put_u32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline void atm_capture_put_u16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+// RIFF, fmt (PCM, mono, 8 bit), JUNK up to the data chunk header at the end of the block.
+static void atm_capture_header(uint8_t h[ATM_CAPTURE_HEADER_SIZE], uint32_t rate_hz, uint32_t bytes) {
+    memset(h, 0, ATM_CAPTURE_HEADER_SIZE);
+    memcpy(h, "RIFF", 4);
+    atm_capture_put_u32(h + 4, ATM_CAPTURE_HEADER_SIZE - 8 + bytes);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    atm_capture_put_u32(h + 16, 16);
+    atm_capture_put_u16(h + 20, 1);
+    atm_capture_put_u16(h + 22, 1);
+    atm_capture_put_u32(h + 24, rate_hz);
+    atm_capture_put_u32(h + 28, rate_hz);
+    atm_capture_put_u16(h + 32, 1);
+    atm_capture_put_u16(h + 34, 8);
+    memcpy(h + 36, "JUNK", 4);
+    atm_capture_put_u32(h + 40, ATM_CAPTURE_HEADER_SIZE - 44 - 8);
+    memcpy(h + ATM_CAPTURE_HEADER_SIZE - 8, "data", 4);
+    atm_capture_put_u32(h + ATM_CAPTURE_HEADER_SIZE - 4, bytes);
+}
+
+bool atm_capture_open(AtmCapture* c, uint32_t rate_hz) {
+    memset(c, 0, sizeof(*c));
+    AtmBlock* blocks = (AtmBlock*)malloc(sizeof(AtmBlock) * ATM_CAPTURE_RING_BLOCKS);
+    if(!blocks) return false;
+    atm_block_ring_init(&c->ring, blocks, ATM_CAPTURE_RING_BLOCKS, ATM_CAPTURE_RING_BLOCKS);
+    c->rate_hz = rate_hz;
+    return true;
+}
+
+void atm_capture_close(AtmCapture* c) {
+    if(c->ring.blocks) free(c->ring.blocks);
+    c->ring.blocks = NULL;
+}
+
+bool atm_capture_begin(AtmCapture* c, AtmCaptureWrite write, void* ctx) {
+    uint8_t h[ATM_CAPTURE_HEADER_SIZE];
+    atm_capture_header(h, c->rate_hz, 0);
+    if(!write(ctx, 0, h, sizeof(h))) c->error = true;
+    return !c->error;
+}
+
+bool atm_capture_service(AtmCapture* c, AtmCaptureWrite write, void* ctx, bool flush) {
+    uint32_t count = atm_block_ring_count(&c->ring);
+    if(count == 0 || (count < ATM_CAPTURE_WRITE_BLOCKS && !flush)) return false;
+    if(count > ATM_CAPTURE_WRITE_BLOCKS) count = ATM_CAPTURE_WRITE_BLOCKS;
+
+    // One write per run of blocks that lie in one piece in the ring. Runs start on multiples of
+    // ATM_CAPTURE_WRITE_BLOCKS until the final flush, so only that one can be cut short here.
+    const uint32_t first = c->ring.tail & (c->ring.capacity - 1);
+    if(count > c->ring.capacity - first) count = c->ring.capacity - first;
+
+    const AtmBlock* run = atm_block_ring_front(&c->ring);
+    const size_t size = (size_t)count * ATM_BLOCK_SAMPLES;
+    if(!c->error) {
+        if(write(ctx, ATM_CAPTURE_HEADER_SIZE + c->bytes, *run, size)) {
+            c->bytes += (uint32_t)size;
+        } else {
+            c->error = true;
+        }
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        atm_block_ring_pop(&c->ring);
+    }
+    return true;
+}
+
+bool atm_capture_finish(AtmCapture* c, AtmCaptureWrite write, void* ctx) {
+    while(atm_capture_service(c, write, ctx, true)) {
+    }
+
+    uint8_t h[ATM_CAPTURE_HEADER_SIZE];
+    atm_capture_header(h, c->rate_hz, c->bytes);
+    if(!c->error && !write(ctx, 0, h, sizeof(h))) c->error = true;
+    return !c->error;
+}
@@ -0,0 +1,963 @@
+#include "lib/ATMengine.h"
+#include "lib/Synth.h"
+
+#include <math.h>
+#include <string.h>
+
+static const uint16_t noteTable[64] = {0,    262,  277,  294,  311,  330,  349,  370,  392,  415,
+                                       440,  466,  494,  523,  554,  587,  622,  659,  698,  740,
+                                       784,  831,  880,  932,  988,  1047, 1109, 1175, 1245, 1319,
+                                       1397, 1480, 1568, 1661, 1760, 1865, 1976, 2093, 2217, 2349,
+                                       2489, 2637, 2794, 2960, 3136, 3322, 3520, 3729, 3951, 4186,
+                                       4435, 4699, 4978, 5274, 5588, 5920, 6272, 6645, 7040, 7459,
+                                       7902, 8372, 8870, 9397};
+
+struct AtmOutputRate {
+    uint32_t hz;
+    uint32_t freq_scale_q16;
+};
+
+// Note-table frequencies are phase steps of a 16-bit accumulator at ATM_LOGICAL_HZ. Other rates
+// keep that pitch by scaling the step; the 16 fractional bits keep the error under 0.02 cent.
+static constexpr AtmOutputRate atm_output_rate(uint32_t hz) {
+    return AtmOutputRate{hz, (uint32_t)((((uint64_t)ATM_LOGICAL_HZ << 16) + hz / 2) / hz)};
+}
+
+static constexpr AtmOutputRate atm_output_rates[] = {
+    atm_output_rate(ATM_LOGICAL_HZ),
+    atm_output_rate(62500),
+    atm_output_rate(48000),
+    atm_output_rate(44100),
+    atm_output_rate(22050),
+};
+
+static_assert(atm_output_rates[0].freq_scale_q16 == 1u << 16, "logical rate must be unscaled");
+
+// Next byte of the channel at *pos. A paged read whose page is not cached yet counts a miss and
+// returns 0; the caller stops there.
+static inline uint8_t atm_src_byte(AtmSongSource* src, uint32_t* pos) {
+    const uint32_t p = (*pos)++;
+    if(src->data) return src->data[p];
+    uint8_t b = 0;
+    if(!atm_pager_byte(src->pager, p, &b)) src->misses++;
+    return b;
+}
+
+// Data offset where track starts.
+static inline uint32_t atm_src_track(const AtmSongSource* src, uint8_t track) {
+    if(src->data) return src->list[track];
+    // Past the data, which every read treats as an error: only a corrupt image gets here.
+    const AtmPager* p = src->pager;
+    return track < p->track_count ? p->tracks[track] : p->data_size;
+}
+
+static uint16_t read_vle(AtmSongSource* src, uint32_t* pos) {
+    uint16_t q = 0;
+    uint8_t d;
+    do {
+        q <<= 7;
+        d = atm_src_byte(src, pos);
+        q |= (d & 0x7F);
+    } while(d & 0x80);
+    return q;
+}
+
+// Table index of note after the global pitch shift. Note 0 is a rest and stays one; a shifted
+// note clamps to the table instead of falling silent.
+static inline uint8_t atm_shift_note(int16_t note, int8_t shift) {
+    if(note && shift) {
+        note = (int16_t)(note + shift);
+        if(note < 1) note = 1;
+    }
+    if(note < 0) note = 0;
+    if(note > 63) note = 63;
+    return (uint8_t)note;
+}
+
+static constexpr uint16_t ATM_TEMPO_MIN_Q8 = 16;
+
+// Recomputes the song-time tick length from tickRate and the output tick length from that and
+// the tempo scale.
+static void atm_retime(AtmEngine* e) {
+    e->tick_div = atm_tick_div_from_rate(e->rate_hz, e->tickRate);
+    uint64_t period = ((uint64_t)e->tick_div << 24) / e->tempo_q8;
+    if(period < (1u << 16)) period = 1u << 16;
+    e->tick_period_q16 = period;
+    e->tick_period = (uint32_t)(period >> 16);
+}
+
+static inline void atm_osc_sync_inc(AtmEngine* e, uint8_t n) {
+    e->osc[n].inc = (uint32_t)e->osc[n].freq * e->freq_scale_q16;
+}
+
+void atm_engine_init(AtmEngine* e) {
+    memset(e, 0, sizeof(*e));
+    e->rate_hz = atm_output_rates[0].hz;
+    e->freq_scale_q16 = atm_output_rates[0].freq_scale_q16;
+    e->ChannelActiveMute = 0b11110000;
+    e->tickRate = 25;
+    e->tempo_q8 = 256;
+    atm_retime(e);
+    e->master_gain_q8 = 256;
+}
+
+bool atm_engine_set_output_rate(AtmEngine* e, uint32_t hz) {
+    for(size_t i = 0; i < sizeof(atm_output_rates) / sizeof(atm_output_rates[0]); i++) {
+        if(atm_output_rates[i].hz != hz) continue;
+        e->rate_hz = hz;
+        e->freq_scale_q16 = atm_output_rates[i].freq_scale_q16;
+        atm_retime(e);
+        atm_engine_sync_osc(e);
+        return true;
+    }
+    return false;
+}
+
+void atm_engine_set_tempo_q8(AtmEngine* e, uint16_t q8) {
+    e->tempo_q8 = q8 < ATM_TEMPO_MIN_Q8 ? ATM_TEMPO_MIN_Q8 : q8;
+    atm_retime(e);
+}
+
+void atm_engine_set_tick_rate(AtmEngine* e, uint8_t tick_rate) {
+    e->tickRate = tick_rate;
+    atm_retime(e);
+}
+
+void atm_engine_sync_osc(AtmEngine* e) {
+    for(uint8_t n = 0; n < ATM_VOICES; n++) {
+        atm_osc_sync_inc(e, n);
+    }
+}
+
+static void atm_engine_publish_levels(AtmEngine* e, const uint8_t levels[4]) {
+    const uint32_t seq = e->level_seq + 1;
+    memcpy(e->levels[seq & 1], levels, 4);
+    __atomic_store_n(&e->level_seq, seq, __ATOMIC_RELEASE);
+}
+
+void atm_engine_reset_meters(AtmEngine* e) {
+    static const uint8_t zero[4] = {0, 0, 0, 0};
+    for(uint8_t i = 0; i < 4; i++) {
+        vol_meter_reset(&e->channel_meters[i]);
+    }
+    atm_engine_publish_levels(e, zero);
+}
+
+void atm_engine_read_levels(const AtmEngine* e, uint8_t out[4]) {
+    uint32_t seq;
+    do {
+        seq = __atomic_load_n(&e->level_seq, __ATOMIC_ACQUIRE);
+        memcpy(out, e->levels[seq & 1], 4);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while(__atomic_load_n(&e->level_seq, __ATOMIC_RELAXED) - seq > 1);
+}
+
+// Resets the song state and starts the channels at the ENTRY tracks of e->song.
+static void atm_engine_start(AtmEngine* e, const uint8_t entry[4]) {
+    memset(e->channel_state, 0, sizeof(e->channel_state));
+    memset(e->call_stack, 0, sizeof(e->call_stack));
+    // The song's oscillators; those of sound effects in the extended build keep playing.
+    memset(e->osc, 0, sizeof(osc_t) * 4);
+    atm_engine_reset_meters(e);
+    e->ChannelActiveMute = 0b11110000;
+
+    e->tickRate = 25;
+    atm_retime(e);
+    e->tick_acc = 0;
+    e->tick_frac = 0;
+    e->pitch_applied = e->pitch_shift;
+    __atomic_store_n(&e->tick_pending, 0, __ATOMIC_RELAXED);
+
+    e->osc[3].freq = 0x0001;
+    atm_osc_sync_inc(e, 3);
+    e->channel_state[3].freq = 0x0001;
+
+    for(uint8_t n = 0; n < 4; n++) {
+        e->channel_state[n].pos = atm_src_track(&e->song, entry[n]);
+    }
+
+    e->song_pos = 0;
+    e->tick_lead = e->tick_div;
+    e->song_ended = false;
+    e->runaway = 0;
+    atm_event_ring_reset(&e->events);
+}
+
+void atm_engine_load(AtmEngine* e, const uint8_t* song) {
+    e->trackCount = song[0];
+    e->song.data = song + 1 + e->trackCount * 2 + 4;
+    e->song.list = (const uint16_t*)(song + 1);
+    e->song.pager = NULL;
+    e->song.misses = 0;
+    atm_engine_start(e, song + 1 + e->trackCount * 2);
+}
+
+void atm_engine_load_paged(AtmEngine* e, AtmPager* pager) {
+    e->trackCount = pager->track_count;
+    e->song.data = NULL;
+    e->song.list = NULL;
+    e->song.pager = pager;
+    e->song.misses = 0;
+    atm_engine_start(e, pager->entry);
+}
+
+// Runs up to ticks ticks of a copy of e on scratch, stopping after the first one that missed
+// a page. The copy reads through the same pager, so its misses request the pages. Returns the
+// ticks that ran without a miss.
+static uint32_t atm_engine_run_ahead(const AtmEngine* e, AtmEngine* scratch, uint32_t ticks) {
+    memcpy(scratch, e, sizeof(*scratch));
+    scratch->events_enabled = false;
+    scratch->song.misses = 0;
+    uint32_t done = 0;
+    while(done < ticks && !scratch->song_ended) {
+        atm_engine_playroutine(scratch);
+        if(scratch->song.misses) break;
+        done++;
+    }
+    return done;
+}
+
+bool atm_engine_tick_ready(const AtmEngine* e, AtmEngine* scratch) {
+    if(!e->song.pager || e->song_ended) return true;
+    return atm_engine_run_ahead(e, scratch, 1) == 1;
+}
+
+void atm_engine_prefetch(const AtmEngine* e, AtmEngine* scratch, uint32_t ticks) {
+    if(e->song.pager) atm_engine_run_ahead(e, scratch, ticks);
+}
+
+static inline uint16_t atm_list_entry(const uint8_t* song, uint8_t track) {
+    return (uint16_t)(song[1 + track * 2] | (song[2 + track * 2] << 8));
+}
+
+static inline bool atm_track_relaid(const uint32_t relaid[8], uint8_t track) {
+    return relaid[track >> 5] & (1u << (track & 31));
+}
+
+// Translates a data offset of the engine's song into song: same track, same distance from its
+// start. Tracks are stored in order, so the offset belongs to the last one starting at or before
+// it; empty tracks share their start with the next one and lose the tie.
+static bool atm_rebase_offset(
+    const AtmEngine* e,
+    const uint8_t* song,
+    const uint32_t relaid[8],
+    uint32_t off,
+    uint32_t* out) {
+    uint8_t track = 0;
+    for(uint8_t i = 1; i < e->trackCount; i++) {
+        if(atm_src_track(&e->song, i) <= off) track = i;
+    }
+    if(track >= song[0] || atm_track_relaid(relaid, track)) return false;
+
+    *out = atm_list_entry(song, track) + (off - atm_src_track(&e->song, track));
+    return true;
+}
+
+static bool atm_rebase_channel(
+    const AtmEngine* e,
+    const uint8_t* song,
+    const uint32_t relaid[8],
+    ch_t* ch,
+    AtmCallStack* stack) {
+    ch_t moved = *ch;
+    AtmCallStack moved_stack = *stack;
+
+    for(uint8_t i = 0; i < ch->stackIndex; i++) {
+        if(!atm_rebase_offset(e, song, relaid, stack->pointer[i], &moved_stack.pointer[i]))
+            return false;
+    }
+
+    if(!atm_rebase_offset(e, song, relaid, ch->pos, &moved.pos)) {
+        // A stopped channel never reads pos again; a song repeat replaces it.
+        if(ch->delay != 0xFFFF) return false;
+        moved.pos = 0;
+    }
+
+    *ch = moved;
+    *stack = moved_stack;
+    return true;
+}
+
+bool atm_engine_rebase_channels(
+    const AtmEngine* e,
+    const uint8_t* song,
+    const uint32_t relaid[8],
+    ch_t ch[4],
+    AtmCallStack stack[4]) {
+    if(e->song.pager) return false;
+    ch_t moved[4];
+    AtmCallStack moved_stack[4];
+    for(uint8_t n = 0; n < 4; n++) {
+        moved[n] = ch[n];
+        moved_stack[n] = stack[n];
+        if(!atm_rebase_channel(e, song, relaid, &moved[n], &moved_stack[n])) return false;
+    }
+    memcpy(ch, moved, sizeof(moved));
+    memcpy(stack, moved_stack, sizeof(moved_stack));
+    return true;
+}
+
+bool atm_engine_rebase(AtmEngine* e, const uint8_t* song, const uint32_t relaid[8]) {
+    if(!atm_engine_rebase_channels(e, song, relaid, e->channel_state, e->call_stack)) return false;
+
+    e->trackCount = song[0];
+    e->song.list = (const uint16_t*)(song + 1);
+    e->song.data = song + 1 + e->trackCount * 2 + 4;
+    return true;
+}
+
+// The device build plays the full four voices; -DATM_SYNTH_LITE selects two of them,
+// -DATM_SYNTH_EXTENDED adds four for sound effects.
+#if defined(ATM_SYNTH_EXTENDED)
+template <typename Sample>
+using AtmSynthSong = AtmSynthExtended<Sample>;
+template <typename Sample>
+using AtmSynthSongUniform = AtmSynthExtendedUniform<Sample>;
+#elif defined(ATM_SYNTH_LITE)
+template <typename Sample>
+using AtmSynthSong = AtmSynthLite<Sample>;
+template <typename Sample>
+using AtmSynthSongUniform = AtmSynthLiteUniform<Sample>;
+#else
+template <typename Sample>
+using AtmSynthSong = AtmSynthNormal<Sample>;
+template <typename Sample>
+using AtmSynthSongUniform = AtmSynthUniform<Sample>;
+#endif
+
+// Counts count samples towards the next tick, queueing every tick that falls due.
+static inline void atm_engine_count_ticks(AtmEngine* e, size_t count) {
+    uint32_t due = 0;
+    while(count) {
+        const uint32_t n = e->tick_acc < e->tick_period ? e->tick_period - e->tick_acc : 1;
+        if(n > count) {
+            e->tick_acc += (uint32_t)count;
+            break;
+        }
+        count -= n;
+        e->tick_acc = 0;
+        due++;
+    }
+    if(due) __atomic_fetch_add(&e->tick_pending, due, __ATOMIC_RELAXED);
+}
+
+template <class Synth>
+static void atm_engine_render_with(AtmEngine* e, typename Synth::Sample* out, size_t count) {
+    static_assert(Synth::slots == ATM_VOICES, "one synth slot per oscillator");
+    if(!count) return;
+    const uint16_t gain_q8 = __atomic_load_n(&e->master_gain_q8, __ATOMIC_RELAXED);
+
+    // Only voices with a volume are synthesized; the rest are caught up in one step afterwards.
+    uint8_t peak[ATM_VOICES] = {};
+    const uint8_t active =
+        atm_synth_render<Synth>(atm_synth_active<Synth>(e->osc), e->osc, out, count, gain_q8, peak);
+    atm_synth_skip<Synth>(e->osc, (uint8_t)(Synth::on & ~active), count);
+    atm_engine_count_ticks(e, count);
+
+    atm_synth_peaks<Synth>(e->osc, peak);
+    const uint32_t decay_q16 = vol_meter_decay_q16((uint32_t)count);
+    uint8_t levels[4];
+    for(uint8_t i = 0; i < 4; i++) {
+        // A channel's meter shows its sound effect too.
+        const uint8_t sfx = peak[atm_sfx_osc(i)];
+        levels[i] = vol_meter_block(
+            &e->channel_meters[i], peak[i] > sfx ? peak[i] : sfx, decay_q16);
+    }
+    atm_engine_publish_levels(e, levels);
+}
+
+template <typename Sample>
+static void atm_engine_render_as(AtmEngine* e, Sample* out, size_t count) {
+    if(__atomic_load_n(&e->uniform_tone_mode, __ATOMIC_RELAXED)) {
+        atm_engine_render_with<AtmSynthSongUniform<Sample>>(e, out, count);
+    } else {
+        atm_engine_render_with<AtmSynthSong<Sample>>(e, out, count);
+    }
+}
+
+void atm_engine_render(AtmEngine* e, uint8_t* out, size_t count) {
+    atm_engine_render_as(e, out, count);
+}
+
+void atm_engine_render_s16(AtmEngine* e, int16_t* out, size_t count) {
+    atm_engine_render_as(e, out, count);
+}
+
+template <typename Sample>
+static size_t atm_engine_run_as(AtmEngine* e, Sample* out, size_t count) {
+    size_t done = 0;
+    while(done < count && !e->song_ended) {
+        // Render up to the next tick boundary, then run the tick before the following sample,
+        // the earliest point the device thread could have run it.
+        size_t n = e->tick_acc < e->tick_period ? e->tick_period - e->tick_acc : 1;
+        if(n > count - done) n = count - done;
+        atm_engine_render_as(e, out + done, n);
+        done += n;
+
+        while(e->tick_pending && !e->song_ended) {
+            e->tick_pending--;
+            atm_engine_tick(e);
+        }
+    }
+    return done;
+}
+
+size_t atm_engine_run(AtmEngine* e, uint8_t* out, size_t count) {
+    return atm_engine_run_as(e, out, count);
+}
+
+size_t atm_engine_run_s16(AtmEngine* e, int16_t* out, size_t count) {
+    return atm_engine_run_as(e, out, count);
+}
+
+// What a channel step did, as far as listeners outside the engine care.
+enum : uint8_t {
+    ATM_STEP_STOP = 1 << 0,
+    ATM_STEP_NOTE = 1 << 1,
+    // Stopped for exceeding ATM_STEP_MAX_COMMANDS or the call stack; comes with STOP.
+    ATM_STEP_RUNAWAY = 1 << 2,
+};
+
+// What STOP does, for a channel that has to be stopped for running away.
+static inline uint8_t atm_channel_runaway(ch_t* ch) {
+    ch->vol = 0;
+    ch->delay = 0xFFFF;
+    return ATM_STEP_STOP | ATM_STEP_RUNAWAY;
+}
+
+// Runs the effects and due commands of one channel for one tick, with stack as its call stack.
+// Song-wide commands go through the arguments: tempo into *tick_rate, GOTO_ADVANCED repeat points
+// into repeat_dst (skipped when NULL). Effects that drive the oscillator directly write to out
+// (skipped when NULL). Notes are transposed by shift on top of the channel's own transposition.
+// Bytecode comes from src; a read that misses the page cache ends the step early, which only a
+// tick ready check lets happen. Commands run are added to *commands. Returns ATM_STEP_* flags:
+// STOP executed, a note (or rest) command started.
+static uint8_t atm_channel_step(
+    ch_t* ch,
+    AtmCallStack* stack,
+    osc_t* out,
+    AtmSongSource* src,
+    uint8_t* tick_rate,
+    ch_t* repeat_dst,
+    int8_t shift,
+    uint32_t* commands) {
+    uint8_t result = 0;
+
+    if(ch->reConfig) {
+        if(ch->reCount >= (ch->reConfig & 0x03)) {
+            if(out) out->freq = noteTable[ch->reConfig >> 2];
+            ch->reCount = 0;
+        } else {
+            ch->reCount++;
+        }
+    }
+
+    if(ch->glisConfig) {
+        if(ch->glisCount >= (uint8_t)(ch->glisConfig & 0x7F)) {
+            if(ch->glisConfig & 0x80)
+                ch->note -= 1;
+            else
+                ch->note += 1;
+
+            if(ch->note < 1)
+                ch->note = 1;
+            else if(ch->note > 63)
+                ch->note = 63;
+
+            ch->freq = noteTable[atm_shift_note(ch->note, shift)];
+            ch->glisCount = 0;
+        } else {
+            ch->glisCount++;
+        }
+    }
+
+    if(ch->volFreSlide) {
+        if(!ch->volFreCount) {
+            int16_t vf = ((ch->volFreConfig & 0x40) ? (int16_t)ch->freq : (int16_t)ch->vol);
+            vf += ch->volFreSlide;
+
+            if(!(ch->volFreConfig & 0x80)) {
+                if(vf < 0)
+                    vf = 0;
+                else if(ch->volFreConfig & 0x40) {
+                    if(vf > 9397) vf = 9397;
+                } else {
+                    if(vf > 63) vf = 63;
+                }
+            }
+
+            if(ch->volFreConfig & 0x40)
+                ch->freq = (uint16_t)vf;
+            else
+                ch->vol = (uint8_t)vf;
+        }
+
+        if(ch->volFreCount++ >= (ch->volFreConfig & 0x3F)) ch->volFreCount = 0;
+    }
+
+    if(ch->arpNotes && ch->note) {
+        if((ch->arpCount & 0x1F) < (ch->arpTiming & 0x1F)) {
+            ch->arpCount++;
+        } else {
+            if((ch->arpCount & 0xE0) == 0x00)
+                ch->arpCount = 0x20;
+            else if(
+                (ch->arpCount & 0xE0) == 0x20 && !(ch->arpTiming & 0x40) &&
+                (ch->arpNotes != 0xFF))
+                ch->arpCount = 0x40;
+            else
+                ch->arpCount = 0x00;
+
+            uint8_t arpNote = ch->note;
+
+            if((ch->arpCount & 0xE0) != 0x00) {
+                if(ch->arpNotes == 0xFF)
+                    arpNote = 0;
+                else
+                    arpNote = (uint8_t)(arpNote + (ch->arpNotes >> 4));
+            }
+            if((ch->arpCount & 0xE0) == 0x40)
+                arpNote = (uint8_t)(arpNote + (ch->arpNotes & 0x0F));
+
+            int16_t idx = (int16_t)arpNote + (int16_t)ch->transConfig;
+            if(arpNote) idx = (int16_t)(idx + shift);
+            if(idx < 0) idx = 0;
+            if(idx > 63) idx = 63;
+            ch->freq = noteTable[idx];
+        }
+    }
+
+    if(ch->treviDepth) {
+        int16_t vt = ((ch->treviConfig & 0x40) ? (int16_t)ch->freq : (int16_t)ch->vol);
+        vt = (ch->treviCount & 0x80) ? (vt + ch->treviDepth) : (vt - ch->treviDepth);
+
+        if(vt < 0)
+            vt = 0;
+        else if(ch->treviConfig & 0x40) {
+            if(vt > 9397) vt = 9397;
+        } else {
+            if(vt > 63) vt = 63;
+        }
+
+        if(ch->treviConfig & 0x40)
+            ch->freq = (uint16_t)vt;
+        else
+            ch->vol = (uint8_t)vt;
+
+        if((ch->treviCount & 0x1F) < (ch->treviConfig & 0x1F))
+            ch->treviCount++;
+        else
+            ch->treviCount = (ch->treviCount & 0x80) ? 0 : 0x80;
+    }
+
+    if(ch->delay) {
+        if(ch->delay != 0xFFFF) ch->delay--;
+    } else {
+        const uint32_t misses = src->misses;
+        uint32_t ran = 0;
+        do {
+            if(ran == ATM_STEP_MAX_COMMANDS) {
+                result |= atm_channel_runaway(ch);
+                break;
+            }
+            ran++;
+            uint8_t cmd = atm_src_byte(src, &ch->pos);
+
+            if(cmd < 64) {
+                result |= ATM_STEP_NOTE;
+                if((ch->note = cmd)) ch->note = (uint8_t)(ch->note + (int8_t)ch->transConfig);
+
+                ch->freq = noteTable[atm_shift_note(ch->note, shift)];
+
+                if(!ch->volFreConfig) ch->vol = ch->reCount;
+
+                if(ch->arpTiming & 0x20) ch->arpCount = 0;
+            } else if(cmd < 160) {
+                switch(cmd - 64) {
+                case 0:
+                    ch->vol = atm_src_byte(src, &ch->pos);
+                    ch->reCount = ch->vol;
+                    break;
+
+                case 1:
+                case 4:
+                    ch->volFreSlide = (int8_t)(atm_src_byte(src, &ch->pos));
+                    ch->volFreConfig = ((cmd - 64) == 1) ? 0x00 : 0x40;
+                    break;
+
+                case 2:
+                case 5:
+                    ch->volFreSlide = (int8_t)(atm_src_byte(src, &ch->pos));
+                    ch->volFreConfig = atm_src_byte(src, &ch->pos);
+                    break;
+
+                case 3:
+                case 6:
+                    ch->volFreSlide = 0;
+                    break;
+
+                case 7:
+                    ch->arpNotes = atm_src_byte(src, &ch->pos);
+                    ch->arpTiming = atm_src_byte(src, &ch->pos);
+                    break;
+
+                case 8:
+                    ch->arpNotes = 0;
+                    break;
+
+                case 9:
+                    ch->reConfig = atm_src_byte(src, &ch->pos);
+                    break;
+
+                case 10:
+                    ch->reConfig = 0;
+                    break;
+
+                case 11:
+                    ch->transConfig = (int8_t)(ch->transConfig + (int8_t)(atm_src_byte(src, &ch->pos)));
+                    break;
+
+                case 12:
+                    ch->transConfig = (int8_t)(atm_src_byte(src, &ch->pos));
+                    break;
+
+                case 13:
+                    ch->transConfig = 0;
+                    break;
+
+                case 14:
+                case 16:
+                    // One byte each, as the compiler emits them.
+                    ch->treviDepth = atm_src_byte(src, &ch->pos);
+                    ch->treviConfig = (uint8_t)(atm_src_byte(src, &ch->pos) +
+                                                (((cmd - 64) == 14) ? 0x00 : 0x40));
+                    break;
+
+                case 15:
+                case 17:
+                    ch->treviDepth = 0;
+                    break;
+
+                case 18:
+                    ch->glisConfig = (int8_t)(atm_src_byte(src, &ch->pos));
+                    break;
+
+                case 19:
+                    ch->glisConfig = 0;
+                    break;
+
+                case 20:
+                    ch->arpNotes = 0xFF;
+                    ch->arpTiming = atm_src_byte(src, &ch->pos);
+                    break;
+
+                case 21:
+                    ch->arpNotes = 0;
+                    break;
+
+                case 92:
+                    *tick_rate = (uint8_t)(*tick_rate + atm_src_byte(src, &ch->pos));
+                    if(*tick_rate < 1) *tick_rate = 1;
+                    break;
+
+                case 93:
+                    *tick_rate = atm_src_byte(src, &ch->pos);
+                    if(*tick_rate < 1) *tick_rate = 1;
+                    break;
+
+                case 94:
+                    for(uint8_t i = 0; i < 4; i++) {
+                        const uint8_t repeatPoint = atm_src_byte(src, &ch->pos);
+                        if(repeat_dst) repeat_dst[i].repeatPoint = repeatPoint;
+                    }
+                    break;
+
+                case 95:
+                    result |= ATM_STEP_STOP;
+                    ch->vol = 0;
+                    ch->delay = 0xFFFF;
+                    break;
+
+                default:
+                    break;
+                }
+            } else if(cmd < 224) {
+                ch->delay = (uint16_t)(cmd - 159);
+            } else if(cmd == 224) {
+                ch->delay = (uint16_t)(read_vle(src, &ch->pos) + 65);
+            } else if(cmd == 252 || cmd == 253) {
+                uint8_t new_counter = (cmd == 252) ? 0 : atm_src_byte(src, &ch->pos);
+                uint8_t new_track = atm_src_byte(src, &ch->pos);
+
+                if(new_track != ch->track) {
+                    if(ch->stackIndex == 7) {
+                        result |= atm_channel_runaway(ch);
+                        break;
+                    }
+                    stack->counter[ch->stackIndex] = ch->counter;
+                    stack->track[ch->stackIndex] = ch->track;
+                    stack->pointer[ch->stackIndex] = ch->pos;
+                    ch->stackIndex++;
+                    ch->track = new_track;
+                }
+                ch->counter = new_counter;
+                ch->pos = atm_src_track(src, ch->track);
+            } else if(cmd == 254) {
+                if(ch->counter > 0 || ch->stackIndex == 0) {
+                    if(ch->counter) ch->counter--;
+                    ch->pos = atm_src_track(src, ch->track);
+                } else {
+                    if(ch->stackIndex == 0) {
+                        ch->delay = 0xFFFF;
+                    } else {
+                        ch->stackIndex--;
+                        ch->pos = stack->pointer[ch->stackIndex];
+                        ch->counter = stack->counter[ch->stackIndex];
+                        ch->track = stack->track[ch->stackIndex];
+                    }
+                }
+            } else if(cmd == 255) {
+                const uint16_t skip = read_vle(src, &ch->pos);
+                ch->pos += skip;
+            } else {
+            }
+        } while(ch->delay == 0 && src->misses == misses);
+        *commands += ran;
+
+        if(ch->delay != 0xFFFF) ch->delay--;
+    }
+
+    return result;
+}
+
+// Loads what channel n (or a sound effect on it) plays into osc[o].
+static inline void atm_channel_to_osc(AtmEngine* e, uint8_t n, const ch_t* ch, uint8_t o) {
+    const uint8_t uniform = __atomic_load_n(&e->uniform_tone_mode, __ATOMIC_RELAXED);
+    if(n == 3 && !uniform) {
+        e->osc[o].vol = (uint8_t)(ch->vol >> 1);
+    } else {
+        e->osc[o].freq = ch->freq;
+        e->osc[o].vol = uniform ? (uint8_t)((ch->vol * 3) >> 2) : ch->vol;
+    }
+}
+
+static void atm_emit(AtmEngine* e, AtmMusicEventType type, uint8_t ch, uint8_t value, uint8_t vol) {
+    AtmMusicEvent ev;
+    ev.pos = e->song_pos + e->tick_lead;
+    ev.type = type;
+    ev.ch = ch;
+    ev.value = value;
+    ev.vol = vol;
+    atm_event_push(&e->events, &ev);
+}
+
+static inline void atm_emit_channel(AtmEngine* e, uint8_t n, uint8_t step) {
+    const ch_t* ch = &e->channel_state[n];
+    if(step & ATM_STEP_STOP) {
+        atm_emit(e, AtmMusicNoteOff, n, 0, 0);
+    } else if(step & ATM_STEP_NOTE) {
+        // The note as heard, with the clamp the note command applies before its table lookup.
+        const uint8_t note = atm_shift_note(ch->note, e->pitch_shift);
+        if(note > 0) {
+            atm_emit(e, AtmMusicNoteOn, n, note, ch->vol);
+        } else {
+            atm_emit(e, AtmMusicNoteOff, n, 0, 0);
+        }
+    }
+}
+
+void atm_engine_playroutine(AtmEngine* e) {
+    ch_t* ch;
+    e->tick_commands = 0;
+
+    // A new pitch shift also moves the notes already sounding.
+    if(e->pitch_applied != e->pitch_shift) {
+        e->pitch_applied = e->pitch_shift;
+        for(uint8_t n = 0; n < 4; n++) {
+            ch = &e->channel_state[n];
+            if(ch->note) ch->freq = noteTable[atm_shift_note(ch->note, e->pitch_shift)];
+        }
+    }
+
+    for(uint8_t n = 0; n < 4; n++) {
+        ch = &e->channel_state[n];
+
+        // A channel borrowed by a sound effect keeps its song position but stays off the oscillator.
+        const bool sfx_owned = atm_sfx_osc(n) == n && e->sfx[n].active;
+        const uint8_t rate = e->tickRate;
+        const uint8_t step = atm_channel_step(
+            ch,
+            &e->call_stack[n],
+            sfx_owned ? NULL : &e->osc[n],
+            &e->song,
+            &e->tickRate,
+            e->channel_state,
+            e->pitch_shift,
+            &e->tick_commands);
+        if(step & ATM_STEP_STOP) {
+            e->ChannelActiveMute = (uint8_t)(e->ChannelActiveMute ^ (1 << (n + 4)));
+        }
+        if(step & ATM_STEP_RUNAWAY) e->runaway |= (uint8_t)(1 << n);
+        if(e->tickRate != rate) atm_retime(e);
+
+        if(e->events_enabled) {
+            if(step) atm_emit_channel(e, n, step);
+            if(e->tickRate != rate) atm_emit(e, AtmMusicTempo, 0xFF, e->tickRate, 0);
+        }
+
+        if(!sfx_owned) {
+            if(!(e->ChannelActiveMute & (1 << n))) atm_channel_to_osc(e, n, ch, n);
+            atm_osc_sync_inc(e, n);
+        }
+
+        if(!(e->ChannelActiveMute & 0xF0)) {
+            uint8_t repeatSong = 0;
+            for(uint8_t j = 0; j < 4; j++)
+                repeatSong = (uint8_t)(repeatSong + e->channel_state[j].repeatPoint);
+
+            // A song that had to be stopped for running away would only run away again.
+            if(repeatSong && !e->runaway) {
+                for(uint8_t k = 0; k < 4; k++) {
+                    e->channel_state[k].pos =
+                        atm_src_track(&e->song, e->channel_state[k].repeatPoint);
+                    e->channel_state[k].delay = 0;
+                }
+                e->ChannelActiveMute = 0b11110000;
+                if(e->events_enabled) atm_emit(e, AtmMusicLoop, 0xFF, 0, 0);
+            } else {
+                if(e->events_enabled && !e->song_ended) atm_emit(e, AtmMusicEnd, 0xFF, 0, 0);
+                e->song_ended = true;
+            }
+        }
+    }
+}
+
+void atm_engine_tick(AtmEngine* e) {
+    atm_engine_playroutine(e);
+    e->song_pos += e->tick_div;
+
+    // A scaled tempo makes ticks a fractional number of samples long: carry the remainder into
+    // the length of the next one. Done here rather than in the renderer so that a tempo change
+    // in this tick keeps the carry.
+    e->tick_frac += (uint32_t)(e->tick_period_q16 & 0xFFFF);
+    e->tick_period = (uint32_t)(e->tick_period_q16 >> 16) + (e->tick_frac >> 16);
+    e->tick_frac &= 0xFFFF;
+}
+
+void atm_engine_sfx_release(AtmEngine* e, uint8_t n) {
+    e->sfx[n].active = 0;
+    const uint8_t o = atm_sfx_osc(n);
+    if(o == n && !(e->ChannelActiveMute & (1 << n)))
+        atm_channel_to_osc(e, n, &e->channel_state[n], n);
+    else
+        e->osc[o].vol = 0;
+    atm_osc_sync_inc(e, o);
+}
+
+void atm_engine_sfx_tick(AtmEngine* e, uint8_t n) {
+    AtmSfxSlot* sfx = &e->sfx[n];
+    const uint8_t o = atm_sfx_osc(n);
+    uint32_t commands = 0;
+    const uint8_t step = atm_channel_step(
+        &sfx->ch, &sfx->stack, &e->osc[o], &sfx->src, &sfx->tick_rate, NULL, 0, &commands);
+    if(step & ATM_STEP_STOP) {
+        atm_engine_sfx_release(e, n);
+        return;
+    }
+    atm_channel_to_osc(e, n, &sfx->ch, o);
+    atm_osc_sync_inc(e, o);
+    sfx->next_tick += atm_tick_div_from_rate(e->rate_hz, sfx->tick_rate);
+}
+
+void atm_engine_sfx_start(
+    AtmEngine* e,
+    const uint8_t* sfx_song,
+    uint8_t n,
+    uint8_t priority,
+    uint32_t now) {
+    AtmSfxSlot* sfx = &e->sfx[n];
+    if(sfx->active && sfx->priority > priority) return;
+
+    memset(sfx, 0, sizeof(*sfx));
+    const uint8_t count = sfx_song[0];
+    sfx->src.list = (const uint16_t*)(sfx_song + 1);
+    sfx->src.data = sfx_song + 1 + count * 2 + 4;
+    sfx->ch.pos = atm_src_track(&sfx->src, sfx_song[1 + count * 2 + n]);
+    if(n == 3) sfx->ch.freq = 0x0001;
+    // An oscillator of its own for the noise needs the LFSR seeded.
+    const uint8_t o = atm_sfx_osc(n);
+    if(o != n && n == 3 && !e->osc[o].freq) e->osc[o].freq = 0x0001;
+    sfx->tick_rate = 25;
+    sfx->priority = priority;
+    sfx->active = 1;
+
+    // The first tick runs right away, so the effect is audible from the next rendered block.
+    sfx->next_tick = now;
+    atm_engine_sfx_tick(e, n);
+}
+
+// Output RMS the auto gain aims for, and the range it may move the gain in.
+static constexpr uint32_t ATM_AUTO_GAIN_TARGET_RMS = 32;
+static constexpr uint32_t ATM_AUTO_GAIN_MIN_Q8 = 64;
+static constexpr uint32_t ATM_AUTO_GAIN_MAX_Q8 = 1024;
+
+// Samples the loudness scan synthesizes at the start of each tick; the rest of the tick is
+// skipped. Phases drift from tick to tick, so over a song the windows see every part of a wave.
+static constexpr uint32_t ATM_SCAN_WINDOW_SAMPLES = 32;
+
+void atm_engine_scan_loudness(
+    AtmEngine* scratch,
+    const uint8_t* song,
+    uint32_t max_samples,
+    AtmLoudness* out) {
+    typedef AtmSynthSong<int16_t> Synth;
+    atm_engine_init(scratch);
+    atm_engine_load(scratch, song);
+
+    uint32_t peak = 0;
+    uint64_t energy = 0;
+    uint64_t samples = 0;
+    uint8_t voice_peak[ATM_VOICES] = {};
+
+    while(scratch->song_pos < max_samples && !scratch->song_ended) {
+        atm_engine_tick(scratch);
+
+        osc_t* o = scratch->osc;
+        const uint32_t sum = (uint32_t)o[0].vol + o[1].vol + o[2].vol + o[3].vol;
+        if(sum > peak) peak = sum;
+
+        // The mix of a window, before gain, standing in for the whole tick.
+        const uint32_t div = scratch->tick_div;
+        const uint32_t window = div < ATM_SCAN_WINDOW_SAMPLES ? div : ATM_SCAN_WINDOW_SAMPLES;
+        if(!window) continue;
+        uint64_t e = 0;
+        if(atm_synth_active<Synth>(o)) {
+            for(uint32_t i = 0; i < window; i++) {
+                const int32_t mix = Synth::Mix::sum(atm_synth_voices<Synth, Synth::on>(o, 0, voice_peak));
+                e += (uint64_t)(mix * mix);
+            }
+            atm_synth_skip<Synth>(o, Synth::on, div - window);
+        } else {
+            atm_synth_skip<Synth>(o, Synth::on, div);
+        }
+        energy += e * div / window;
+        samples += div;
+    }
+
+    // Peak stays the sum of the volumes: square waves reach it whenever their phases line up,
+    // which a window may happen to miss.
+    out->peak = (uint16_t)peak;
+    out->rms = samples ? (uint16_t)(sqrtf((float)energy / (float)samples) + 0.5f) : 0;
+}
+
+uint16_t atm_auto_gain_q8(const AtmLoudness* l) {
+    if(!l->peak || !l->rms) return 256;
+
+    // Output is mix * gain_q8 >> 9, clipped at 127.
+    uint32_t q8 = (ATM_AUTO_GAIN_TARGET_RMS << 9) / l->rms;
+    const uint32_t no_clip = (127u << 9) / l->peak;
+    if(q8 > no_clip) q8 = no_clip;
+    if(q8 < ATM_AUTO_GAIN_MIN_Q8) q8 = ATM_AUTO_GAIN_MIN_Q8;
+    if(q8 > ATM_AUTO_GAIN_MAX_Q8) q8 = ATM_AUTO_GAIN_MAX_Q8;
+    return (uint16_t)q8;
+}
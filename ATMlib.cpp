@@ -1,110 +1,26 @@
 #include "lib/ATMlib.h"
-#include "lib/Vol.h"
+#include "lib/ATMcapture.h"
+#include "lib/ATMengine.h"
+#include "lib/Blocks.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <furi.h>
 #include <furi_hal.h>
+#include <storage/storage.h>
 #include <stm32wbxx_ll_tim.h>
 #include <stm32wbxx_ll_dma.h>
 
-uint8_t trackCount = 0;
-uint8_t tickRate = 25;
-const uint16_t* trackList = NULL;
-const uint8_t* trackBase = NULL;
-
 uint8_t pcm = 128;
 uint16_t cia = 1;
 uint16_t cia_count = 1;
 
-osc_t osc[4];
-
-static uint8_t ChannelActiveMute = 0b11110000;
-
-static const uint16_t noteTable[64] = {0,    262,  277,  294,  311,  330,  349,  370,  392,  415,
-                                       440,  466,  494,  523,  554,  587,  622,  659,  698,  740,
-                                       784,  831,  880,  932,  988,  1047, 1109, 1175, 1245, 1319,
-                                       1397, 1480, 1568, 1661, 1760, 1865, 1976, 2093, 2217, 2349,
-                                       2489, 2637, 2794, 2960, 3136, 3322, 3520, 3729, 3951, 4186,
-                                       4435, 4699, 4978, 5274, 5588, 5920, 6272, 6645, 7040, 7459,
-                                       7902, 8372, 8870, 9397};
-
-struct ch_t {
-    const uint8_t* ptr;
-    uint8_t note;
-
-    uint16_t stackPointer[7];
-    uint8_t stackCounter[7];
-    uint8_t stackTrack[7];
-
-    uint8_t stackIndex;
-    uint8_t repeatPoint;
-
-    uint16_t delay;
-    uint8_t counter;
-    uint8_t track;
-
-    uint16_t freq;
-    uint8_t vol;
-
-    int8_t volFreSlide;
-    uint8_t volFreConfig;
-    uint8_t volFreCount;
-
-    uint8_t arpNotes;
-    uint8_t arpTiming;
-    uint8_t arpCount;
-
-    uint8_t reConfig;
-    uint8_t reCount;
-
-    int8_t transConfig;
-
-    uint8_t treviDepth;
-    uint8_t treviConfig;
-    uint8_t treviCount;
-
-    int8_t glisConfig;
-    uint8_t glisCount;
-};
-
-static ch_t channel_state[4];
-static VolMeter channel_meters[4];
-
-static inline uint8_t abs_i8_to_u8(int8_t v) {
-    return (uint8_t)(v < 0 ? -v : v);
-}
-
-static uint16_t read_vle(const uint8_t** pp) {
-    uint16_t q = 0;
-    uint8_t d;
-    do {
-        q <<= 7;
-        d = *(*pp)++;
-        q |= (d & 0x7F);
-    } while(d & 0x80);
-    return q;
-}
-
-static inline const uint8_t* getTrackPointer(uint8_t track) {
-    return trackBase + trackList[track];
-}
-
-static inline uint16_t read_u16_le(const uint8_t** pp) {
-    uint16_t lo = *(*pp)++;
-    uint16_t hi = *(*pp)++;
-    return (uint16_t)(lo | (hi << 8));
-}
+static AtmEngine atm_engine;
 
 static constexpr uint32_t ATM_PWM_ARR = 255;
 static constexpr uint32_t ATM_PWM_PSC = 3;
-static constexpr uint32_t ATM_LOGICAL_HZ = 31250;
-
-static inline uint32_t tick_div_from_rate(uint8_t tr) {
-    if(tr < 1) tr = 1;
-    return (uint32_t)(ATM_LOGICAL_HZ / (uint32_t)tr);
-}
 
-static constexpr size_t ATM_LOGICAL_SAMPLES_PER_HALF = 128;
+static constexpr size_t ATM_LOGICAL_SAMPLES_PER_HALF = ATM_BLOCK_SAMPLES;
 static constexpr size_t ATM_DMA_SAMPLES_PER_HALF = ATM_LOGICAL_SAMPLES_PER_HALF * 2;
 static constexpr size_t ATM_DMA_TOTAL = ATM_DMA_SAMPLES_PER_HALF * 2;
 
@@ -113,105 +29,160 @@ static uint32_t dma_buf[ATM_DMA_TOTAL];
 static bool atm_running = false;
 static bool atm_paused = false;
 static constexpr float ATM_MASTER_GAIN_MAX = 2.0f;
-static uint16_t atm_master_gain_q8 = 256;
 
-static uint32_t atm_tick_div = 0;
-static uint32_t atm_tick_acc = 0;
-static uint32_t atm_tick_pending = 0;
+// How much of a song the loudness scan looks at.
+static constexpr uint32_t ATM_AUTO_GAIN_SCAN_SAMPLES = ATM_LOGICAL_HZ * 120;
+
+// The engine gain is the user volume times the song's auto gain, folded into one Q8 factor.
+static uint16_t atm_user_gain_q8 = 256;
+static uint16_t atm_song_gain_q8 = 256;
+
+// Likewise the engine tempo is the user's tempo scale times the fast-forward factor.
+static constexpr float ATM_TEMPO_SCALE_MIN = 0.25f;
+static constexpr float ATM_TEMPO_SCALE_MAX = 4.0f;
+static uint16_t atm_user_tempo_q8 = 256;
+static uint8_t atm_fast_forward = 1;
+
+static constexpr uint32_t ATM_SEEK_SNAPSHOT_MAX = 16;
+static constexpr uint32_t ATM_SEEK_SNAPSHOT_INTERVAL = ATM_LOGICAL_HZ * 5;
+
+// Engine state after a tick, enough to resume playback from that point without replaying the song.
+struct AtmSnapshot {
+    uint32_t pos;
+    ch_t ch[4];
+    AtmCallStack stack[4];
+    uint16_t osc_freq[4];
+    uint8_t osc_vol[4];
+    uint8_t tick_rate;
+    uint8_t active_mute;
+};
+
+// The song the engine plays, for seeking back past the first snapshot.
+static const uint8_t* atm_song = NULL;
+
+static AtmSnapshot atm_snapshots[ATM_SEEK_SNAPSHOT_MAX];
+static uint8_t atm_snapshot_count = 0;
+static uint32_t atm_snapshot_interval = ATM_SEEK_SNAPSHOT_INTERVAL;
+
+// Logical samples rendered so far; the clock sound effects are ticked against.
+static uint32_t atm_rendered_samples = 0;
+
+// Render-ahead mode (ATMsynth::setRenderAhead()): the ATM thread renders up to atm_render_ahead
+// blocks ahead into atm_ring and the DMA interrupt only copies them out. 0 renders in the
+// interrupt.
+static constexpr uint8_t ATM_RENDER_AHEAD_MAX = 16;
+static AtmBlock atm_ring_blocks[ATM_RENDER_AHEAD_MAX];
+static AtmBlockRing atm_ring;
+static uint8_t atm_render_ahead = 0;
 
 static FuriThread* atm_thread = NULL;
 static FuriMessageQueue* atm_cmd_q = NULL;
-static void dma_isr(void* ctx);
-
-static uint8_t atm_audio_enabled = 1;
-static uint32_t channel_levels_packed = 0;
-static uint8_t atm_uniform_tone_mode = 0;
-
-static inline uint8_t atm_render_logical_sample_u8() {
-    int8_t c0 = 0;
-    int8_t c1 = 0;
-    int8_t c2 = 0;
-    int8_t c3 = 0;
-    int16_t mix = 0;
-
-    const uint8_t uniform = __atomic_load_n(&atm_uniform_tone_mode, __ATOMIC_RELAXED);
-    if(uniform) {
-        for(uint8_t i = 0; i < 4; i++) {
-            osc[i].phase = (uint16_t)(osc[i].phase + osc[i].freq);
-            int8_t c = (int8_t)osc[i].vol;
-            if(osc[i].phase & 0x8000) c = (int8_t)(-c);
-            mix += c;
-            if(i == 0) c0 = c;
-            if(i == 1) c1 = c;
-            if(i == 2) c2 = c;
-            if(i == 3) c3 = c;
-        }
-    } else {
-        osc[2].phase = (uint16_t)(osc[2].phase + osc[2].freq);
-        int8_t phase2 = (int8_t)(osc[2].phase >> 8);
-        if(phase2 < 0) phase2 = (int8_t)(~phase2);
-        phase2 = (int8_t)(phase2 << 1);
-        phase2 = (int8_t)(phase2 - 128);
-        c2 = (int8_t)((((int16_t)phase2 * (int8_t)osc[2].vol) << 1) >> 8);
-        mix = c2;
 
-        osc[0].phase = (uint16_t)(osc[0].phase + osc[0].freq);
-        c0 = (int8_t)osc[0].vol;
-        if(osc[0].phase >= 0xC000) c0 = (int8_t)(-c0);
-        mix += c0;
+// Set on the ATM thread with every command queued and every sound effect request, so either
+// wakes it at once instead of at its next poll.
+enum : uint32_t {
+    ATM_THREAD_FLAG_WAKE = 1 << 0,
+};
 
-        osc[1].phase = (uint16_t)(osc[1].phase + osc[1].freq);
-        c1 = (int8_t)osc[1].vol;
-        if(osc[1].phase & 0x8000) c1 = (int8_t)(-c1);
-        mix += c1;
+// ATMsynth::playSfx() and stopSfx() requests, the latest per channel, taken by the ATM thread
+// ahead of the command queue: an effect never waits behind queued commands. song NULL stops.
+typedef struct {
+    const uint8_t* song;
+    uint8_t priority;
+} AtmSfxRequest;
+static AtmSfxRequest atm_sfx_requests[4];
+static uint8_t atm_sfx_pending = 0;
+
+// Paged song (ATMsynth::playPaged()): the page cache, the file it is filled from and the reader
+// thread that fills it. Set up and torn down by the ATM thread, which also runs the ticks that
+// read through the cache, looking ahead on a scratch copy of the engine.
+static AtmPager* atm_pager = NULL;
+static AtmEngine* atm_pager_scratch = NULL;
+static File* atm_pager_file = NULL;
+static FuriThread* atm_pager_thread = NULL;
+
+// Ticks the ATM thread looks ahead for pages to request; at the default tempo about 300 ms.
+static constexpr uint32_t ATM_PAGER_LOOKAHEAD_TICKS = 8;
+
+enum : uint32_t {
+    ATM_PAGER_FLAG_WAKE = 1 << 0,
+    ATM_PAGER_FLAG_QUIT = 1 << 1,
+};
 
-        uint16_t freq = osc[3].freq;
-        freq <<= 1;
-        if(freq & 0x8000) freq ^= 1;
-        if(freq & 0x4000) freq ^= 1;
-        osc[3].freq = freq;
+// Recording (ATMsynth::startRecording()): the DMA interrupt tees every block it plays into
+// atm_capture, and a low-priority thread writes them to atm_capture_file. The interrupt sees the
+// capture from the moment atm_capture is set until it is cleared, and one that runs always runs
+// to the end before the thread that cleared it goes on.
+static AtmCapture* atm_capture = NULL;
+static File* atm_capture_file = NULL;
+static FuriThread* atm_capture_thread = NULL;
 
-        c3 = (int8_t)osc[3].vol;
-        if(freq & 0x8000) c3 = (int8_t)(-c3);
-        mix += c3;
-    }
+// How often the writer looks for full runs; a run is about 33 ms of output.
+static constexpr uint32_t ATM_CAPTURE_POLL_MS = 20;
 
-    const uint8_t l0 = vol_meter_step(&channel_meters[0], abs_i8_to_u8(c0));
-    const uint8_t l1 = vol_meter_step(&channel_meters[1], abs_i8_to_u8(c1));
-    const uint8_t l2 = vol_meter_step(&channel_meters[2], abs_i8_to_u8(c2));
-    const uint8_t l3 = vol_meter_step(&channel_meters[3], abs_i8_to_u8(c3));
-    const uint32_t packed =
-        (uint32_t)l0 | ((uint32_t)l1 << 8) | ((uint32_t)l2 << 16) | ((uint32_t)l3 << 24);
-    __atomic_store_n(&channel_levels_packed, packed, __ATOMIC_RELAXED);
+enum : uint32_t {
+    ATM_CAPTURE_FLAG_QUIT = 1 << 0,
+};
+static void dma_isr(void* ctx);
+static void atm_render_ahead_fill();
 
-    const uint16_t gain_q8 = __atomic_load_n(&atm_master_gain_q8, __ATOMIC_RELAXED);
+static uint8_t atm_audio_enabled = 1;
 
-    // Uniform-tone mode needs extra headroom: four similar waveforms fold into each other harder.
-    int32_t centered =
-        ((int32_t)mix * (int32_t)gain_q8) >>
-        (uniform ? 10 : 9);
-    if(centered > 127) centered = 127;
-    if(centered < -127) centered = -127;
+// Visualizer tap: only fed while the scope page is on screen.
+static AtmScopeTap atm_scope;
+static uint8_t atm_scope_enabled = 0;
 
-    int16_t outv = (int16_t)(128 + centered);
-    if(outv < 0) outv = 0;
-    if(outv > 255) outv = 255;
+static inline void atm_scope_feed(const uint8_t* block, size_t count) {
+    AtmScopeFrame* f = atm_scope_write(&atm_scope, block, count);
+    if(!f) return;
 
-    atm_tick_acc++;
-    if(atm_tick_acc >= atm_tick_div) {
-        atm_tick_acc = 0;
-        __atomic_fetch_add(&atm_tick_pending, 1, __ATOMIC_RELAXED);
+    const AtmEngine* e = &atm_engine;
+    for(uint8_t i = 0; i < 4; i++) {
+        // A sound effect shows over the song, whether or not it has an oscillator of its own.
+        const uint8_t o = atm_sfx_osc(i);
+        if(e->sfx[i].active && e->osc[o].vol) {
+            f->notes[i] = e->sfx[i].ch.note;
+        } else {
+            f->notes[i] = e->osc[i].vol && (o != i || !e->sfx[i].active) ? e->channel_state[i].note : 0;
+        }
     }
-
-    return (uint8_t)outv;
+    atm_scope_publish(&atm_scope);
 }
 
 static inline void atm_fill_half(size_t half_index) {
     uint32_t* dst = dma_buf + (half_index * ATM_DMA_SAMPLES_PER_HALF);
     const uint8_t en = __atomic_load_n(&atm_audio_enabled, __ATOMIC_RELAXED);
+    uint8_t block[ATM_LOGICAL_SAMPLES_PER_HALF];
+
+    if(!en || atm_paused) {
+        memset(block, 128, sizeof(block));
+    } else {
+        if(!__atomic_load_n(&atm_render_ahead, __ATOMIC_RELAXED)) {
+            atm_engine_render(&atm_engine, block, ATM_LOGICAL_SAMPLES_PER_HALF);
+            __atomic_fetch_add(
+                &atm_rendered_samples, ATM_LOGICAL_SAMPLES_PER_HALF, __ATOMIC_RELAXED);
+        } else if(
+            !atm_block_ring_count(&atm_ring) &&
+            __atomic_load_n(&atm_engine.song_ended, __ATOMIC_RELAXED)) {
+            // Played out, not an underrun; the thread halts at its next look.
+            memset(block, 128, sizeof(block));
+        } else if(const AtmBlock* ready = atm_block_ring_front(&atm_ring)) {
+            memcpy(block, *ready, sizeof(block));
+            atm_block_ring_pop(&atm_ring);
+        } else {
+            // The thread fell behind: a gap now, the music carries on where it was.
+            memset(block, 128, sizeof(block));
+        }
+        if(__atomic_load_n(&atm_scope_enabled, __ATOMIC_RELAXED)) {
+            atm_scope_feed(block, ATM_LOGICAL_SAMPLES_PER_HALF);
+        }
+    }
+
+    AtmCapture* capture = __atomic_load_n(&atm_capture, __ATOMIC_ACQUIRE);
+    if(capture) atm_capture_feed(capture, block);
+
     for(size_t i = 0; i < ATM_LOGICAL_SAMPLES_PER_HALF; i++) {
-        uint8_t s = (!en || atm_paused) ? 128 : atm_render_logical_sample_u8();
-        uint32_t duty = (uint32_t)s;
+        uint32_t duty = (uint32_t)block[i];
         if(duty > ATM_PWM_ARR) duty = ATM_PWM_ARR;
         dst[i * 2 + 0] = duty;
         dst[i * 2 + 1] = duty;
@@ -224,9 +195,11 @@ static void tim16_dma_start() {
     for(size_t i = 0; i < ATM_DMA_TOTAL; i++)
         dma_buf[i] = 128;
 
-    atm_tick_acc = 0;
-    __atomic_store_n(&atm_tick_pending, 0, __ATOMIC_RELAXED);
+    atm_engine.tick_acc = 0;
+    __atomic_store_n(&atm_engine.tick_pending, 0, __ATOMIC_RELAXED);
 
+    // With render-ahead the first blocks come out of the ring like all the others.
+    if(atm_render_ahead) atm_render_ahead_fill();
     atm_fill_half(0);
     atm_fill_half(1);
 
@@ -303,321 +276,272 @@ static void dma_isr(void* /*ctx*/) {
 }
 
 void ATM_playroutine(void) {
-    ch_t* ch;
+    atm_engine_playroutine(&atm_engine);
+}
 
-    for(uint8_t n = 0; n < 4; n++) {
-        ch = &channel_state[n];
+static void atm_snapshot_save(AtmSnapshot* s) {
+    const AtmEngine* e = &atm_engine;
+    s->pos = e->song_pos;
+    memcpy(s->ch, e->channel_state, sizeof(s->ch));
+    memcpy(s->stack, e->call_stack, sizeof(s->stack));
+    for(uint8_t i = 0; i < 4; i++) {
+        s->osc_freq[i] = e->osc[i].freq;
+        s->osc_vol[i] = e->osc[i].vol;
+    }
+    s->tick_rate = e->tickRate;
+    s->active_mute = e->ChannelActiveMute;
+}
 
-        if(ch->reConfig) {
-            if(ch->reCount >= (ch->reConfig & 0x03)) {
-                osc[n].freq = noteTable[ch->reConfig >> 2];
-                ch->reCount = 0;
-            } else {
-                ch->reCount++;
-            }
-        }
+static void atm_snapshot_restore(const AtmSnapshot* s) {
+    AtmEngine* e = &atm_engine;
+    e->song_pos = s->pos;
+    memcpy(e->channel_state, s->ch, sizeof(s->ch));
+    memcpy(e->call_stack, s->stack, sizeof(s->stack));
+    for(uint8_t i = 0; i < 4; i++) {
+        e->osc[i].freq = s->osc_freq[i];
+        e->osc[i].vol = s->osc_vol[i];
+    }
+    atm_engine_sync_osc(e);
+    atm_engine_set_tick_rate(e, s->tick_rate);
 
-        if(ch->glisConfig) {
-            if(ch->glisCount >= (uint8_t)(ch->glisConfig & 0x7F)) {
-                if(ch->glisConfig & 0x80)
-                    ch->note -= 1;
-                else
-                    ch->note += 1;
+    // Active bits come from the song, mute bits stay as the user set them.
+    e->ChannelActiveMute = (uint8_t)((s->active_mute & 0xF0) | (e->ChannelActiveMute & 0x0F));
+}
 
-                if(ch->note < 1)
-                    ch->note = 1;
-                else if(ch->note > 63)
-                    ch->note = 63;
+static void atm_snapshot_reset() {
+    atm_snapshot_count = 0;
+    atm_snapshot_interval = ATM_SEEK_SNAPSHOT_INTERVAL;
+}
 
-                ch->freq = noteTable[ch->note];
-                ch->glisCount = 0;
-            } else {
-                ch->glisCount++;
-            }
-        }
+static void atm_snapshot_record_if_due() {
+    const uint32_t pos = atm_engine.song_pos;
+    if(atm_snapshot_count &&
+       pos < atm_snapshots[atm_snapshot_count - 1].pos + atm_snapshot_interval)
+        return;
+
+    if(atm_snapshot_count == ATM_SEEK_SNAPSHOT_MAX) {
+        // Table is full: keep every other snapshot and space the next ones twice as far apart.
+        for(uint8_t i = 0; i < ATM_SEEK_SNAPSHOT_MAX / 2; i++)
+            atm_snapshots[i] = atm_snapshots[i * 2];
+        atm_snapshot_count = ATM_SEEK_SNAPSHOT_MAX / 2;
+        atm_snapshot_interval *= 2;
+        if(pos < atm_snapshots[atm_snapshot_count - 1].pos + atm_snapshot_interval) return;
+    }
 
-        if(ch->volFreSlide) {
-            if(!ch->volFreCount) {
-                int16_t vf = ((ch->volFreConfig & 0x40) ? (int16_t)ch->freq : (int16_t)ch->vol);
-                vf += ch->volFreSlide;
-
-                if(!(ch->volFreConfig & 0x80)) {
-                    if(vf < 0)
-                        vf = 0;
-                    else if(ch->volFreConfig & 0x40) {
-                        if(vf > 9397) vf = 9397;
-                    } else {
-                        if(vf > 63) vf = 63;
-                    }
-                }
+    atm_snapshot_save(&atm_snapshots[atm_snapshot_count++]);
+}
 
-                if(ch->volFreConfig & 0x40)
-                    ch->freq = (uint16_t)vf;
-                else
-                    ch->vol = (uint8_t)vf;
-            }
+static inline void atm_tick() {
+    atm_engine_tick(&atm_engine);
+    atm_snapshot_record_if_due();
+}
 
-            if(ch->volFreCount++ >= (ch->volFreConfig & 0x3F)) ch->volFreCount = 0;
+static void atm_seek_to(uint32_t target) {
+    AtmEngine* e = &atm_engine;
+    const AtmSnapshot* best = NULL;
+    for(uint8_t i = 0; i < atm_snapshot_count; i++) {
+        if(atm_snapshots[i].pos > target) break;
+        best = &atm_snapshots[i];
+    }
+    if(best && (target < e->song_pos || best->pos > e->song_pos)) {
+        atm_snapshot_restore(best);
+        e->song_ended = false;
+    } else if(!best && target < e->song_pos && atm_song) {
+        // A reload can drop the early snapshots: start over instead.
+        const uint8_t mutes = e->ChannelActiveMute & 0x0F;
+        atm_engine_load(e, atm_song);
+        e->ChannelActiveMute |= mutes;
+    }
+
+    // Tick-only fast-forward: nothing is synthesized until the target is reached, and the notes
+    // skipped over are not reported.
+    const bool events = e->events_enabled;
+    e->events_enabled = false;
+    while(e->song_pos < target && !e->song_ended) {
+        atm_tick();
+    }
+    e->events_enabled = events;
+    atm_event_ring_reset(&e->events);
+
+    for(uint8_t i = 0; i < 4; i++) {
+        e->osc[i].phase = 0;
+    }
+    if(!e->osc[3].freq) {
+        e->osc[3].freq = 0x0001;
+        atm_engine_sync_osc(e);
+    }
+}
+
+// Moves playback to song, a recompile of the playing one (see ATMsynth::reload()).
+static void atm_reload(const uint8_t* song, const uint32_t relaid[8]) {
+    AtmEngine* e = &atm_engine;
+
+    // Snapshots are translated against the layout still in the engine, so they go first. Those
+    // inside a restructured track are dropped.
+    uint8_t kept = 0;
+    for(uint8_t i = 0; i < atm_snapshot_count; i++) {
+        if(atm_engine_rebase_channels(
+               e, song, relaid, atm_snapshots[i].ch, atm_snapshots[i].stack)) {
+            atm_snapshots[kept++] = atm_snapshots[i];
         }
+    }
+    atm_snapshot_count = kept;
+
+    atm_song = song;
+    // Events queued from the old version may name notes it no longer has.
+    atm_event_ring_reset(&e->events);
+    if(atm_engine_rebase(e, song, relaid)) return;
+
+    // A channel is inside a restructured track: play the new version from the start up to where
+    // the old one was.
+    const uint32_t pos = e->song_pos;
+    const uint8_t mutes = e->ChannelActiveMute & 0x0F;
+    atm_engine_load(e, song);
+    e->ChannelActiveMute |= mutes;
+    atm_snapshot_reset();
+    atm_snapshot_record_if_due();
+    atm_seek_to(pos);
+    __atomic_store_n(&e->tick_pending, 0, __ATOMIC_RELAXED);
+}
 
-        if(ch->arpNotes && ch->note) {
-            if((ch->arpCount & 0x1F) < (ch->arpTiming & 0x1F)) {
-                ch->arpCount++;
-            } else {
-                if((ch->arpCount & 0xE0) == 0x00)
-                    ch->arpCount = 0x20;
-                else if(
-                    (ch->arpCount & 0xE0) == 0x20 && !(ch->arpTiming & 0x40) &&
-                    (ch->arpNotes != 0xFF))
-                    ch->arpCount = 0x40;
-                else
-                    ch->arpCount = 0x00;
-
-                uint8_t arpNote = ch->note;
-
-                if((ch->arpCount & 0xE0) != 0x00) {
-                    if(ch->arpNotes == 0xFF)
-                        arpNote = 0;
-                    else
-                        arpNote = (uint8_t)(arpNote + (ch->arpNotes >> 4));
-                }
-                if((ch->arpCount & 0xE0) == 0x40)
-                    arpNote = (uint8_t)(arpNote + (ch->arpNotes & 0x0F));
+static bool atm_pager_read(void* ctx, uint32_t offset, uint8_t* dst, size_t size) {
+    File* file = (File*)ctx;
+    return storage_file_seek(file, offset, true) && storage_file_read(file, dst, size) == size;
+}
 
-                int16_t idx = (int16_t)arpNote + (int16_t)ch->transConfig;
-                if(idx < 0) idx = 0;
-                if(idx > 63) idx = 63;
-                ch->freq = noteTable[idx];
-            }
+static int32_t atm_pager_thread_fn(void* /*ctx*/) {
+    while(true) {
+        const uint32_t flags = furi_thread_flags_wait(
+            ATM_PAGER_FLAG_WAKE | ATM_PAGER_FLAG_QUIT, FuriFlagWaitAny, FuriWaitForever);
+        if(flags & ATM_PAGER_FLAG_QUIT) break;
+        while(atm_pager_service(atm_pager, atm_pager_read, atm_pager_file)) {
         }
+    }
+    return 0;
+}
 
-        if(ch->treviDepth) {
-            int16_t vt = ((ch->treviConfig & 0x40) ? (int16_t)ch->freq : (int16_t)ch->vol);
-            vt = (ch->treviCount & 0x80) ? (vt + ch->treviDepth) : (vt - ch->treviDepth);
+static void atm_paged_close() {
+    if(atm_pager_thread) {
+        furi_thread_flags_set(furi_thread_get_id(atm_pager_thread), ATM_PAGER_FLAG_QUIT);
+        furi_thread_join(atm_pager_thread);
+        furi_thread_free(atm_pager_thread);
+        atm_pager_thread = NULL;
+    }
+    if(atm_pager_file) {
+        storage_file_close(atm_pager_file);
+        storage_file_free(atm_pager_file);
+        furi_record_close(RECORD_STORAGE);
+        atm_pager_file = NULL;
+    }
+    if(atm_pager) {
+        atm_pager_close(atm_pager);
+        free(atm_pager);
+        atm_pager = NULL;
+    }
+    if(atm_pager_scratch) {
+        free(atm_pager_scratch);
+        atm_pager_scratch = NULL;
+    }
+}
 
-            if(vt < 0)
-                vt = 0;
-            else if(ch->treviConfig & 0x40) {
-                if(vt > 9397) vt = 9397;
-            } else {
-                if(vt > 63) vt = 63;
-            }
+// Reads the header and track table of the paged image at path.
+static bool atm_paged_open(const char* path) {
+    atm_paged_close();
 
-            if(ch->treviConfig & 0x40)
-                ch->freq = (uint16_t)vt;
-            else
-                ch->vol = (uint8_t)vt;
+    Storage* storage = (Storage*)furi_record_open(RECORD_STORAGE);
+    atm_pager_file = storage_file_alloc(storage);
+    atm_pager = (AtmPager*)malloc(sizeof(AtmPager));
+    atm_pager_scratch = (AtmEngine*)malloc(sizeof(AtmEngine));
 
-            if((ch->treviCount & 0x1F) < (ch->treviConfig & 0x1F))
-                ch->treviCount++;
-            else
-                ch->treviCount = (ch->treviCount & 0x80) ? 0 : 0x80;
-        }
+    uint8_t header[ATM_PAGED_HEADER_SIZE];
+    uint8_t* head = NULL;
+    bool ok = false;
+    do {
+        if(!atm_pager || !atm_pager_scratch) break;
+        if(!storage_file_open(atm_pager_file, path, FSAM_READ, FSOM_OPEN_EXISTING)) break;
+        if(storage_file_read(atm_pager_file, header, sizeof(header)) != sizeof(header)) break;
+
+        const uint32_t size = atm_paged_data_offset(header[5]);
+        head = (uint8_t*)malloc(size);
+        if(!head) break;
+        memcpy(head, header, sizeof(header));
+        const size_t rest = size - sizeof(header);
+        if(storage_file_read(atm_pager_file, head + sizeof(header), rest) != rest) break;
+        ok = atm_pager_open(atm_pager, head, size);
+    } while(false);
+    if(head) free(head);
+
+    if(!ok) {
+        // Nothing of the pager to close: it either never opened or failed to.
+        if(atm_pager) free(atm_pager);
+        atm_pager = NULL;
+        atm_paged_close();
+        return false;
+    }
 
-        if(ch->delay) {
-            if(ch->delay != 0xFFFF) ch->delay--;
-        } else {
-            do {
-                uint8_t cmd = *ch->ptr++;
-
-                if(cmd < 64) {
-                    if((ch->note = cmd)) ch->note = (uint8_t)(ch->note + (int8_t)ch->transConfig);
-
-                    int16_t ni = (int16_t)ch->note;
-                    if(ni < 0) ni = 0;
-                    if(ni > 63) ni = 63;
-                    ch->freq = noteTable[ni];
-
-                    if(!ch->volFreConfig) ch->vol = ch->reCount;
-
-                    if(ch->arpTiming & 0x20) ch->arpCount = 0;
-                } else if(cmd < 160) {
-                    switch(cmd - 64) {
-                    case 0:
-                        ch->vol = *ch->ptr++;
-                        ch->reCount = ch->vol;
-                        break;
-
-                    case 1:
-                    case 4:
-                        ch->volFreSlide = (int8_t)(*ch->ptr++);
-                        ch->volFreConfig = ((cmd - 64) == 1) ? 0x00 : 0x40;
-                        break;
-
-                    case 2:
-                    case 5:
-                        ch->volFreSlide = (int8_t)(*ch->ptr++);
-                        ch->volFreConfig = *ch->ptr++;
-                        break;
-
-                    case 3:
-                    case 6:
-                        ch->volFreSlide = 0;
-                        break;
-
-                    case 7:
-                        ch->arpNotes = *ch->ptr++;
-                        ch->arpTiming = *ch->ptr++;
-                        break;
-
-                    case 8:
-                        ch->arpNotes = 0;
-                        break;
-
-                    case 9:
-                        ch->reConfig = *ch->ptr++;
-                        break;
-
-                    case 10:
-                        ch->reConfig = 0;
-                        break;
-
-                    case 11:
-                        ch->transConfig = (int8_t)(ch->transConfig + (int8_t)(*ch->ptr++));
-                        break;
-
-                    case 12:
-                        ch->transConfig = (int8_t)(*ch->ptr++);
-                        break;
-
-                    case 13:
-                        ch->transConfig = 0;
-                        break;
-
-                    case 14:
-                    case 16: {
-                        uint16_t depth_w = read_u16_le(&ch->ptr);
-                        uint16_t cfg_w = read_u16_le(&ch->ptr);
-                        ch->treviDepth = (uint8_t)(depth_w & 0xFF);
-                        ch->treviConfig =
-                            (uint8_t)((cfg_w & 0xFF) + (((cmd - 64) == 14) ? 0x00 : 0x40));
-                        break;
-                    }
-
-                    case 15:
-                    case 17:
-                        ch->treviDepth = 0;
-                        break;
-
-                    case 18:
-                        ch->glisConfig = (int8_t)(*ch->ptr++);
-                        break;
-
-                    case 19:
-                        ch->glisConfig = 0;
-                        break;
-
-                    case 20:
-                        ch->arpNotes = 0xFF;
-                        ch->arpTiming = *ch->ptr++;
-                        break;
-
-                    case 21:
-                        ch->arpNotes = 0;
-                        break;
-
-                    case 92:
-                        tickRate = (uint8_t)(tickRate + *ch->ptr++);
-                        if(tickRate < 1) tickRate = 1;
-                        atm_tick_div = tick_div_from_rate(tickRate);
-                        break;
-
-                    case 93:
-                        tickRate = *ch->ptr++;
-                        if(tickRate < 1) tickRate = 1;
-                        atm_tick_div = tick_div_from_rate(tickRate);
-                        break;
-
-                    case 94:
-                        for(uint8_t i = 0; i < 4; i++)
-                            channel_state[i].repeatPoint = *ch->ptr++;
-                        break;
-
-                    case 95:
-                        ChannelActiveMute = (uint8_t)(ChannelActiveMute ^ (1 << (n + 4)));
-                        ch->vol = 0;
-                        ch->delay = 0xFFFF;
-                        break;
-
-                    default:
-                        break;
-                    }
-                } else if(cmd < 224) {
-                    ch->delay = (uint16_t)(cmd - 159);
-                } else if(cmd == 224) {
-                    ch->delay = (uint16_t)(read_vle(&ch->ptr) + 65);
-                } else if(cmd == 252 || cmd == 253) {
-                    uint8_t new_counter = (cmd == 252) ? 0 : *ch->ptr++;
-                    uint8_t new_track = *ch->ptr++;
-
-                    if(new_track != ch->track) {
-                        ch->stackCounter[ch->stackIndex] = ch->counter;
-                        ch->stackTrack[ch->stackIndex] = ch->track;
-                        ch->stackPointer[ch->stackIndex] = (uint16_t)(ch->ptr - trackBase);
-                        ch->stackIndex++;
-                        ch->track = new_track;
-                    }
-                    ch->counter = new_counter;
-                    ch->ptr = getTrackPointer(ch->track);
-                } else if(cmd == 254) {
-                    if(ch->counter > 0 || ch->stackIndex == 0) {
-                        if(ch->counter) ch->counter--;
-                        ch->ptr = getTrackPointer(ch->track);
-                    } else {
-                        if(ch->stackIndex == 0) {
-                            ch->delay = 0xFFFF;
-                        } else {
-                            ch->stackIndex--;
-                            ch->ptr = ch->stackPointer[ch->stackIndex] + trackBase;
-                            ch->counter = ch->stackCounter[ch->stackIndex];
-                            ch->track = ch->stackTrack[ch->stackIndex];
-                        }
-                    }
-                } else if(cmd == 255) {
-                    ch->ptr += read_vle(&ch->ptr);
-                } else {
-                }
-            } while(ch->delay == 0);
+    return true;
+}
 
-            if(ch->delay != 0xFFFF) ch->delay--;
+// Loads the pages the first tick of the paged song in the engine reads, right here, so that it
+// does not start late; then hands the pager to a reader thread.
+static void atm_paged_start() {
+    for(uint8_t i = 0; i < 16 && !atm_engine_tick_ready(&atm_engine, atm_pager_scratch); i++) {
+        while(atm_pager_service(atm_pager, atm_pager_read, atm_pager_file)) {
         }
+    }
 
-        if(!(ChannelActiveMute & (1 << n))) {
-            const uint8_t uniform = __atomic_load_n(&atm_uniform_tone_mode, __ATOMIC_RELAXED);
-            if(n == 3 && !uniform) {
-                osc[n].vol = (uint8_t)(ch->vol >> 1);
-            } else {
-                osc[n].freq = ch->freq;
-                osc[n].vol = uniform ? (uint8_t)((ch->vol * 3) >> 2) : ch->vol;
-            }
-        }
+    atm_pager_thread = furi_thread_alloc();
+    furi_thread_set_name(atm_pager_thread, "ATMpager");
+    furi_thread_set_stack_size(atm_pager_thread, 1024);
+    furi_thread_set_priority(atm_pager_thread, FuriThreadPriorityLow);
+    furi_thread_set_callback(atm_pager_thread, atm_pager_thread_fn);
+    furi_thread_start(atm_pager_thread);
+}
 
-        if(!(ChannelActiveMute & 0xF0)) {
-            uint8_t repeatSong = 0;
-            for(uint8_t j = 0; j < 4; j++)
-                repeatSong = (uint8_t)(repeatSong + channel_state[j].repeatPoint);
+// After a tick of a paged song: asks for the pages the next ticks will read and wakes the reader
+// if any are missing.
+static void atm_paged_prefetch() {
+    atm_engine_prefetch(&atm_engine, atm_pager_scratch, ATM_PAGER_LOOKAHEAD_TICKS);
+    if(atm_pager_pending(atm_pager)) {
+        furi_thread_flags_set(furi_thread_get_id(atm_pager_thread), ATM_PAGER_FLAG_WAKE);
+    }
+}
 
-            if(repeatSong) {
-                for(uint8_t k = 0; k < 4; k++) {
-                    channel_state[k].ptr = getTrackPointer(channel_state[k].repeatPoint);
-                    channel_state[k].delay = 0;
-                }
-                ChannelActiveMute = 0b11110000;
-            } else {
-                ATMsynth::stop();
-            }
+static bool atm_capture_write(void* ctx, uint32_t offset, const uint8_t* src, size_t size) {
+    File* file = (File*)ctx;
+    if(storage_file_tell(file) != offset && !storage_file_seek(file, offset, true)) return false;
+    return storage_file_write(file, src, size) == size;
+}
+
+static int32_t atm_capture_thread_fn(void* ctx) {
+    AtmCapture* c = (AtmCapture*)ctx;
+    while(true) {
+        const uint32_t flags =
+            furi_thread_flags_wait(ATM_CAPTURE_FLAG_QUIT, FuriFlagWaitAny, ATM_CAPTURE_POLL_MS);
+        if(!(flags & FuriFlagError) && (flags & ATM_CAPTURE_FLAG_QUIT)) break;
+        while(atm_capture_service(c, atm_capture_write, atm_capture_file, false)) {
         }
     }
+    atm_capture_finish(c, atm_capture_write, atm_capture_file);
+    return 0;
 }
 
 enum AtmCmdType : uint8_t {
     AtmCmdPlay,
+    AtmCmdPlayPaged,
     AtmCmdStop,
     AtmCmdTogglePause,
     AtmCmdMute,
     AtmCmdUnmute,
     AtmCmdSetVolume,
     AtmCmdSetUniformToneMode,
+    AtmCmdSeek,
+    AtmCmdSetTempo,
+    AtmCmdSetPitch,
+    AtmCmdSetFastForward,
+    AtmCmdSetRenderAhead,
+    AtmCmdSetEvents,
+    AtmCmdReload,
     AtmCmdQuit,
 };
 
@@ -626,7 +550,16 @@ struct AtmCmd {
     union {
         struct {
             const uint8_t* song;
+            uint16_t gain_q8;
         } play;
+        struct {
+            // malloc'ed by the caller, freed by the ATM thread.
+            char* path;
+        } paged;
+        struct {
+            const uint8_t* song;
+            uint32_t relaid[8];
+        } reload;
         struct {
             uint8_t ch;
         } ch;
@@ -636,55 +569,184 @@ struct AtmCmd {
         struct {
             uint8_t en;
         } mode;
+        struct {
+            float scale;
+        } tempo;
+        struct {
+            int8_t semitones;
+        } pitch;
+        struct {
+            uint8_t factor;
+        } ff;
+        struct {
+            uint8_t blocks;
+        } ahead;
+        struct {
+            int32_t ms;
+            uint8_t relative;
+        } seek;
+        struct {
+            const uint8_t* song;
+            uint8_t ch;
+            uint8_t priority;
+        } sfx;
     } u;
 };
 
 static inline void push_cmd(const AtmCmd& c) {
     if(!atm_cmd_q) ATMsynth::systemInit();
     furi_message_queue_put(atm_cmd_q, &c, FuriWaitForever);
+    furi_thread_flags_set(furi_thread_get_id(atm_thread), ATM_THREAD_FLAG_WAKE);
+}
+
+// A request of a lower priority than the one still pending for the channel is dropped, as the
+// engine would drop the effect.
+static void push_sfx(uint8_t ch, const uint8_t* song, uint8_t priority) {
+    if(!atm_cmd_q) ATMsynth::systemInit();
+    const uint8_t bit = (uint8_t)(1 << ch);
+    FURI_CRITICAL_ENTER();
+    AtmSfxRequest* r = &atm_sfx_requests[ch];
+    if(!(atm_sfx_pending & bit) || !r->song || !song || priority >= r->priority) {
+        r->song = song;
+        r->priority = priority;
+        atm_sfx_pending |= bit;
+    }
+    FURI_CRITICAL_EXIT();
+    furi_thread_flags_set(furi_thread_get_id(atm_thread), ATM_THREAD_FLAG_WAKE);
+}
+
+static bool atm_speaker_owned = false;
+
+static void atm_release_speaker() {
+    if(atm_speaker_owned) {
+        tim16_dma_stop();
+        furi_hal_speaker_release();
+        atm_speaker_owned = false;
+    }
+}
+
+static bool atm_acquire_speaker() {
+    if(!atm_speaker_owned) {
+        if(!furi_hal_speaker_acquire(200)) return false;
+        atm_speaker_owned = true;
+        tim16_dma_start();
+    }
+    return true;
+}
+
+// Stops the song and the effects and gives the speaker back.
+static void atm_halt() {
+    AtmEngine* e = &atm_engine;
+    atm_running = false;
+    atm_paused = false;
+
+    atm_release_speaker();
+    atm_paged_close();
+    atm_block_ring_clear(&atm_ring);
+
+    memset(e->channel_state, 0, sizeof(e->channel_state));
+    memset(e->sfx, 0, sizeof(e->sfx));
+    // Every voice goes quiet, the effect oscillators of the extended build too: with their slots
+    // cleared nothing else would ever silence them.
+    for(uint8_t n = 0; n < ATM_VOICES; n++) e->osc[n].vol = 0;
+    atm_engine_reset_meters(e);
+    e->ChannelActiveMute = 0b11110000;
+}
+
+static void atm_apply_gain() {
+    uint32_t q8 = ((uint32_t)atm_user_gain_q8 * atm_song_gain_q8 + 128) >> 8;
+    if(q8 > UINT16_MAX) q8 = UINT16_MAX;
+    __atomic_store_n(&atm_engine.master_gain_q8, (uint16_t)q8, __ATOMIC_RELAXED);
+}
+
+static void atm_apply_tempo() {
+    atm_engine_set_tempo_q8(&atm_engine, (uint16_t)(atm_user_tempo_q8 * atm_fast_forward));
+}
+
+// Runs the song ticks that are due and whose pages are cached, then the sound effect ticks due.
+static void atm_run_due_ticks() {
+    AtmEngine* e = &atm_engine;
+    while(atm_running && !e->song_ended && __atomic_load_n(&e->tick_pending, __ATOMIC_RELAXED)) {
+        // A paged tick whose pages are still being read stays pending: it runs late rather than
+        // wait for storage.
+        if(!atm_engine_tick_ready(e, atm_pager_scratch)) {
+            furi_thread_flags_set(furi_thread_get_id(atm_pager_thread), ATM_PAGER_FLAG_WAKE);
+            break;
+        }
+        __atomic_fetch_sub(&e->tick_pending, 1, __ATOMIC_RELAXED);
+        atm_tick();
+        if(atm_pager && !e->song_ended) atm_paged_prefetch();
+    }
+
+    const uint32_t now = __atomic_load_n(&atm_rendered_samples, __ATOMIC_RELAXED);
+    for(uint8_t n = 0; n < 4; n++) {
+        while(e->sfx[n].active && (int32_t)(now - e->sfx[n].next_tick) >= 0) {
+            atm_engine_sfx_tick(e, n);
+        }
+    }
+}
+
+// Render-ahead: renders blocks until the ring is full, each followed by the ticks it made due,
+// just as the interrupt and the thread take turns otherwise.
+static void atm_render_ahead_fill() {
+    AtmBlock* back;
+    while(!atm_engine.song_ended && (back = atm_block_ring_back(&atm_ring)) != NULL) {
+        atm_engine_render(&atm_engine, *back, ATM_BLOCK_SAMPLES);
+        atm_block_ring_push(&atm_ring);
+        __atomic_fetch_add(&atm_rendered_samples, ATM_BLOCK_SAMPLES, __ATOMIC_RELAXED);
+        atm_run_due_ticks();
+    }
+}
+
+// Starts or stops the sound effects requested since the last look. The first tick of an effect
+// runs right here, so it is heard from the next block rendered.
+static void atm_take_sfx_requests() {
+    AtmEngine* e = &atm_engine;
+    AtmSfxRequest requests[4];
+    FURI_CRITICAL_ENTER();
+    const uint8_t pending = atm_sfx_pending;
+    memcpy(requests, atm_sfx_requests, sizeof(requests));
+    atm_sfx_pending = 0;
+    FURI_CRITICAL_EXIT();
+
+    for(uint8_t n = 0; n < 4; n++) {
+        if(!(pending & (1 << n))) continue;
+        if(!requests[n].song) {
+            if(e->sfx[n].active) atm_engine_sfx_release(e, n);
+            continue;
+        }
+        const uint8_t en = __atomic_load_n(&atm_audio_enabled, __ATOMIC_RELAXED);
+        if(en && !atm_acquire_speaker()) continue;
+        atm_engine_sfx_start(
+            e,
+            requests[n].song,
+            n,
+            requests[n].priority,
+            __atomic_load_n(&atm_rendered_samples, __ATOMIC_RELAXED));
+    }
 }
 
 static int32_t atm_thread_fn(void* /*ctx*/) {
+    AtmEngine* e = &atm_engine;
     AtmCmd cmd;
-    bool speaker_owned = false;
 
     while(true) {
-        if(furi_message_queue_get(atm_cmd_q, &cmd, 10) == FuriStatusOk) {
+        // Render-ahead has to top the ring up well within a block. A command or a sound effect
+        // cuts the wait short.
+        const uint32_t wait = __atomic_load_n(&atm_render_ahead, __ATOMIC_RELAXED) ? 1 : 10;
+        if(!furi_message_queue_get_count(atm_cmd_q) &&
+           !__atomic_load_n(&atm_sfx_pending, __ATOMIC_RELAXED)) {
+            furi_thread_flags_wait(ATM_THREAD_FLAG_WAKE, FuriFlagWaitAny, wait);
+        }
+        atm_take_sfx_requests();
+        if(furi_message_queue_get(atm_cmd_q, &cmd, 0) == FuriStatusOk) {
             if(cmd.type == AtmCmdStop) {
-                atm_running = false;
-                atm_paused = false;
-
-                if(speaker_owned) {
-                    tim16_dma_stop();
-                    furi_hal_speaker_release();
-                    speaker_owned = false;
-                }
-
-                memset(channel_state, 0, sizeof(channel_state));
-                __atomic_store_n(&channel_levels_packed, 0, __ATOMIC_RELAXED);
-                for(uint8_t i = 0; i < 4; i++) {
-                    vol_meter_reset(&channel_meters[i]);
-                }
-                ChannelActiveMute = 0b11110000;
+                atm_halt();
                 continue;
             }
 
             if(cmd.type == AtmCmdQuit) {
-                atm_running = false;
-                atm_paused = false;
-
-                if(speaker_owned) {
-                    tim16_dma_stop();
-                    furi_hal_speaker_release();
-                    speaker_owned = false;
-                }
-
-                memset(channel_state, 0, sizeof(channel_state));
-                __atomic_store_n(&channel_levels_packed, 0, __ATOMIC_RELAXED);
-                for(uint8_t i = 0; i < 4; i++) {
-                    vol_meter_reset(&channel_meters[i]);
-                }
-                ChannelActiveMute = 0b11110000;
+                atm_halt();
                 break;
             }
 
@@ -694,12 +756,16 @@ static int32_t atm_thread_fn(void* /*ctx*/) {
             }
 
             if(cmd.type == AtmCmdMute) {
-                ChannelActiveMute = (uint8_t)(ChannelActiveMute | (1 << cmd.u.ch.ch));
+                e->ChannelActiveMute = (uint8_t)(e->ChannelActiveMute | (1 << cmd.u.ch.ch));
+                // Silence the voice rather than freeze its last note; a sound effect keeps it.
+                if(atm_sfx_osc(cmd.u.ch.ch) != cmd.u.ch.ch || !e->sfx[cmd.u.ch.ch].active)
+                    e->osc[cmd.u.ch.ch].vol = 0;
                 continue;
             }
 
             if(cmd.type == AtmCmdUnmute) {
-                ChannelActiveMute = (uint8_t)(ChannelActiveMute & (uint8_t)~(1 << cmd.u.ch.ch));
+                e->ChannelActiveMute =
+                    (uint8_t)(e->ChannelActiveMute & (uint8_t)~(1 << cmd.u.ch.ch));
                 continue;
             }
 
@@ -707,55 +773,131 @@ static int32_t atm_thread_fn(void* /*ctx*/) {
                 float v = cmd.u.vol.v;
                 if(v < 0) v = 0;
                 if(v > ATM_MASTER_GAIN_MAX) v = ATM_MASTER_GAIN_MAX;
-                uint16_t q8 = (uint16_t)(v * 256.0f + 0.5f);
-                __atomic_store_n(&atm_master_gain_q8, q8, __ATOMIC_RELAXED);
+                atm_user_gain_q8 = (uint16_t)(v * 256.0f + 0.5f);
+                atm_apply_gain();
                 continue;
             }
 
             if(cmd.type == AtmCmdSetUniformToneMode) {
-                __atomic_store_n(
-                    &atm_uniform_tone_mode, cmd.u.mode.en ? 1 : 0, __ATOMIC_RELAXED);
+                __atomic_store_n(&e->uniform_tone_mode, cmd.u.mode.en ? 1 : 0, __ATOMIC_RELAXED);
                 continue;
             }
 
-            if(cmd.type == AtmCmdPlay) {
-                const uint8_t* song = cmd.u.play.song;
+            if(cmd.type == AtmCmdSetTempo) {
+                float v = cmd.u.tempo.scale;
+                if(v < ATM_TEMPO_SCALE_MIN) v = ATM_TEMPO_SCALE_MIN;
+                if(v > ATM_TEMPO_SCALE_MAX) v = ATM_TEMPO_SCALE_MAX;
+                atm_user_tempo_q8 = (uint16_t)(v * 256.0f + 0.5f);
+                atm_apply_tempo();
+                continue;
+            }
+
+            if(cmd.type == AtmCmdSetPitch) {
+                e->pitch_shift = cmd.u.pitch.semitones;
+                continue;
+            }
+
+            if(cmd.type == AtmCmdSetFastForward) {
+                atm_fast_forward = cmd.u.ff.factor >= 4 ? 4 : cmd.u.ff.factor >= 2 ? 2 : 1;
+                atm_apply_tempo();
+                continue;
+            }
 
-                memset(channel_state, 0, sizeof(channel_state));
-                memset(osc, 0, sizeof(osc));
-                __atomic_store_n(&channel_levels_packed, 0, __ATOMIC_RELAXED);
-                for(uint8_t i = 0; i < 4; i++) {
-                    vol_meter_reset(&channel_meters[i]);
+            if(cmd.type == AtmCmdSetRenderAhead) {
+                const uint8_t blocks = cmd.u.ahead.blocks < ATM_RENDER_AHEAD_MAX ?
+                                           cmd.u.ahead.blocks :
+                                           ATM_RENDER_AHEAD_MAX;
+                // The interrupt only looks at the ring once atm_render_ahead says so.
+                if(!atm_render_ahead) {
+                    atm_block_ring_init(&atm_ring, atm_ring_blocks, ATM_RENDER_AHEAD_MAX, blocks);
+                } else {
+                    atm_block_ring_set_depth(&atm_ring, blocks);
                 }
-                ChannelActiveMute = 0b11110000;
+                __atomic_store_n(&atm_render_ahead, blocks, __ATOMIC_RELAXED);
+                continue;
+            }
+
+            if(cmd.type == AtmCmdSetEvents) {
+                // What is queued from before was not wanted.
+                if(cmd.u.mode.en && !e->events_enabled) atm_event_ring_reset(&e->events);
+                e->events_enabled = cmd.u.mode.en;
+                continue;
+            }
 
-                tickRate = 25;
-                atm_tick_div = tick_div_from_rate(tickRate);
+            if(cmd.type == AtmCmdSeek) {
+                // A paged song would have to read its way to the target.
+                if(!atm_running || atm_pager) continue;
+
+                int64_t target = (int64_t)cmd.u.seek.ms * ATM_LOGICAL_HZ / 1000;
+                if(cmd.u.seek.relative) target += e->song_pos;
+                if(target < 0) target = 0;
+                if(target > UINT32_MAX) target = UINT32_MAX;
+
+                const bool was_paused = atm_paused;
+                atm_paused = true;
+                atm_seek_to((uint32_t)target);
+                __atomic_store_n(&e->tick_pending, 0, __ATOMIC_RELAXED);
+                atm_block_ring_discard(&atm_ring);
+                atm_paused = was_paused;
+                if(e->song_ended) atm_halt();
+                continue;
+            }
 
-                osc[3].freq = 0x0001;
-                channel_state[3].freq = 0x0001;
+            if(cmd.type == AtmCmdReload) {
+                if(!atm_running || atm_pager) continue;
 
-                trackCount = *song++;
-                trackList = (const uint16_t*)song;
-                song += (trackCount << 1);
-                trackBase = song + 4;
+                const bool was_paused = atm_paused;
+                atm_paused = true;
+                atm_reload(cmd.u.reload.song, cmd.u.reload.relaid);
+                atm_paused = was_paused;
+                if(e->song_ended) atm_halt();
+                continue;
+            }
 
-                for(uint8_t n = 0; n < 4; n++) {
-                    channel_state[n].ptr = getTrackPointer(*song++);
+            if(cmd.type == AtmCmdPlayPaged) {
+                const bool opened = cmd.u.paged.path && atm_paged_open(cmd.u.paged.path);
+                free(cmd.u.paged.path);
+                if(!opened) {
+                    atm_halt();
+                    continue;
                 }
 
+                // The loudness scan would have to read the whole song: play at unity gain.
+                atm_song_gain_q8 = 256;
+                atm_apply_gain();
+
+                atm_engine_load_paged(e, atm_pager);
+                atm_block_ring_discard(&atm_ring);
+                atm_song = NULL;
+                atm_snapshot_reset();
+                atm_paged_start();
+                atm_paged_prefetch();
+
                 atm_running = true;
                 atm_paused = false;
 
                 const uint8_t en = __atomic_load_n(&atm_audio_enabled, __ATOMIC_RELAXED);
-                if(en && !speaker_owned) {
-                    if(furi_hal_speaker_acquire(200)) {
-                        speaker_owned = true;
-                        tim16_dma_start();
-                    } else {
-                        atm_running = false;
-                    }
-                }
+                if(en && !atm_acquire_speaker()) atm_running = false;
+                continue;
+            }
+
+            if(cmd.type == AtmCmdPlay) {
+                atm_paged_close();
+
+                atm_song_gain_q8 = cmd.u.play.gain_q8;
+                atm_apply_gain();
+
+                atm_engine_load(e, cmd.u.play.song);
+                atm_block_ring_discard(&atm_ring);
+                atm_song = cmd.u.play.song;
+                atm_snapshot_reset();
+                atm_snapshot_record_if_due();
+
+                atm_running = true;
+                atm_paused = false;
+
+                const uint8_t en = __atomic_load_n(&atm_audio_enabled, __ATOMIC_RELAXED);
+                if(en && !atm_acquire_speaker()) atm_running = false;
                 continue;
             }
         }
@@ -763,26 +905,26 @@ static int32_t atm_thread_fn(void* /*ctx*/) {
         const uint8_t en = __atomic_load_n(&atm_audio_enabled, __ATOMIC_RELAXED);
 
         if(!en) {
-            if(speaker_owned) {
-                tim16_dma_stop();
-                furi_hal_speaker_release();
-                speaker_owned = false;
-            }
-        } else {
-            if(atm_running && !speaker_owned) {
-                if(furi_hal_speaker_acquire(200)) {
-                    speaker_owned = true;
-                    tim16_dma_start();
-                }
-            }
+            atm_release_speaker();
+        } else if(atm_running) {
+            atm_acquire_speaker();
         }
 
-        if(atm_running && en && !atm_paused) {
-            uint32_t pending = __atomic_load_n(&atm_tick_pending, __ATOMIC_RELAXED);
-            if(pending) {
-                __atomic_fetch_sub(&atm_tick_pending, 1, __ATOMIC_RELAXED);
-                ATM_playroutine();
+        if(en && !atm_paused) {
+            if(__atomic_load_n(&atm_render_ahead, __ATOMIC_RELAXED) && atm_speaker_owned) {
+                atm_render_ahead_fill();
+            } else {
+                // Every tick due, not one per pass: above 100 ticks a second one per 10 ms poll
+                // would fall further and further behind.
+                atm_run_due_ticks();
             }
+
+            // The end of the song is still queued in render-ahead mode: it stops once the
+            // interrupt has played the last block.
+            const bool failed = atm_pager && __atomic_load_n(&atm_pager->error, __ATOMIC_RELAXED);
+            const bool drained = !__atomic_load_n(&atm_render_ahead, __ATOMIC_RELAXED) ||
+                                 !atm_speaker_owned || !atm_block_ring_count(&atm_ring);
+            if(atm_running && ((e->song_ended && drained) || failed)) atm_halt();
         }
     }
     return 0;
@@ -792,6 +934,8 @@ ATMsynth ATM;
 
 void ATMsynth::systemInit() {
     if(atm_cmd_q) return;
+    atm_engine_init(&atm_engine);
+    atm_scope_init(&atm_scope);
     atm_cmd_q = furi_message_queue_alloc(8, sizeof(AtmCmd));
 
     atm_thread = furi_thread_alloc();
@@ -803,16 +947,19 @@ void ATMsynth::systemInit() {
 }
 
 void ATMsynth::systemDeinit() {
+    stopRecording(NULL);
+
     AtmCmd c{};
     c.type = AtmCmdQuit;
     furi_message_queue_put(atm_cmd_q, &c, FuriWaitForever);
+    furi_thread_flags_set(furi_thread_get_id(atm_thread), ATM_THREAD_FLAG_WAKE);
     tim16_dma_stop();
 
     if(furi_hal_speaker_is_mine()) {
         furi_hal_speaker_release();
     }
 
-    __atomic_store_n(&atm_tick_pending, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&atm_engine.tick_pending, 0, __ATOMIC_RELAXED);
     furi_thread_join(atm_thread);
     furi_thread_free(atm_thread);
     furi_message_queue_free(atm_cmd_q);
@@ -820,10 +967,36 @@ void ATMsynth::systemDeinit() {
     atm_thread = NULL;
 }
 
-void ATMsynth::play(const uint8_t* song) {
+uint16_t atm_song_auto_gain_q8(const uint8_t* song) {
+    // The scan runs on an engine of its own, only as long as it takes.
+    AtmEngine* scratch = (AtmEngine*)malloc(sizeof(AtmEngine));
+    if(!scratch) return 256;
+    AtmLoudness loudness;
+    atm_engine_scan_loudness(scratch, song, ATM_AUTO_GAIN_SCAN_SAMPLES, &loudness);
+    free(scratch);
+    return atm_auto_gain_q8(&loudness);
+}
+
+void ATMsynth::play(const uint8_t* song, uint16_t gain_q8) {
     AtmCmd c{};
     c.type = AtmCmdPlay;
     c.u.play.song = song;
+    c.u.play.gain_q8 = gain_q8;
+    push_cmd(c);
+}
+
+void ATMsynth::playPaged(const char* path) {
+    AtmCmd c{};
+    c.type = AtmCmdPlayPaged;
+    c.u.paged.path = strdup(path);
+    push_cmd(c);
+}
+
+void ATMsynth::reload(const uint8_t* song, const uint32_t relaid[8]) {
+    AtmCmd c{};
+    c.type = AtmCmdReload;
+    c.u.reload.song = song;
+    memcpy(c.u.reload.relaid, relaid, sizeof(c.u.reload.relaid));
     push_cmd(c);
 }
 
@@ -833,6 +1006,30 @@ void ATMsynth::stop() {
     push_cmd(c);
 }
 
+void ATMsynth::seek(uint32_t ms) {
+    AtmCmd c{};
+    c.type = AtmCmdSeek;
+    c.u.seek.ms = (int32_t)(ms > INT32_MAX ? INT32_MAX : ms);
+    c.u.seek.relative = 0;
+    push_cmd(c);
+}
+
+void ATMsynth::seekRelative(int32_t delta_ms) {
+    AtmCmd c{};
+    c.type = AtmCmdSeek;
+    c.u.seek.ms = delta_ms;
+    c.u.seek.relative = 1;
+    push_cmd(c);
+}
+
+void ATMsynth::playSfx(const uint8_t* sfx, uint8_t ch, uint8_t priority) {
+    if(sfx) push_sfx(ch & 0x03, sfx, priority);
+}
+
+void ATMsynth::stopSfx(uint8_t ch) {
+    push_sfx(ch & 0x03, NULL, 0);
+}
+
 void ATMsynth::playPause() {
     AtmCmd c{};
     c.type = AtmCmdTogglePause;
@@ -864,6 +1061,95 @@ void ATMsynth::setMasterVolume(float v) {
     push_cmd(c);
 }
 
+void ATMsynth::setTempoScale(float scale) {
+    AtmCmd c{};
+    c.type = AtmCmdSetTempo;
+    c.u.tempo.scale = scale;
+    push_cmd(c);
+}
+
+void ATMsynth::setPitchShift(int8_t semitones) {
+    AtmCmd c{};
+    c.type = AtmCmdSetPitch;
+    c.u.pitch.semitones = semitones;
+    push_cmd(c);
+}
+
+void ATMsynth::setFastForward(uint8_t factor) {
+    AtmCmd c{};
+    c.type = AtmCmdSetFastForward;
+    c.u.ff.factor = factor;
+    push_cmd(c);
+}
+
+bool ATMsynth::startRecording(const char* path) {
+    if(atm_capture) return false;
+
+    AtmCapture* c = (AtmCapture*)malloc(sizeof(AtmCapture));
+    if(!c) return false;
+    if(!atm_capture_open(c, ATM_LOGICAL_HZ)) {
+        free(c);
+        return false;
+    }
+
+    Storage* storage = (Storage*)furi_record_open(RECORD_STORAGE);
+    atm_capture_file = storage_file_alloc(storage);
+    if(!storage_file_open(atm_capture_file, path, FSAM_WRITE, FSOM_CREATE_ALWAYS) ||
+       !atm_capture_begin(c, atm_capture_write, atm_capture_file)) {
+        storage_file_close(atm_capture_file);
+        storage_file_free(atm_capture_file);
+        furi_record_close(RECORD_STORAGE);
+        atm_capture_file = NULL;
+        atm_capture_close(c);
+        free(c);
+        return false;
+    }
+
+    atm_capture_thread = furi_thread_alloc();
+    furi_thread_set_name(atm_capture_thread, "ATMcapture");
+    furi_thread_set_stack_size(atm_capture_thread, 1024);
+    furi_thread_set_priority(atm_capture_thread, FuriThreadPriorityLow);
+    furi_thread_set_context(atm_capture_thread, c);
+    furi_thread_set_callback(atm_capture_thread, atm_capture_thread_fn);
+    furi_thread_start(atm_capture_thread);
+
+    __atomic_store_n(&atm_capture, c, __ATOMIC_RELEASE);
+    return true;
+}
+
+void ATMsynth::stopRecording(AtmCaptureReport* report) {
+    AtmCapture* c = atm_capture;
+    if(report) memset(report, 0, sizeof(*report));
+    if(!c) return;
+
+    // No interrupt touches the capture after this, so the writer has the last word.
+    __atomic_store_n(&atm_capture, (AtmCapture*)NULL, __ATOMIC_RELEASE);
+    furi_thread_flags_set(furi_thread_get_id(atm_capture_thread), ATM_CAPTURE_FLAG_QUIT);
+    furi_thread_join(atm_capture_thread);
+    furi_thread_free(atm_capture_thread);
+    atm_capture_thread = NULL;
+
+    storage_file_close(atm_capture_file);
+    storage_file_free(atm_capture_file);
+    furi_record_close(RECORD_STORAGE);
+    atm_capture_file = NULL;
+
+    if(report) {
+        report->samples = c->bytes;
+        report->dropped = c->dropped;
+        report->ok = !c->error;
+    }
+    atm_capture_close(c);
+    free(c);
+}
+
+void ATMsynth::setRenderAhead(uint8_t blocks) {
+    AtmCmd c{};
+    c.type = AtmCmdSetRenderAhead;
+    c.u.ahead.blocks = blocks;
+    push_cmd(c);
+}
+
 void ATMsynth::setUniformToneMode(bool en) {
     AtmCmd c{};
     c.type = AtmCmdSetUniformToneMode;
@@ -883,9 +1169,58 @@ void atm_set_enabled(uint8_t en) {
 
 void atm_get_channel_levels(uint8_t out_levels[4]) {
     if(!out_levels) return;
-    const uint32_t packed = __atomic_load_n(&channel_levels_packed, __ATOMIC_RELAXED);
-    out_levels[0] = (uint8_t)(packed & 0xFF);
-    out_levels[1] = (uint8_t)((packed >> 8) & 0xFF);
-    out_levels[2] = (uint8_t)((packed >> 16) & 0xFF);
-    out_levels[3] = (uint8_t)((packed >> 24) & 0xFF);
+    atm_engine_read_levels(&atm_engine, out_levels);
+}
+
+void atm_set_scope_enabled(uint8_t en) {
+    __atomic_store_n(&atm_scope_enabled, en ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+const AtmScopeFrame* atm_get_scope_frame(void) {
+    return atm_scope_read(&atm_scope);
+}
+
+void atm_set_events_enabled(uint8_t en) {
+    AtmCmd c{};
+    c.type = AtmCmdSetEvents;
+    c.u.mode.en = en ? 1 : 0;
+    push_cmd(c);
+}
+
+bool atm_poll_event(AtmMusicEvent* out) {
+    return atm_event_pop(&atm_engine.events, out);
+}
+
+uint32_t atm_get_events_dropped(void) {
+    return __atomic_load_n(&atm_engine.events.dropped, __ATOMIC_RELAXED);
+}
+
+uint32_t atm_get_position_ms(void) {
+    uint32_t pos = __atomic_load_n(&atm_engine.song_pos, __ATOMIC_RELAXED);
+    // With render-ahead the engine is ahead of the speaker by the queued blocks, in song time.
+    if(__atomic_load_n(&atm_render_ahead, __ATOMIC_RELAXED)) {
+        const uint32_t queued = atm_block_ring_count(&atm_ring) * ATM_BLOCK_SAMPLES;
+        const uint32_t lead = (uint32_t)(
+            ((uint64_t)queued * __atomic_load_n(&atm_engine.tempo_q8, __ATOMIC_RELAXED)) >> 8);
+        pos = pos > lead ? pos - lead : 0;
+    }
+    return (uint32_t)(((uint64_t)pos * 1000) / ATM_LOGICAL_HZ);
 }
+
+bool atm_get_recording(AtmCaptureReport* out) {
+    const AtmCapture* c = atm_capture;
+    if(!c) return false;
+    out->samples = __atomic_load_n(&c->bytes, __ATOMIC_RELAXED);
+    out->dropped = __atomic_load_n(&c->dropped, __ATOMIC_RELAXED);
+    out->ok = !__atomic_load_n(&c->error, __ATOMIC_RELAXED);
+    return true;
+}
+
+uint32_t atm_get_underruns(void) {
+    return __atomic_load_n(&atm_ring.underruns, __ATOMIC_RELAXED);
+}
+
+uint8_t atm_get_runaway_channels(void) {
+    return __atomic_load_n(&atm_engine.runaway, __ATOMIC_RELAXED);
+}
+
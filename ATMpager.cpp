@@ -0,0 +1,123 @@
+#include "lib/ATMpager.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static inline uint32_t atm_paged_read_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool atm_pager_open(AtmPager* p, const uint8_t* head, size_t size) {
+    memset(p, 0, sizeof(*p));
+    if(size < ATM_PAGED_HEADER_SIZE || memcmp(head, ATM_PAGED_MAGIC, 4) != 0) return false;
+    if(head[4] != ATM_PAGED_VERSION || head[5] == 0) return false;
+
+    const uint8_t count = head[5];
+    const uint32_t data_offset = atm_paged_data_offset(count);
+    if(size < data_offset) return false;
+
+    const uint32_t data_size = atm_paged_read_u32(head + 8);
+    uint32_t* tracks = (uint32_t*)malloc((size_t)count * sizeof(uint32_t));
+    if(!tracks) return false;
+    for(uint8_t i = 0; i < count; i++) {
+        tracks[i] = atm_paged_read_u32(head + ATM_PAGED_HEADER_SIZE + i * 4);
+        if(tracks[i] > data_size) {
+            free(tracks);
+            return false;
+        }
+    }
+
+    p->track_count = count;
+    p->tracks = tracks;
+    memcpy(p->entry, head + data_offset - 4, 4);
+    p->data_offset = data_offset;
+    p->data_size = data_size;
+    return true;
+}
+
+void atm_pager_close(AtmPager* p) {
+    if(p->tracks) free(p->tracks);
+    p->tracks = NULL;
+    p->track_count = 0;
+}
+
+static inline int atm_pager_find(const AtmPager* p, uint32_t page) {
+    if(p->slot_state[p->last] != AtmPageEmpty && p->slot_page[p->last] == page) return p->last;
+    for(uint8_t i = 0; i < ATM_PAGE_SLOTS; i++) {
+        if(p->slot_state[i] != AtmPageEmpty && p->slot_page[i] == page) return i;
+    }
+    return -1;
+}
+
+void atm_pager_request(AtmPager* p, uint32_t pos) {
+    if(pos >= p->data_size) return;
+    const uint32_t page = pos / ATM_PAGE_SIZE;
+    const int found = atm_pager_find(p, page);
+    if(found >= 0) {
+        p->slot_used[found] = ++p->clock;
+        return;
+    }
+
+    // An empty slot, else the least recently used cached one. Queued slots belong to the reader.
+    int victim = -1;
+    for(uint8_t i = 0; i < ATM_PAGE_SLOTS; i++) {
+        const uint8_t state = __atomic_load_n(&p->slot_state[i], __ATOMIC_ACQUIRE);
+        if(state == AtmPageEmpty) {
+            victim = i;
+            break;
+        }
+        if(state == AtmPageReady &&
+           (victim < 0 || (int32_t)(p->slot_used[i] - p->slot_used[victim]) < 0))
+            victim = i;
+    }
+    if(victim < 0) return;
+
+    p->slot_page[victim] = page;
+    p->slot_used[victim] = ++p->clock;
+    p->slot_state[victim] = AtmPageQueued;
+    p->queue[p->queue_head % ATM_PAGE_SLOTS] = (uint8_t)victim;
+    __atomic_store_n(&p->queue_head, p->queue_head + 1, __ATOMIC_RELEASE);
+}
+
+bool atm_pager_byte(AtmPager* p, uint32_t pos, uint8_t* out) {
+    if(pos >= p->data_size) {
+        // Only a corrupt image sends a channel here.
+        __atomic_store_n(&p->error, true, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    const uint32_t page = pos / ATM_PAGE_SIZE;
+    const int slot = atm_pager_find(p, page);
+    if(slot >= 0 && __atomic_load_n(&p->slot_state[slot], __ATOMIC_ACQUIRE) == AtmPageReady) {
+        p->last = (uint8_t)slot;
+        p->slot_used[slot] = ++p->clock;
+        *out = p->page[slot][pos % ATM_PAGE_SIZE];
+        return true;
+    }
+
+    atm_pager_request(p, pos);
+    return false;
+}
+
+bool atm_pager_pending(const AtmPager* p) {
+    return __atomic_load_n(&p->queue_head, __ATOMIC_ACQUIRE) != p->queue_tail;
+}
+
+bool atm_pager_service(AtmPager* p, AtmPageRead read, void* ctx) {
+    if(!atm_pager_pending(p)) return false;
+
+    const uint8_t slot = p->queue[p->queue_tail % ATM_PAGE_SLOTS];
+    const uint32_t start = p->slot_page[slot] * ATM_PAGE_SIZE;
+    uint32_t size = p->data_size - start;
+    if(size > ATM_PAGE_SIZE) size = ATM_PAGE_SIZE;
+
+    if(read(ctx, p->data_offset + start, p->page[slot], size)) {
+        p->loads++;
+        __atomic_store_n(&p->slot_state[slot], AtmPageReady, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&p->error, true, __ATOMIC_RELAXED);
+        __atomic_store_n(&p->slot_state[slot], AtmPageEmpty, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&p->queue_tail, p->queue_tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
@@ -0,0 +1,668 @@
+#include "lib/ATMparse.h"
+#include "lib/ATMpager.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ATM_TXT_MAGIC        "ATM1"
+#define ATM_TXT_CMD_NAME     "NAME"
+#define ATM_TXT_CMD_ENTRY    "ENTRY"
+#define ATM_TXT_CMD_TRACK    "TRACK"
+#define ATM_TXT_CMD_ENDTRACK "ENDTRACK"
+#define ATM_TXT_CMD_END      "END"
+#define ATM_TXT_COMMENT      '#'
+#define ATM_TXT_SEPARATOR    ','
+
+#define ATM_TXT_OP_DB                "DB"
+#define ATM_TXT_OP_NOTE              "NOTE"
+#define ATM_TXT_OP_DELAY             "DELAY"
+#define ATM_TXT_OP_STOP              "STOP"
+#define ATM_TXT_OP_RETURN            "RETURN"
+#define ATM_TXT_OP_GOTO              "GOTO"
+#define ATM_TXT_OP_REPEAT            "REPEAT"
+#define ATM_TXT_OP_SET_TEMPO         "SET_TEMPO"
+#define ATM_TXT_OP_ADD_TEMPO         "ADD_TEMPO"
+#define ATM_TXT_OP_SET_VOLUME        "SET_VOLUME"
+#define ATM_TXT_OP_VOLUME_SLIDE_ON   "VOLUME_SLIDE_ON"
+#define ATM_TXT_OP_VOLUME_SLIDE_OFF  "VOLUME_SLIDE_OFF"
+#define ATM_TXT_OP_SET_NOTE_CUT      "SET_NOTE_CUT"
+#define ATM_TXT_OP_NOTE_CUT_OFF      "NOTE_CUT_OFF"
+#define ATM_TXT_OP_SET_TRANSPOSITION "SET_TRANSPOSITION"
+#define ATM_TXT_OP_TRANSPOSITION_OFF "TRANSPOSITION_OFF"
+#define ATM_TXT_OP_GOTO_ADVANCED     "GOTO_ADVANCED"
+#define ATM_TXT_OP_SET_VIBRATO       "SET_VIBRATO"
+
+typedef struct {
+    const char* cur;
+    // Where the last token read starts, or the end of the text once there are no more.
+    const char* tok;
+} AtmTokenizer;
+
+typedef struct {
+    uint8_t* bytes;
+    size_t size;
+    size_t capacity;
+} ByteBuffer;
+
+typedef struct {
+    uint32_t* items;
+    size_t size;
+    size_t capacity;
+} OffsetBuffer;
+
+static bool atm_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool atm_token_equals(const char* token, const char* keyword) {
+    while(*token && *keyword) {
+        if(atm_char_upper(*token) != atm_char_upper(*keyword)) return false;
+        token++;
+        keyword++;
+    }
+    return (*token == '\0') && (*keyword == '\0');
+}
+
+static bool byte_buffer_push(ByteBuffer* b, uint8_t value) {
+    if(b->size == b->capacity) {
+        size_t next = (b->capacity == 0) ? 128 : (b->capacity * 2);
+        uint8_t* n = (uint8_t*)realloc(b->bytes, next);
+        if(!n) return false;
+        b->bytes = n;
+        b->capacity = next;
+    }
+    b->bytes[b->size++] = value;
+    return true;
+}
+
+static bool byte_buffer_push_u8_from_i32(ByteBuffer* b, int32_t value) {
+    return byte_buffer_push(b, (uint8_t)(value & 0xFF));
+}
+
+static bool byte_buffer_push_vle(ByteBuffer* b, uint32_t value) {
+    uint8_t groups[5];
+    size_t n = 0;
+
+    do {
+        groups[n++] = (uint8_t)(value & 0x7F);
+        value >>= 7;
+    } while(value && n < sizeof(groups));
+
+    for(size_t i = n; i > 0; i--) {
+        uint8_t out = groups[i - 1];
+        if(i != 1) out |= 0x80;
+        if(!byte_buffer_push(b, out)) return false;
+    }
+
+    return true;
+}
+
+static inline void atm_put_u32(uint8_t* dst, size_t* p, uint32_t v) {
+    for(uint8_t i = 0; i < 4; i++) {
+        dst[(*p)++] = (uint8_t)(v >> (i * 8));
+    }
+}
+
+static bool offset_buffer_push(OffsetBuffer* b, uint32_t value) {
+    if(b->size == b->capacity) {
+        size_t next = (b->capacity == 0) ? 16 : (b->capacity * 2);
+        uint32_t* n = (uint32_t*)realloc(b->items, next * sizeof(uint32_t));
+        if(!n) return false;
+        b->items = n;
+        b->capacity = next;
+    }
+    b->items[b->size++] = value;
+    return true;
+}
+
+static bool atm_next_token(AtmTokenizer* tz, char* token, size_t token_size) {
+    const char* p = tz->cur;
+
+    while(*p) {
+        if(*p == ATM_TXT_COMMENT) {
+            while(*p && *p != '\n')
+                p++;
+            continue;
+        }
+
+        if(atm_is_space(*p) || *p == ATM_TXT_SEPARATOR) {
+            p++;
+            continue;
+        }
+
+        break;
+    }
+
+    tz->tok = p;
+    if(!*p) {
+        tz->cur = p;
+        return false;
+    }
+
+    size_t n = 0;
+    while(*p && !atm_is_space(*p) && (*p != ATM_TXT_SEPARATOR) && (*p != ATM_TXT_COMMENT)) {
+        if((n + 1) < token_size) token[n++] = *p;
+        p++;
+    }
+
+    token[n] = '\0';
+    tz->cur = p;
+    return n > 0;
+}
+
+static bool atm_parse_i32(const char* token, int32_t* out) {
+    char* end = NULL;
+    long value = strtol(token, &end, 0);
+    if(!end || (*end != '\0')) return false;
+    *out = (int32_t)value;
+    return true;
+}
+
+static bool atm_parse_arg_i32(AtmTokenizer* tz, int32_t* out) {
+    char token[32];
+    if(!atm_next_token(tz, token, sizeof(token))) return false;
+    return atm_parse_i32(token, out);
+}
+
+static bool atm_parse_name_line(AtmTokenizer* tz, char* out, size_t out_size) {
+    if(!out || out_size == 0) return false;
+
+    const char* p = tz->cur;
+    while(*p == ' ' || *p == '\t' || *p == ATM_TXT_SEPARATOR)
+        p++;
+
+    if(*p == '\0' || *p == '\n' || *p == '\r' || *p == ATM_TXT_COMMENT) return false;
+
+    size_t n = 0;
+    while(*p && *p != '\n' && *p != '\r' && *p != ATM_TXT_COMMENT) {
+        if((n + 1) < out_size) out[n++] = *p;
+        p++;
+    }
+
+    while(n > 0 && (out[n - 1] == ' ' || out[n - 1] == '\t' || out[n - 1] == ATM_TXT_SEPARATOR))
+        n--;
+    out[n] = '\0';
+
+    tz->cur = p;
+    return n > 0;
+}
+
+static bool atm_parse_why(const char** why, const char* message) {
+    *why = message;
+    return false;
+}
+
+// Sets *why when it fails for any reason but memory.
+static bool atm_emit_instruction(AtmTokenizer* tz, const char* op, ByteBuffer* data, const char** why) {
+    int32_t a = 0;
+    int32_t b = 0;
+    int32_t c = 0;
+    int32_t d = 0;
+
+    if(atm_token_equals(op, ATM_TXT_OP_DB)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        return byte_buffer_push_u8_from_i32(data, a);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_NOTE)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        if(a < 0 || a > 63) return atm_parse_why(why, "note out of range 0..63");
+        return byte_buffer_push_u8_from_i32(data, a);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_DELAY)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        if(a < 1) return atm_parse_why(why, "delay under 1");
+
+        if(a <= 64) {
+            return byte_buffer_push_u8_from_i32(data, 159 + a);
+        } else {
+            if(!byte_buffer_push(data, 224)) return false;
+            return byte_buffer_push_vle(data, (uint32_t)(a - 65));
+        }
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_STOP)) {
+        return byte_buffer_push(data, 0x9F);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_RETURN)) {
+        return byte_buffer_push(data, 0xFE);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_GOTO)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        return byte_buffer_push(data, 0xFC) && byte_buffer_push_u8_from_i32(data, a);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_REPEAT)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        if(!atm_parse_arg_i32(tz, &b)) return atm_parse_why(why, "bad argument");
+        return byte_buffer_push(data, 0xFD) && byte_buffer_push_u8_from_i32(data, a) &&
+               byte_buffer_push_u8_from_i32(data, b);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_SET_TEMPO)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        return byte_buffer_push(data, 0x9D) && byte_buffer_push_u8_from_i32(data, a);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_ADD_TEMPO)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        return byte_buffer_push(data, 0x9C) && byte_buffer_push_u8_from_i32(data, a);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_SET_VOLUME)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        return byte_buffer_push(data, 0x40) && byte_buffer_push_u8_from_i32(data, a);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_VOLUME_SLIDE_ON)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        return byte_buffer_push(data, 0x41) && byte_buffer_push_u8_from_i32(data, a);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_VOLUME_SLIDE_OFF)) {
+        return byte_buffer_push(data, 0x43);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_SET_NOTE_CUT)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        return byte_buffer_push(data, 0x54) && byte_buffer_push_u8_from_i32(data, a);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_NOTE_CUT_OFF)) {
+        return byte_buffer_push(data, 0x55);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_SET_TRANSPOSITION)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        return byte_buffer_push(data, 0x4C) && byte_buffer_push_u8_from_i32(data, a);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_TRANSPOSITION_OFF)) {
+        return byte_buffer_push(data, 0x4D);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_GOTO_ADVANCED)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        if(!atm_parse_arg_i32(tz, &b)) return atm_parse_why(why, "bad argument");
+        if(!atm_parse_arg_i32(tz, &c)) return atm_parse_why(why, "bad argument");
+        if(!atm_parse_arg_i32(tz, &d)) return atm_parse_why(why, "bad argument");
+        return byte_buffer_push(data, 0x9E) && byte_buffer_push_u8_from_i32(data, a) &&
+               byte_buffer_push_u8_from_i32(data, b) && byte_buffer_push_u8_from_i32(data, c) &&
+               byte_buffer_push_u8_from_i32(data, d);
+    }
+
+    if(atm_token_equals(op, ATM_TXT_OP_SET_VIBRATO)) {
+        if(!atm_parse_arg_i32(tz, &a)) return atm_parse_why(why, "bad argument");
+        if(!atm_parse_arg_i32(tz, &b)) return atm_parse_why(why, "bad argument");
+        return byte_buffer_push(data, 0x4E) && byte_buffer_push_u8_from_i32(data, a) &&
+               byte_buffer_push_u8_from_i32(data, b);
+    }
+
+    if(atm_parse_i32(op, &a)) {
+        return byte_buffer_push_u8_from_i32(data, a);
+    }
+
+    return atm_parse_why(why, "unknown instruction");
+}
+
+// Bytes in the compiled instruction at p, operands included; mirrors the decoder in
+// atm_channel_step(). Never reads past end.
+static size_t atm_instruction_size(const uint8_t* p, const uint8_t* end) {
+    const uint8_t cmd = *p;
+    size_t size = 1;
+
+    if(cmd >= 64 && cmd < 160) {
+        switch(cmd - 64) {
+        case 0:
+        case 1:
+        case 4:
+        case 9:
+        case 11:
+        case 12:
+        case 18:
+        case 20:
+        case 92:
+        case 93:
+            size = 2;
+            break;
+        case 2:
+        case 5:
+        case 7:
+        case 14:
+        case 16:
+            size = 3;
+            break;
+        case 94:
+            size = 5;
+            break;
+        default:
+            break;
+        }
+    } else if(cmd == 252) {
+        size = 2;
+    } else if(cmd == 253) {
+        size = 3;
+    } else if(cmd == 224 || cmd == 255) {
+        // Opcode, then a VLE whose last byte has bit 7 clear.
+        while(p + size < end && (p[size++] & 0x80)) {
+        }
+    }
+
+    const size_t left = (size_t)(end - p);
+    return size < left ? size : left;
+}
+
+#define ATM_FNV_BASIS 2166136261u
+#define ATM_FNV_PRIME 16777619u
+
+static uint32_t atm_hash_bytes(uint32_t h, const void* bytes, size_t size) {
+    const uint8_t* p = (const uint8_t*)bytes;
+    for(size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * ATM_FNV_PRIME;
+    }
+    return h;
+}
+
+// Hashes where every instruction of a compiled track starts; two tracks with the same layout
+// hash can trade places under a playing channel.
+static uint32_t atm_layout_hash(const uint8_t* bytes, size_t size) {
+    uint32_t h = ATM_FNV_BASIS;
+    const uint8_t* end = bytes + size;
+    for(const uint8_t* p = bytes; p < end;) {
+        const uint8_t n = (uint8_t)atm_instruction_size(p, end);
+        h = atm_hash_bytes(h, &n, 1);
+        p += n;
+    }
+    return h;
+}
+
+// Hashes the tokens of a TRACK block up to and including ENDTRACK, leaving tz after it. Returns
+// false if the text ends first.
+static bool atm_hash_track_text(AtmTokenizer* tz, uint32_t* out) {
+    char token[64];
+    uint32_t h = ATM_FNV_BASIS;
+    while(atm_next_token(tz, token, sizeof(token))) {
+        if(atm_token_equals(token, ATM_TXT_CMD_ENDTRACK)) {
+            *out = h;
+            return true;
+        }
+        // Token plus its terminator, so "1 23" and "12 3" differ.
+        h = atm_hash_bytes(h, token, strlen(token) + 1);
+    }
+    return false;
+}
+
+// Fills err, if any, with message and the line and column of at in text.
+static void atm_parse_fail(AtmParseError* err, const char* text, const char* at, const char* message) {
+    if(!err) return;
+    err->message = message;
+    err->line = 1;
+    err->column = 1;
+    for(const char* p = text; p < at; p++) {
+        if(*p == '\n') {
+            err->line++;
+            err->column = 1;
+        } else {
+            err->column++;
+        }
+    }
+}
+
+// Compiles to the classic image, or with paged set to the paged one (lib/ATMpager.h), which has
+// no size limit and is never cached. On failure says why in err, if any.
+static bool atm_parse_song(
+    const char* text,
+    bool paged,
+    AtmCompileCache* cache,
+    uint8_t** out_buf,
+    size_t* out_size,
+    char* out_song_name,
+    size_t out_song_name_size,
+    AtmParseError* err) {
+    AtmTokenizer tz = {.cur = text, .tok = text};
+    char token[64];
+    // What went wrong and where, for err: at, or else the token tz stopped at.
+    const char* why = "out of memory";
+    const char* at = NULL;
+
+    uint8_t entry[4] = {0};
+    int32_t value = 0;
+
+    ByteBuffer data = {NULL, 0, 0};
+    OffsetBuffer offsets = {NULL, 0, 0};
+    AtmTrackCacheEntry* tracks = NULL;
+    size_t tracks_capacity = 0;
+    size_t recompiled = 0;
+
+    uint8_t* song = NULL;
+    size_t song_size = 0;
+    size_t p = 0;
+    bool ok = false;
+    char ignored_song_name[2] = {0};
+    char* song_name_dst = out_song_name ? out_song_name : ignored_song_name;
+    size_t song_name_dst_size = out_song_name ? out_song_name_size : sizeof(ignored_song_name);
+
+    if(song_name_dst_size > 0) song_name_dst[0] = '\0';
+
+    why = "expected ATM1";
+    if(!atm_next_token(&tz, token, sizeof(token)) || !atm_token_equals(token, ATM_TXT_MAGIC))
+        goto out;
+
+    why = "expected NAME or ENTRY";
+    if(!atm_next_token(&tz, token, sizeof(token))) goto out;
+    if(atm_token_equals(token, ATM_TXT_CMD_NAME)) {
+        why = "empty NAME";
+        if(!atm_parse_name_line(&tz, song_name_dst, song_name_dst_size)) goto out;
+        why = "expected ENTRY";
+        if(!atm_next_token(&tz, token, sizeof(token))) goto out;
+    }
+
+    if(!atm_token_equals(token, ATM_TXT_CMD_ENTRY))
+        goto out;
+    why = "ENTRY needs four track numbers";
+    for(size_t i = 0; i < 4; i++) {
+        if(!atm_parse_arg_i32(&tz, &value)) goto out;
+        entry[i] = (uint8_t)(value & 0xFF);
+    }
+
+    while(atm_next_token(&tz, token, sizeof(token))) {
+        if(atm_token_equals(token, ATM_TXT_CMD_END)) {
+            break;
+        }
+
+        why = "expected TRACK or END";
+        if(!atm_token_equals(token, ATM_TXT_CMD_TRACK)) goto out;
+        const char* track_at = tz.tok;
+
+        const size_t index = offsets.size;
+        const size_t start = data.size;
+        why = "out of memory";
+        if(!offset_buffer_push(&offsets, (uint32_t)data.size)) goto out;
+
+        if(!cache) {
+            while(atm_next_token(&tz, token, sizeof(token))) {
+                if(atm_token_equals(token, ATM_TXT_CMD_ENDTRACK)) break;
+                if(!atm_emit_instruction(&tz, token, &data, &why)) goto out;
+            }
+
+            if(!atm_token_equals(token, ATM_TXT_CMD_ENDTRACK)) {
+                why = "TRACK without ENDTRACK";
+                at = track_at;
+                goto out;
+            }
+            continue;
+        }
+
+        if(index == tracks_capacity) {
+            const size_t next = tracks_capacity ? tracks_capacity * 2 : 16;
+            AtmTrackCacheEntry* n =
+                (AtmTrackCacheEntry*)realloc(tracks, next * sizeof(AtmTrackCacheEntry));
+            if(!n) goto out;
+            tracks = n;
+            tracks_capacity = next;
+        }
+
+        AtmTokenizer body = tz;
+        AtmTrackCacheEntry* t = &tracks[index];
+        if(!atm_hash_track_text(&tz, &t->text_hash)) {
+            why = "TRACK without ENDTRACK";
+            at = track_at;
+            goto out;
+        }
+
+        const AtmTrackCacheEntry* was = (index < cache->count) ? &cache->tracks[index] : NULL;
+        if(was && was->text_hash == t->text_hash) {
+            for(size_t i = 0; i < was->size; i++) {
+                if(!byte_buffer_push(&data, cache->data[was->offset + i])) goto out;
+            }
+            t->layout_hash = was->layout_hash;
+            t->change = AtmTrackSame;
+        } else {
+            while(atm_next_token(&body, token, sizeof(token))) {
+                if(atm_token_equals(token, ATM_TXT_CMD_ENDTRACK)) break;
+                if(!atm_emit_instruction(&body, token, &data, &why)) {
+                    at = body.tok;
+                    goto out;
+                }
+            }
+            t->layout_hash = atm_layout_hash(data.bytes + start, data.size - start);
+            recompiled++;
+
+            if(!was) {
+                t->change = AtmTrackRelaid;
+            } else if(
+                was->size == data.size - start &&
+                memcmp(cache->data + was->offset, data.bytes + start, was->size) == 0) {
+                t->change = AtmTrackSame;
+            } else {
+                t->change = (was->layout_hash == t->layout_hash) ? AtmTrackEdited :
+                                                                    AtmTrackRelaid;
+            }
+        }
+        t->offset = (uint16_t)start;
+        t->size = (uint16_t)(data.size - start);
+    }
+
+    why = "expected END";
+    if(!atm_token_equals(token, ATM_TXT_CMD_END)) goto out;
+    why = offsets.size ? "more than 255 tracks" : "no tracks";
+    if(offsets.size == 0 || offsets.size > 255) goto out;
+    why = "out of memory";
+
+    if(paged) {
+        const uint32_t data_offset = atm_paged_data_offset((uint8_t)offsets.size);
+        if(data.size > UINT32_MAX - data_offset) goto out;
+        song_size = data_offset + data.size;
+        song = (uint8_t*)malloc(song_size);
+        if(!song) goto out;
+
+        memcpy(song, ATM_PAGED_MAGIC, 4);
+        song[4] = ATM_PAGED_VERSION;
+        song[5] = (uint8_t)offsets.size;
+        song[6] = 0;
+        song[7] = 0;
+        p = 8;
+        atm_put_u32(song, &p, (uint32_t)data.size);
+        for(size_t i = 0; i < offsets.size; i++) {
+            atm_put_u32(song, &p, offsets.items[i]);
+        }
+    } else {
+        // 16-bit offsets: bigger songs only compile paged.
+        why = "track data over 64 KB";
+        if(data.size > UINT16_MAX) goto out;
+        why = "out of memory";
+        song_size = 1 + offsets.size * 2 + 4 + data.size;
+        song = (uint8_t*)malloc(song_size);
+        if(!song) goto out;
+
+        song[p++] = (uint8_t)offsets.size;
+        for(size_t i = 0; i < offsets.size; i++) {
+            uint32_t off = offsets.items[i];
+            song[p++] = (uint8_t)(off & 0xFF);
+            song[p++] = (uint8_t)((off >> 8) & 0xFF);
+        }
+    }
+    for(size_t i = 0; i < 4; i++) {
+        song[p++] = entry[i];
+    }
+    memcpy(song + p, data.bytes, data.size);
+
+    if(cache) {
+        atm_compile_cache_free(cache);
+        cache->tracks = tracks;
+        cache->count = offsets.size;
+        cache->data = data.bytes;
+        cache->data_size = data.size;
+        cache->recompiled = recompiled;
+        tracks = NULL;
+        data.bytes = NULL;
+    }
+
+    *out_buf = song;
+    *out_size = song_size;
+    song = NULL;
+    ok = true;
+
+out:
+    if(!ok) atm_parse_fail(err, text, at ? at : tz.tok, why);
+    if(song) free(song);
+    if(data.bytes) free(data.bytes);
+    if(offsets.items) free(offsets.items);
+    if(tracks) free(tracks);
+    return ok;
+}
+
+bool atm_parse_song_text(
+    const char* text,
+    uint8_t** out_buf,
+    size_t* out_size,
+    char* out_song_name,
+    size_t out_song_name_size) {
+    return atm_parse_song(
+        text, false, NULL, out_buf, out_size, out_song_name, out_song_name_size, NULL);
+}
+
+bool atm_parse_song_text_diag(
+    const char* text,
+    uint8_t** out_buf,
+    size_t* out_size,
+    char* out_song_name,
+    size_t out_song_name_size,
+    AtmParseError* err) {
+    return atm_parse_song(
+        text, false, NULL, out_buf, out_size, out_song_name, out_song_name_size, err);
+}
+
+bool atm_parse_song_text_paged(
+    const char* text,
+    uint8_t** out_buf,
+    size_t* out_size,
+    char* out_song_name,
+    size_t out_song_name_size) {
+    return atm_parse_song(
+        text, true, NULL, out_buf, out_size, out_song_name, out_song_name_size, NULL);
+}
+
+bool atm_parse_song_text_cached(
+    const char* text,
+    AtmCompileCache* cache,
+    uint8_t** out_buf,
+    size_t* out_size,
+    char* out_song_name,
+    size_t out_song_name_size) {
+    return atm_parse_song(
+        text, false, cache, out_buf, out_size, out_song_name, out_song_name_size, NULL);
+}
+
+void atm_compile_cache_free(AtmCompileCache* cache) {
+    if(cache->tracks) free(cache->tracks);
+    if(cache->data) free(cache->data);
+    cache->tracks = NULL;
+    cache->count = 0;
+    cache->data = NULL;
+    cache->data_size = 0;
+    cache->recompiled = 0;
+}
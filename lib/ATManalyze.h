@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t duration_ms;
+    uint32_t loop_start_ms;
+    uint32_t loop_end_ms;
+    bool terminates;
+    bool looped;
+} AtmSongInfo;
+
+// Walks a compiled song tick by tick without synthesis, following the same flow and tempo rules
+// as ATM_playroutine. Times use the engine's song clock (see atm_get_position_ms()).
+// Returns false if the song is malformed or did not settle within the simulation limit.
+bool atm_analyze_song(const uint8_t* song, size_t song_size, AtmSongInfo* out);
+
+// Looks for a loop a channel can run forever without reaching a delay: track 0 returning without
+// one while it is played outside any call (where RETURN starts track 0 over), or tracks calling
+// each other, or restarting themselves, before one. Only tracks a channel can reach count. Such a
+// song would hit the engine's per-tick command limit. Returns true and the first offending track
+// in *out_track if there is one; a malformed song also returns true, with track 0xFF.
+bool atm_find_delay_free_cycle(const uint8_t* song, size_t song_size, uint8_t* out_track);
+
+#ifdef __cplusplus
+}
+#endif
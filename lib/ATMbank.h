@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Bank file: several compiled songs behind a name/offset index, so a player can load any
+// entry with one seek and one read. All integers are little-endian.
+//
+//   header  "ATMB", u8 version, u8 reserved, u16 count
+//   index   count x { char name[40] (NUL-padded), u32 offset, u32 size }
+//   images  compiled songs, offsets are from the start of the file
+
+#define ATM_BANK_MAGIC        "ATMB"
+#define ATM_BANK_VERSION      1
+#define ATM_BANK_HEADER_SIZE  8
+#define ATM_BANK_NAME_SIZE    40
+#define ATM_BANK_ENTRY_SIZE   (ATM_BANK_NAME_SIZE + 8)
+#define ATM_BANK_MAX_ENTRIES  255
+#define ATM_BANK_MAX_SONG_SIZE (64 * 1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    char name[ATM_BANK_NAME_SIZE];
+    uint32_t offset;
+    uint32_t size;
+} AtmBankEntry;
+
+static inline uint32_t atm_bank_read_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void atm_bank_write_u32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)((v >> 8) & 0xFF);
+    p[2] = (uint8_t)((v >> 16) & 0xFF);
+    p[3] = (uint8_t)((v >> 24) & 0xFF);
+}
+
+// Returns the entry count, or -1 if the header is not a supported bank.
+static inline int32_t atm_bank_parse_header(const uint8_t header[ATM_BANK_HEADER_SIZE]) {
+    if(memcmp(header, ATM_BANK_MAGIC, 4) != 0) return -1;
+    if(header[4] != ATM_BANK_VERSION) return -1;
+    uint16_t count = (uint16_t)(header[6] | (header[7] << 8));
+    if(count > ATM_BANK_MAX_ENTRIES) return -1;
+    return count;
+}
+
+static inline void atm_bank_parse_entry(const uint8_t raw[ATM_BANK_ENTRY_SIZE], AtmBankEntry* out) {
+    memcpy(out->name, raw, ATM_BANK_NAME_SIZE);
+    out->name[ATM_BANK_NAME_SIZE - 1] = '\0';
+    out->offset = atm_bank_read_u32(raw + ATM_BANK_NAME_SIZE);
+    out->size = atm_bank_read_u32(raw + ATM_BANK_NAME_SIZE + 4);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Blocks.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Capture of the output to a WAV file: 8-bit unsigned mono, the very samples the speaker gets.
+// The audio side queues each block it plays into a ring and never waits; a writer on a thread of
+// its own drains the ring in runs of ATM_CAPTURE_WRITE_BLOCKS. Blocks that find the ring full are
+// dropped and counted, so a slow card costs gaps in the file and never an underrun.
+//
+// The header is padded with a JUNK chunk to ATM_CAPTURE_HEADER_SIZE bytes, so that every write of
+// samples starts on a sector boundary of the file.
+
+// About 260 ms of output; allocated only while capturing.
+#define ATM_CAPTURE_RING_BLOCKS  64
+// 1 KB, two sectors.
+#define ATM_CAPTURE_WRITE_BLOCKS 8
+#define ATM_CAPTURE_HEADER_SIZE  512
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Writes size bytes at offset of the file; runs on the writer. Returns false on a storage error.
+typedef bool (*AtmCaptureWrite)(void* ctx, uint32_t offset, const uint8_t* src, size_t size);
+
+typedef struct {
+    AtmBlockRing ring;
+    uint32_t rate_hz;
+    // Sample bytes written so far, and a sticky flag for a failed write. Writer side.
+    uint32_t bytes;
+    bool error;
+    // Blocks the audio side found no room for. Audio side.
+    uint32_t dropped;
+} AtmCapture;
+
+// Allocates the ring. Returns false, leaving nothing to close, if there is no memory for it.
+bool atm_capture_open(AtmCapture* c, uint32_t rate_hz);
+void atm_capture_close(AtmCapture* c);
+
+// Audio side: queues a copy of one block of ATM_BLOCK_SAMPLES samples, or drops it.
+static inline void atm_capture_feed(AtmCapture* c, const uint8_t* block) {
+    AtmBlock* slot = atm_block_ring_back(&c->ring);
+    if(!slot) {
+        __atomic_store_n(&c->dropped, c->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    memcpy(*slot, block, ATM_BLOCK_SAMPLES);
+    atm_block_ring_push(&c->ring);
+}
+
+// Writer side: writes the header of an empty file. Before the audio side starts feeding.
+bool atm_capture_begin(AtmCapture* c, AtmCaptureWrite write, void* ctx);
+// Writer side: writes the oldest ATM_CAPTURE_WRITE_BLOCKS queued blocks, or with flush whatever
+// is queued, up to that many. Returns false if there was nothing to write. After a failed write
+// blocks are still taken from the ring, just not written.
+bool atm_capture_service(AtmCapture* c, AtmCaptureWrite write, void* ctx, bool flush);
+// Writer side: once the audio side has stopped feeding, writes what is left and the final sizes
+// into the header. Returns false if any write failed.
+bool atm_capture_finish(AtmCapture* c, AtmCaptureWrite write, void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+
+// Compile-time ATM1 compiler. Produces the same image as atm_parse_song_text(), as a
+// constexpr std::array that lives in flash and needs no parse time or heap at runtime:
+//
+//   ATM_CONSTEXPR_SONG(title_song, R"ATM(
+//   ATM1
+//   ENTRY 0 1 2 3
+//   ...
+//   END
+//   )ATM");
+//
+//   ATM.play(title_song.data());
+//
+// A text that does not compile fails the build; the compiler error names
+// atm_const::check<N>, where N is the byte offset in the text where compilation stopped.
+
+namespace atm_const {
+
+static constexpr size_t npos = (size_t)-1;
+
+struct Result {
+    size_t size;
+    size_t tracks;
+    size_t error_offset;
+};
+
+namespace detail {
+
+constexpr char upper(char c) {
+    return (c >= 'a' && c <= 'z') ? (char)(c - ('a' - 'A')) : c;
+}
+
+constexpr bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+struct Token {
+    size_t begin;
+    size_t len;
+};
+
+class Compiler {
+public:
+    constexpr Compiler(const char* text, uint8_t* out, size_t track_count)
+        : text_(text)
+        , out_(out)
+        , header_(1 + track_count * 2 + 4) {
+    }
+
+    constexpr Result run() {
+        Token tok{0, 0};
+        int32_t value = 0;
+        uint8_t entry[4] = {0, 0, 0, 0};
+
+        if(!next_token(tok) || !equals(tok, "ATM1")) return fail();
+
+        if(!next_token(tok)) return fail();
+        if(equals(tok, "NAME")) {
+            if(!skip_name_line()) return fail();
+            if(!next_token(tok)) return fail();
+        }
+
+        if(!equals(tok, "ENTRY")) return fail();
+        for(size_t i = 0; i < 4; i++) {
+            if(!parse_arg(value)) return fail();
+            entry[i] = (uint8_t)(value & 0xFF);
+        }
+
+        while(next_token(tok)) {
+            if(equals(tok, "END")) break;
+            if(!equals(tok, "TRACK")) return fail();
+
+            if(out_) {
+                put(1 + tracks_ * 2, (uint8_t)(data_ & 0xFF));
+                put(2 + tracks_ * 2, (uint8_t)((data_ >> 8) & 0xFF));
+            }
+            tracks_++;
+
+            while(next_token(tok)) {
+                if(equals(tok, "ENDTRACK")) break;
+                if(!emit_instruction(tok)) return fail();
+            }
+
+            if(!equals(tok, "ENDTRACK")) return fail();
+        }
+
+        if(!equals(tok, "END")) return fail();
+        if(tracks_ == 0 || tracks_ > 255) return fail();
+
+        if(out_) {
+            put(0, (uint8_t)tracks_);
+            for(size_t i = 0; i < 4; i++)
+                put(1 + tracks_ * 2 + i, entry[i]);
+        }
+
+        return Result{1 + tracks_ * 2 + 4 + data_, tracks_, npos};
+    }
+
+private:
+    const char* text_;
+    uint8_t* out_;
+    size_t header_;
+    size_t pos_ = 0;
+    size_t tracks_ = 0;
+    size_t data_ = 0;
+
+    constexpr Result fail() const {
+        return Result{0, 0, pos_};
+    }
+
+    constexpr void put(size_t at, uint8_t v) {
+        out_[at] = v;
+    }
+
+    constexpr bool push(uint8_t v) {
+        if(out_) put(header_ + data_, v);
+        data_++;
+        return true;
+    }
+
+    constexpr bool push_i32(int32_t v) {
+        return push((uint8_t)(v & 0xFF));
+    }
+
+    constexpr bool push_vle(uint32_t v) {
+        uint8_t groups[5] = {0, 0, 0, 0, 0};
+        size_t n = 0;
+        do {
+            groups[n++] = (uint8_t)(v & 0x7F);
+            v >>= 7;
+        } while(v && n < sizeof(groups));
+
+        for(size_t i = n; i > 0; i--) {
+            uint8_t b = groups[i - 1];
+            if(i != 1) b |= 0x80;
+            push(b);
+        }
+        return true;
+    }
+
+    constexpr bool next_token(Token& tok) {
+        while(text_[pos_]) {
+            if(text_[pos_] == '#') {
+                while(text_[pos_] && text_[pos_] != '\n')
+                    pos_++;
+                continue;
+            }
+            if(is_space(text_[pos_]) || text_[pos_] == ',') {
+                pos_++;
+                continue;
+            }
+            break;
+        }
+        if(!text_[pos_]) return false;
+
+        size_t begin = pos_;
+        while(text_[pos_] && !is_space(text_[pos_]) && text_[pos_] != ',' && text_[pos_] != '#')
+            pos_++;
+
+        tok = Token{begin, pos_ - begin};
+        return true;
+    }
+
+    constexpr bool equals(const Token& tok, const char* keyword) const {
+        size_t i = 0;
+        for(; i < tok.len && keyword[i]; i++) {
+            if(upper(text_[tok.begin + i]) != upper(keyword[i])) return false;
+        }
+        return i == tok.len && keyword[i] == '\0';
+    }
+
+    constexpr bool skip_name_line() {
+        while(text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == ',')
+            pos_++;
+
+        const char c = text_[pos_];
+        if(c == '\0' || c == '\n' || c == '\r' || c == '#') return false;
+
+        size_t n = 0;
+        size_t trimmed = 0;
+        while(text_[pos_] && text_[pos_] != '\n' && text_[pos_] != '\r' && text_[pos_] != '#') {
+            n++;
+            if(text_[pos_] != ' ' && text_[pos_] != '\t' && text_[pos_] != ',') trimmed = n;
+            pos_++;
+        }
+        return trimmed > 0;
+    }
+
+    // Same acceptance rules as strtol(token, &end, 0) followed by a check for *end == '\0'.
+    constexpr bool parse_i32(const Token& tok, int32_t& out) const {
+        size_t i = 0;
+        bool neg = false;
+        if(i < tok.len && (text_[tok.begin] == '+' || text_[tok.begin] == '-')) {
+            neg = text_[tok.begin] == '-';
+            i++;
+        }
+
+        uint32_t base = 10;
+        if(i + 1 < tok.len && text_[tok.begin + i] == '0' &&
+           upper(text_[tok.begin + i + 1]) == 'X' && i + 2 < tok.len) {
+            base = 16;
+            i += 2;
+        } else if(i < tok.len && text_[tok.begin + i] == '0') {
+            base = 8;
+        }
+
+        if(i >= tok.len) return false;
+
+        int64_t v = 0;
+        for(; i < tok.len; i++) {
+            const char c = upper(text_[tok.begin + i]);
+            uint32_t d = 0;
+            if(c >= '0' && c <= '9')
+                d = (uint32_t)(c - '0');
+            else if(c >= 'A' && c <= 'F')
+                d = (uint32_t)(c - 'A' + 10);
+            else
+                return false;
+            if(d >= base) return false;
+            v = v * base + d;
+            if(v > INT32_MAX) v = INT32_MAX;
+        }
+
+        out = (int32_t)(neg ? -v : v);
+        return true;
+    }
+
+    constexpr bool parse_arg(int32_t& out) {
+        Token tok{0, 0};
+        if(!next_token(tok)) return false;
+        return parse_i32(tok, out);
+    }
+
+    constexpr bool emit_instruction(const Token& op) {
+        int32_t a = 0;
+        int32_t b = 0;
+        int32_t c = 0;
+        int32_t d = 0;
+
+        if(equals(op, "DB")) {
+            if(!parse_arg(a)) return false;
+            return push_i32(a);
+        }
+
+        if(equals(op, "NOTE")) {
+            if(!parse_arg(a)) return false;
+            if(a < 0 || a > 63) return false;
+            return push_i32(a);
+        }
+
+        if(equals(op, "DELAY")) {
+            if(!parse_arg(a)) return false;
+            if(a < 1) return false;
+            if(a <= 64) return push_i32(159 + a);
+            return push(224) && push_vle((uint32_t)(a - 65));
+        }
+
+        if(equals(op, "STOP")) return push(0x9F);
+        if(equals(op, "RETURN")) return push(0xFE);
+
+        if(equals(op, "GOTO")) {
+            if(!parse_arg(a)) return false;
+            return push(0xFC) && push_i32(a);
+        }
+
+        if(equals(op, "REPEAT")) {
+            if(!parse_arg(a) || !parse_arg(b)) return false;
+            return push(0xFD) && push_i32(a) && push_i32(b);
+        }
+
+        if(equals(op, "SET_TEMPO")) {
+            if(!parse_arg(a)) return false;
+            return push(0x9D) && push_i32(a);
+        }
+
+        if(equals(op, "ADD_TEMPO")) {
+            if(!parse_arg(a)) return false;
+            return push(0x9C) && push_i32(a);
+        }
+
+        if(equals(op, "SET_VOLUME")) {
+            if(!parse_arg(a)) return false;
+            return push(0x40) && push_i32(a);
+        }
+
+        if(equals(op, "VOLUME_SLIDE_ON")) {
+            if(!parse_arg(a)) return false;
+            return push(0x41) && push_i32(a);
+        }
+
+        if(equals(op, "VOLUME_SLIDE_OFF")) return push(0x43);
+
+        if(equals(op, "SET_NOTE_CUT")) {
+            if(!parse_arg(a)) return false;
+            return push(0x54) && push_i32(a);
+        }
+
+        if(equals(op, "NOTE_CUT_OFF")) return push(0x55);
+
+        if(equals(op, "SET_TRANSPOSITION")) {
+            if(!parse_arg(a)) return false;
+            return push(0x4C) && push_i32(a);
+        }
+
+        if(equals(op, "TRANSPOSITION_OFF")) return push(0x4D);
+
+        if(equals(op, "GOTO_ADVANCED")) {
+            if(!parse_arg(a) || !parse_arg(b) || !parse_arg(c) || !parse_arg(d)) return false;
+            return push(0x9E) && push_i32(a) && push_i32(b) && push_i32(c) && push_i32(d);
+        }
+
+        if(equals(op, "SET_VIBRATO")) {
+            if(!parse_arg(a) || !parse_arg(b)) return false;
+            return push(0x4E) && push_i32(a) && push_i32(b);
+        }
+
+        if(parse_i32(op, a)) return push_i32(a);
+
+        return false;
+    }
+};
+
+} // namespace detail
+
+constexpr Result measure(const char* text) {
+    detail::Compiler c(text, nullptr, 0);
+    return c.run();
+}
+
+template <size_t N>
+constexpr std::array<uint8_t, N> compile(const char* text) {
+    std::array<uint8_t, N> image{};
+    const Result r = measure(text);
+    if(r.error_offset != npos || r.size != N) return image;
+
+    detail::Compiler c(text, image.data(), r.tracks);
+    c.run();
+    return image;
+}
+
+template <size_t ErrorOffset>
+struct check {
+    static_assert(ErrorOffset == npos, "ATM1 text does not compile, see the offset in check<N>");
+    static constexpr bool ok = ErrorOffset == npos;
+};
+
+} // namespace atm_const
+
+#define ATM_CONSTEXPR_SONG(name, text)                                                         \
+    static constexpr const char name##_atm_text[] = text;                                     \
+    static constexpr ::atm_const::Result name##_atm_result = ::atm_const::measure(name##_atm_text); \
+    static_assert(::atm_const::check<name##_atm_result.error_offset>::ok, #name);             \
+    static constexpr auto name = ::atm_const::compile<name##_atm_result.size>(name##_atm_text)
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "ATMlib.h"
+#include "ATMpager.h"
+#include "Vol.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Commands one channel may run in one tick. A track that jumps around without reaching a DELAY
+// would otherwise spin forever on the player thread; past this, or past the seven nested calls
+// the channel has room for, the channel is stopped as if by STOP and flagged in
+// AtmEngine::runaway. Real songs stay far below it.
+#define ATM_STEP_MAX_COMMANDS 4096
+
+// Oscillators the engine drives. Song channel n plays on osc[n]. A sound effect on channel n
+// borrows that oscillator, or in the extended build (-DATM_SYNTH_EXTENDED) plays on osc[4 + n] of
+// its own, so the song channel keeps sounding under it.
+#ifdef ATM_SYNTH_EXTENDED
+#define ATM_VOICES 8
+#else
+#define ATM_VOICES 4
+#endif
+
+#if defined(ATM_SYNTH_EXTENDED) && defined(ATM_SYNTH_LITE)
+#error "ATM_SYNTH_EXTENDED and ATM_SYNTH_LITE exclude each other"
+#endif
+
+// The oscillator sound effects on channel n play on.
+static inline uint8_t atm_sfx_osc(uint8_t n) {
+    return ATM_VOICES > 4 ? (uint8_t)(4 + n) : n;
+}
+
+// Playback state of one channel inside a song, the part every tick reads. Positions are offsets
+// into the song's track data. Fields are in the order atm_channel_step() goes through them.
+struct ch_t {
+    uint32_t pos;
+    uint16_t delay;
+    uint16_t freq;
+
+    uint8_t reConfig;
+    uint8_t reCount;
+    int8_t glisConfig;
+    uint8_t glisCount;
+    uint8_t arpNotes;
+    uint8_t arpTiming;
+    uint8_t arpCount;
+    int8_t volFreSlide;
+    uint8_t volFreConfig;
+    uint8_t volFreCount;
+    uint8_t treviDepth;
+    uint8_t treviConfig;
+    uint8_t treviCount;
+
+    uint8_t note;
+    uint8_t vol;
+    int8_t transConfig;
+    uint8_t counter;
+    uint8_t track;
+    uint8_t stackIndex;
+    uint8_t repeatPoint;
+};
+
+// Where a channel's calls return to, the first stackIndex entries. Only CALL and RETURN touch
+// it, so it is kept out of ch_t.
+struct AtmCallStack {
+    uint32_t pointer[7];
+    uint8_t counter[7];
+    uint8_t track[7];
+};
+
+// Budgets: ch_t, copied for every snapshot and every tick ready check, and osc_t, read for every
+// sample.
+static_assert(sizeof(ch_t) <= 28, "ch_t over budget");
+static_assert(sizeof(osc_t) <= 12, "osc_t over budget");
+
+// Where channels read their bytecode: a compiled image in memory (data and its track list), or
+// a paged image through pager, with data NULL.
+struct AtmSongSource {
+    const uint8_t* data;
+    const uint16_t* list;
+    AtmPager* pager;
+    // Reads whose page was not cached; they return 0 and end the channel's tick.
+    uint32_t misses;
+};
+
+// Sound effect on one channel. It runs its own channel engine and tempo, so the song underneath
+// keeps its timing and, unless the effect has an oscillator of its own, takes the oscillator back
+// as soon as the effect stops.
+struct AtmSfxSlot {
+    ch_t ch;
+    AtmSongSource src;
+    uint32_t next_tick;
+    uint8_t tick_rate;
+    uint8_t priority;
+    uint8_t active;
+    AtmCallStack stack;
+};
+
+// Everything one player needs to turn a compiled song into samples. Engines share no state, so
+// any number of them can render side by side; the device player owns exactly one.
+//
+// The renderer counts ticks into tick_pending and leaves running them to the caller: the device
+// does that on its own thread, atm_engine_run() does it inline.
+struct AtmEngine {
+    ch_t channel_state[4];
+    osc_t osc[ATM_VOICES];
+    AtmCallStack call_stack[4];
+    AtmSfxSlot sfx[4];
+    VolMeter channel_meters[4];
+
+    // Output sample rate and the factor from note-table frequency to phase increment.
+    uint32_t rate_hz;
+    uint32_t freq_scale_q16;
+
+    uint8_t trackCount;
+    AtmSongSource song;
+
+    uint8_t tickRate;
+    uint8_t ChannelActiveMute;
+    uint8_t uniform_tone_mode;
+    uint16_t master_gain_q8;
+
+    // tick_div is a tick in song time, in samples at the output rate; song_pos advances by it.
+    // tempo_q8 (256 = as written) stretches that into the output tick, tick_period_q16. The
+    // renderer counts out whole tick_period samples; each tick sets the next one's length with
+    // the remainder carried in tick_frac. At a slow tick rate and tempo a tick is more than
+    // 65535 samples, hence 64 bits for tick_period_q16.
+    uint32_t tick_div;
+    uint64_t tick_period_q16;
+    uint32_t tick_period;
+    uint32_t tick_frac;
+    uint32_t tick_acc;
+    uint32_t tick_pending;
+    uint16_t tempo_q8;
+
+    // Semitones added to every song note. Picked up by the next tick, notes already sounding
+    // included; pitch_applied is the shift they currently sound at.
+    int8_t pitch_shift;
+    int8_t pitch_applied;
+
+    // Song position in output samples, advanced once per executed tick.
+    uint32_t song_pos;
+    bool song_ended;
+    // Bit n set once song channel n was stopped for running away (see ATM_STEP_MAX_COMMANDS).
+    uint8_t runaway;
+    // Commands the song channels ran in the last tick, a measure of its cost.
+    uint32_t tick_commands;
+    // The first tick runs after one tick of output, so what tick k changes is heard from sample
+    // song_pos + tick_lead on.
+    uint32_t tick_lead;
+
+    // Note, tempo, loop and end events of the song (not of sound effects), stamped with the
+    // sample they are heard from. Only collected while events_enabled is set.
+    AtmEventRing events;
+    bool events_enabled;
+
+    // Meter levels, published once per rendered block. The renderer fills the buffer level_seq
+    // does not point at, then advances level_seq; see atm_engine_read_levels().
+    uint8_t levels[2][4];
+    uint32_t level_seq;
+};
+
+// Loudness of a song at unity gain, in mix units (the sum of the four channel outputs before
+// the master gain; full scale at unity gain is 254).
+struct AtmLoudness {
+    uint16_t peak;
+    uint16_t rms;
+};
+
+static inline uint32_t atm_tick_div_from_rate(uint32_t hz, uint8_t tr) {
+    if(tr < 1) tr = 1;
+    return hz / (uint32_t)tr;
+}
+
+// Clears the engine to silence with unity gain, no song loaded and ATM_LOGICAL_HZ output.
+void atm_engine_init(AtmEngine* e);
+// Selects one of the supported output rates (ATM_LOGICAL_HZ, 62500, 48000, 44100, 22050). Pitch
+// and tempo sound the same at all of them. Call before atm_engine_load(). Returns false, leaving
+// the rate unchanged, for any other rate.
+bool atm_engine_set_output_rate(AtmEngine* e, uint32_t hz);
+// Recomputes every oscillator's phase increment after its freq was set directly.
+void atm_engine_sync_osc(AtmEngine* e);
+// Plays the song q8 / 256 times as fast, from the next tick on. Pitch is unaffected.
+void atm_engine_set_tempo_q8(AtmEngine* e, uint16_t q8);
+// Sets tickRate directly, e.g. when restoring saved state, and the tick lengths that follow.
+void atm_engine_set_tick_rate(AtmEngine* e, uint8_t tick_rate);
+// Resets the song state and starts song from its ENTRY tracks. Gain, tone mode, tempo scale,
+// pitch shift and running sound effects are kept.
+void atm_engine_load(AtmEngine* e, const uint8_t* song);
+// atm_engine_load() for a paged song. pager must be open and outlive playback.
+void atm_engine_load_paged(AtmEngine* e, AtmPager* pager);
+// Whether the next tick finds every byte it reads cached; always true for a song in memory, which
+// leaves scratch alone. Runs the tick on scratch, a copy of e, so the pages it misses are
+// requested there and then.
+bool atm_engine_tick_ready(const AtmEngine* e, AtmEngine* scratch);
+// Runs up to ticks ticks ahead of e on scratch and requests the pages the first of them to miss
+// needs, so that by the time e gets there they are cached. Follows GOTO, REPEAT and RETURN the
+// way playback will. Paged songs only.
+void atm_engine_prefetch(const AtmEngine* e, AtmEngine* scratch, uint32_t ticks);
+// Swaps the song for song, a recompile of it, without a break: every channel carries on at the
+// same place in the same track. relaid has bit i set (bit i & 31 of word i >> 5) for each track
+// whose instructions moved. Returns false, leaving the engine untouched, if a channel is inside
+// such a track, or inside one song no longer has, or would return into one, and for paged songs.
+bool atm_engine_rebase(AtmEngine* e, const uint8_t* song, const uint32_t relaid[8]);
+// atm_engine_rebase() for saved channel states and their call stacks of the engine's song. All or
+// nothing as well.
+bool atm_engine_rebase_channels(
+    const AtmEngine* e,
+    const uint8_t* song,
+    const uint32_t relaid[8],
+    ch_t ch[4],
+    AtmCallStack stack[4]);
+void atm_engine_reset_meters(AtmEngine* e);
+// Latest meter levels, 0..63 per channel. Never blocks the renderer: a read that raced two
+// publications is simply retried.
+void atm_engine_read_levels(const AtmEngine* e, uint8_t out[4]);
+
+// Runs one tick of every channel. At the end of a song that does not repeat, sets song_ended.
+// Queues music events if enabled.
+void atm_engine_playroutine(AtmEngine* e);
+// atm_engine_playroutine() plus the song position and the length of the next tick.
+void atm_engine_tick(AtmEngine* e);
+
+// Renders count logical samples as unsigned 8-bit PCM centered on 128.
+void atm_engine_render(AtmEngine* e, uint8_t* out, size_t count);
+// atm_engine_render() as signed 16-bit PCM, for host rendering.
+void atm_engine_render_s16(AtmEngine* e, int16_t* out, size_t count);
+// Offline rendering: like atm_engine_render(), but runs due ticks between samples. Stops at the
+// end of the song and returns the number of samples written.
+size_t atm_engine_run(AtmEngine* e, uint8_t* out, size_t count);
+size_t atm_engine_run_s16(AtmEngine* e, int16_t* out, size_t count);
+
+// Estimates the loudness of song from its first max_samples logical samples, running scratch
+// tick by tick and synthesizing the start of each tick. Peak is the largest sum of channel
+// volumes, which square waves reach whenever their phases line up; RMS is that of the
+// synthesized mix. Measured in normal tone mode, uniform-tone mode is always quieter.
+void atm_engine_scan_loudness(
+    AtmEngine* scratch,
+    const uint8_t* song,
+    uint32_t max_samples,
+    AtmLoudness* out);
+// Q8 gain that brings the song to a common loudness without letting its peak clip.
+uint16_t atm_auto_gain_q8(const AtmLoudness* l);
+
+// now is the sample clock next_tick is measured against.
+void atm_engine_sfx_start(
+    AtmEngine* e,
+    const uint8_t* sfx_song,
+    uint8_t n,
+    uint8_t priority,
+    uint32_t now);
+void atm_engine_sfx_tick(AtmEngine* e, uint8_t n);
+void atm_engine_sfx_release(AtmEngine* e, uint8_t n);
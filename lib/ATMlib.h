@@ -3,6 +3,9 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "Events.h"
+#include "Scope.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -22,40 +25,98 @@ typedef uint16_t word;
 #define pgm_read_word(addr) (*((const uint16_t*)(addr)))
 #endif
 
-extern byte trackCount;
-extern byte tickRate;
-extern const word* trackList;
-extern const byte* trackBase;
+#define ATM_LOGICAL_HZ 31250u
 
 extern uint8_t pcm;
 
 extern uint16_t cia;
 extern uint16_t cia_count;
 
+// freq is in note-table units (for the noise channel, the LFSR state). inc is freq converted to
+// a Q16.16 phase step at the output rate; the top 16 bits of phase are the waveform position.
+// Ordered as the renderer reads them.
 typedef struct {
+    uint32_t phase;
+    uint32_t inc;
     uint8_t vol;
     uint16_t freq;
-    uint16_t phase;
 } osc_t;
 
 typedef osc_t Oscillator;
 
-extern osc_t osc[4];
-
 void ATM_playroutine(void);
 
 void atm_system_init(void);
 void atm_system_deinit(void);
 void atm_set_enabled(uint8_t en);
 void atm_get_channel_levels(uint8_t out_levels[4]);
+uint32_t atm_get_position_ms(void);
+// Song channels stopped this song for running past the per-tick command limit, as a bit mask.
+uint8_t atm_get_runaway_channels(void);
+// Blocks the audio interrupt found nothing rendered for and played silence instead, since
+// render-ahead was last switched on (see ATMsynth::setRenderAhead()).
+uint32_t atm_get_underruns(void);
+// Q8 gain that brings song to a common loudness (see ATMsynth::play()), from a scan of its first
+// two minutes. Slow: call once when the song is loaded, not per play. 256 if there is no memory
+// for the scan.
+uint16_t atm_song_auto_gain_q8(const uint8_t* song);
+
+// A recording (ATMsynth::startRecording()) so far, or in the end.
+typedef struct {
+    // Samples in the file, at ATM_LOGICAL_HZ.
+    uint32_t samples;
+    // Blocks of 128 samples left out because the card fell behind.
+    uint32_t dropped;
+    // False once a write failed; the file ends there.
+    bool ok;
+} AtmCaptureReport;
+
+// Progress of the running recording; false if there is none. Call from the thread that starts
+// and stops recordings.
+bool atm_get_recording(AtmCaptureReport* out);
+// The scope tap costs the audio interrupt a little, so it only runs while enabled.
+void atm_set_scope_enabled(uint8_t en);
+// Newest visualizer frame since the last call, or NULL. Call from one thread only.
+const AtmScopeFrame* atm_get_scope_frame(void);
+// Music events are only queued while enabled; off by default, since nobody may be reading them.
+// Enabling drops whatever was queued before.
+void atm_set_events_enabled(uint8_t en);
+// Oldest undelivered music event of the playing song; false when there is none. Events are
+// queued as the ticks run, within one DMA block (about 4 ms) of being heard, so a consumer that
+// polls often stays in sync without looking at pos. With render-ahead they come that many blocks
+// earlier still. Starting a song, seeking and reloading drop the events still queued. Call from
+// one thread only.
+bool atm_poll_event(AtmMusicEvent* out);
+// Events lost to a full queue since the song started or last jumped.
+uint32_t atm_get_events_dropped(void);
 
 class ATMsynth {
 public:
     ATMsynth() {}
 
-    static void play(const byte* song);
+    // Plays song at gain_q8 / 256 times the user volume, normally the song's
+    // atm_song_auto_gain_q8().
+    static void play(const byte* song, uint16_t gain_q8 = 256);
+    // Plays the paged image (lib/ATMpager.h) at path straight from storage, for songs too big to
+    // load. Only a small page cache stays in RAM; a low-priority thread reads ahead of the
+    // ticks. Plays at unity gain, and seek and reload do nothing.
+    static void playPaged(const char* path);
+    // Replaces the playing song with song, a recompile of it after an edit, and keeps playing
+    // from the same spot. relaid flags the tracks whose instructions moved (bit i & 31 of word
+    // i >> 5 for track i, see atm_parse_song_text_cached()); if a channel is inside one of them,
+    // the new song is replayed silently up to the old position instead. Does nothing while
+    // stopped. The old song must stay valid until this command has run.
+    static void reload(const byte* song, const uint32_t relaid[8]);
     static void playPause();
     static void stop();
+    static void seek(uint32_t ms);
+    static void seekRelative(int32_t delta_ms);
+    // Plays a compiled song as a sound effect on channel ch, starting from that channel's ENTRY
+    // track. The song keeps running underneath and gets the channel back when the effect STOPs.
+    // An effect only replaces a running one on the same channel if its priority is not lower.
+    // Skips the command queue: audible from the next rendered block.
+    static void playSfx(const byte* sfx, byte ch, byte priority = 0);
+    static void stopSfx(byte ch);
     static void muteChannel(byte ch);
     static void unMuteChannel(byte ch);
 
@@ -64,6 +125,24 @@ public:
     static void setEnabled(bool en);
     static void setMasterVolume(float v);
     static void setUniformToneMode(bool en);
+    // Practice and preview controls; all take effect at the next tick, without reloading the song.
+    // Tempo scale runs from 0.25 to 4, pitch shift is in semitones. Fast-forward (1, 2 or 4)
+    // multiplies the tempo scale without changing it.
+    static void setTempoScale(float scale);
+    static void setPitchShift(int8_t semitones);
+    static void setFastForward(uint8_t factor);
+    // Renders up to blocks blocks of about 4 ms ahead on the player thread, the audio interrupt
+    // only copying them out, instead of rendering in the interrupt (0, the default). More blocks
+    // ride out longer stalls of the thread, but every change made while playing (mute, volume,
+    // tone mode, tempo) is heard that much later. At most 16.
+    static void setRenderAhead(uint8_t blocks);
+    // Records everything the speaker plays from now on, mutes, volume and tone mode included, to
+    // a WAV file at path: 8-bit mono at ATM_LOGICAL_HZ. A low-priority thread writes it; if the
+    // card falls behind, blocks are left out and counted rather than the sound ever waiting.
+    // Returns false if a recording is already running or the file cannot be created.
+    static bool startRecording(const char* path);
+    // Finishes the file and reports on it (report may be NULL). Does nothing if not recording.
+    static void stopRecording(AtmCaptureReport* report);
 };
 
 extern ATMsynth ATM;
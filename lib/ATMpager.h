@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Paged song: a compiled song too big to hold in RAM, played from storage through a small page
+// cache. The image is the usual one with a header and 32-bit track offsets, so it is not limited
+// to 64 KB. All integers are little-endian.
+//
+//   header  "ATMP", u8 version, u8 track count, u16 reserved, u32 data size
+//   tracks  track count x u32 offset into data
+//   entry   4 x u8 track
+//   data    track bytecode
+//
+// The thread that runs the ticks asks for pages; a reader on a thread of its own fetches them.
+// A tick never waits for storage: the engine checks that every byte a tick will read is cached
+// before running it (atm_engine_tick_ready()) and otherwise leaves it pending until the pages
+// have arrived.
+
+#define ATM_PAGED_MAGIC       "ATMP"
+#define ATM_PAGED_VERSION     1
+#define ATM_PAGED_HEADER_SIZE 12
+#define ATM_PAGE_SIZE         512
+// Four channels, each with the page it plays from and room for one more it is about to need.
+#define ATM_PAGE_SLOTS        8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    AtmPageEmpty,
+    // Waiting for the reader.
+    AtmPageQueued,
+    AtmPageReady,
+} AtmPageState;
+
+// Reads size bytes at offset of the image file into dst; runs on the reader. Returns false on a
+// storage error.
+typedef bool (*AtmPageRead)(void* ctx, uint32_t offset, uint8_t* dst, size_t size);
+
+typedef struct {
+    // From the header. tracks is owned by the pager.
+    uint8_t track_count;
+    uint32_t* tracks;
+    uint8_t entry[4];
+    uint32_t data_offset;
+    uint32_t data_size;
+
+    uint8_t page[ATM_PAGE_SLOTS][ATM_PAGE_SIZE];
+    uint32_t slot_page[ATM_PAGE_SLOTS];
+    // AtmPageState; the reader publishes Ready with release order.
+    uint8_t slot_state[ATM_PAGE_SLOTS];
+    // Use stamps for least-recently-used eviction.
+    uint32_t slot_used[ATM_PAGE_SLOTS];
+    uint32_t clock;
+    uint8_t last;
+
+    // Slots waiting for the reader, in request order: head is advanced by the requesting thread,
+    // tail by the reader.
+    uint8_t queue[ATM_PAGE_SLOTS];
+    uint32_t queue_head;
+    uint32_t queue_tail;
+
+    // Pages read, and a sticky flag for reads the reader failed or that fell outside the data.
+    uint32_t loads;
+    bool error;
+} AtmPager;
+
+// Header size of a paged image with track_count tracks, up to the start of the data.
+static inline uint32_t atm_paged_data_offset(uint8_t track_count) {
+    return ATM_PAGED_HEADER_SIZE + (uint32_t)track_count * 4 + 4;
+}
+
+// Sets the pager up from the first bytes of a paged image, header through entry list
+// (atm_paged_data_offset() bytes; the first ATM_PAGED_HEADER_SIZE tell how many). Returns false,
+// leaving nothing to free, if it is not a supported paged image.
+bool atm_pager_open(AtmPager* p, const uint8_t* head, size_t size);
+void atm_pager_close(AtmPager* p);
+
+// Byte pos of the data into *out if its page is cached. Otherwise asks for the page and returns
+// false. For the thread that runs the ticks.
+bool atm_pager_byte(AtmPager* p, uint32_t pos, uint8_t* out);
+// Asks the reader for the page holding pos unless it is cached or on its way. Pages asked for
+// most recently are evicted last.
+void atm_pager_request(AtmPager* p, uint32_t pos);
+
+// Reader side: true if a page is waiting to be read.
+bool atm_pager_pending(const AtmPager* p);
+// Reader side: reads the oldest requested page. Returns false if there was none.
+bool atm_pager_service(AtmPager* p, AtmPageRead read, void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline char atm_char_upper(char c) {
+    if(c >= 'a' && c <= 'z') return (char)(c - ('a' - 'A'));
+    return c;
+}
+
+// Compiles ATM1 text into the image format consumed by ATMsynth::play(). Fails if the track data
+// exceeds 64 KB. On success *out_buf is malloc'ed and owned by the caller. out_song_name may be
+// NULL.
+bool atm_parse_song_text(
+    const char* text,
+    uint8_t** out_buf,
+    size_t* out_size,
+    char* out_song_name,
+    size_t out_song_name_size);
+
+// Why and where a compile failed. line and column count from 1 and point at the token the
+// compiler stopped at, the end of the text if it ran out.
+typedef struct {
+    const char* message;
+    uint32_t line;
+    uint32_t column;
+} AtmParseError;
+
+// atm_parse_song_text() that on failure fills err.
+bool atm_parse_song_text_diag(
+    const char* text,
+    uint8_t** out_buf,
+    size_t* out_size,
+    char* out_song_name,
+    size_t out_song_name_size,
+    AtmParseError* err);
+
+// atm_parse_song_text() into a paged image (lib/ATMpager.h), for ATMsynth::playPaged(). Any size.
+bool atm_parse_song_text_paged(
+    const char* text,
+    uint8_t** out_buf,
+    size_t* out_size,
+    char* out_song_name,
+    size_t out_song_name_size);
+
+// How a track compiled against the previous compile with the same cache.
+typedef enum {
+    // Same bytes.
+    AtmTrackSame,
+    // Different bytes, but every instruction starts at the same offset, so a channel playing the
+    // track can continue from where it is.
+    AtmTrackEdited,
+    // Instructions moved, or the track is new.
+    AtmTrackRelaid,
+} AtmTrackChange;
+
+typedef struct {
+    uint32_t text_hash;
+    uint32_t layout_hash;
+    uint16_t offset;
+    uint16_t size;
+    uint8_t change;
+} AtmTrackCacheEntry;
+
+// What atm_parse_song_text_cached() keeps from one compile of a file to the next: the compiled
+// track data and, per track, a hash of its text. Zero-initialize before first use.
+typedef struct {
+    AtmTrackCacheEntry* tracks;
+    size_t count;
+    uint8_t* data;
+    size_t data_size;
+    // Tracks compiled from text by the last call; the rest were copied from the cache.
+    size_t recompiled;
+} AtmCompileCache;
+
+// atm_parse_song_text() for a file that is edited while it plays: a track whose text (comments
+// and spacing aside) did not change since the last successful call is copied instead of being
+// compiled again. Tracks are matched by position. Afterwards cache->tracks[i].change tells how
+// track i changed. On failure the cache is left as it was.
+bool atm_parse_song_text_cached(
+    const char* text,
+    AtmCompileCache* cache,
+    uint8_t** out_buf,
+    size_t* out_size,
+    char* out_song_name,
+    size_t out_song_name_size);
+
+void atm_compile_cache_free(AtmCompileCache* cache);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Samples per block: half the DMA buffer, about 4 ms of output at ATM_LOGICAL_HZ.
+#define ATM_BLOCK_SAMPLES 128
+
+// One block of output as the renderer writes it: unsigned 8-bit, centered on 128.
+typedef uint8_t AtmBlock[ATM_BLOCK_SAMPLES];
+
+// Single producer, single consumer queue of output blocks, in storage the caller owns: capacity
+// blocks, a power of two. The producer may have at most depth of them queued. Neither side ever
+// waits: the producer gets no slot while the queue is full, the consumer none while it is
+// empty, which it counts in underruns.
+typedef struct {
+    AtmBlock* blocks;
+    uint32_t capacity;
+    uint32_t depth;
+    uint32_t head;
+    uint32_t tail;
+    // Set by the producer to drop everything queued before head; applied by the consumer.
+    uint32_t discard;
+    uint32_t underruns;
+} AtmBlockRing;
+
+// Only while neither side is using the ring.
+static inline void atm_block_ring_init(
+    AtmBlockRing* r,
+    AtmBlock* blocks,
+    uint32_t capacity,
+    uint32_t depth) {
+    r->blocks = blocks;
+    r->capacity = capacity;
+    r->depth = depth > capacity ? capacity : depth;
+    r->head = 0;
+    r->tail = 0;
+    r->discard = 0;
+    r->underruns = 0;
+}
+
+// Blocks queued, as far as the caller can tell; either side may call it. Blocks discarded but
+// not yet skipped by the consumer do not count. Loaded in this order so head is never behind
+// the other two.
+static inline uint32_t atm_block_ring_count(const AtmBlockRing* r) {
+    const uint32_t discard = __atomic_load_n(&r->discard, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    if((int32_t)(discard - tail) > 0) tail = discard;
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+}
+
+// Producer side. Changing depth is for the producer too; a smaller one takes effect as the
+// consumer drains the queue.
+static inline void atm_block_ring_set_depth(AtmBlockRing* r, uint32_t depth) {
+    r->depth = depth > r->capacity ? r->capacity : depth;
+}
+
+// The slot to render the next block into, or NULL while depth blocks are queued.
+static inline AtmBlock* atm_block_ring_back(AtmBlockRing* r) {
+    if(r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= r->depth) return NULL;
+    return &r->blocks[r->head & (r->capacity - 1)];
+}
+
+static inline void atm_block_ring_push(AtmBlockRing* r) {
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+// Drops the blocks queued so far, e.g. when playback jumps. The consumer skips them the next
+// time it looks; until then they still count against depth.
+static inline void atm_block_ring_discard(AtmBlockRing* r) {
+    __atomic_store_n(&r->discard, r->head, __ATOMIC_RELEASE);
+}
+
+// Empties the ring at once. Only while the consumer is stopped.
+static inline void atm_block_ring_clear(AtmBlockRing* r) {
+    r->tail = r->head;
+    r->discard = r->head;
+}
+
+// Consumer side. The oldest queued block, or NULL (counted as an underrun) if there is none. It
+// stays the producer's to leave alone until atm_block_ring_pop().
+static inline const AtmBlock* atm_block_ring_front(AtmBlockRing* r) {
+    uint32_t tail = r->tail;
+    const uint32_t discard = __atomic_load_n(&r->discard, __ATOMIC_ACQUIRE);
+    if((int32_t)(discard - tail) > 0) {
+        tail = discard;
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+    if(__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail) {
+        __atomic_store_n(&r->underruns, r->underruns + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    return &r->blocks[tail & (r->capacity - 1)];
+}
+
+static inline void atm_block_ring_pop(AtmBlockRing* r) {
+    __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+}
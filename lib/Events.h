@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+// Ring capacity in events; a power of two.
+#define ATM_EVENT_RING_SIZE 64
+
+typedef enum : uint8_t {
+    // value: note 1..63 after transposition and pitch shift, vol: channel volume.
+    AtmMusicNoteOn,
+    // A rest (note 0) or the channel STOPped; value and vol are 0.
+    AtmMusicNoteOff,
+    // value: new tick rate in ticks per second.
+    AtmMusicTempo,
+    // The song jumped back to its repeat point.
+    AtmMusicLoop,
+    // The song ended without repeating.
+    AtmMusicEnd,
+} AtmMusicEventType;
+
+// pos is the song position of the first sample the event is heard in, in output samples from the
+// start of the song at the written tempo. ch is 0xFF for song-wide events.
+typedef struct {
+    uint32_t pos;
+    AtmMusicEventType type;
+    uint8_t ch;
+    uint8_t value;
+    uint8_t vol;
+} AtmMusicEvent;
+
+// Single producer (whoever runs the ticks), single consumer. The producer never waits: when the
+// ring is full the new event is dropped and counted. All zero is an empty ring.
+typedef struct {
+    AtmMusicEvent ev[ATM_EVENT_RING_SIZE];
+    uint32_t head;
+    uint32_t tail;
+    // Set by the producer to drop everything queued before head; applied by the consumer.
+    uint32_t discard;
+    uint32_t dropped;
+} AtmEventRing;
+
+// Producer side, e.g. when a song starts or playback jumps: drops the queued events, which are
+// about the old position, and the count of dropped ones. The consumer skips them the next time
+// it looks; until then they still take room.
+static inline void atm_event_ring_reset(AtmEventRing* r) {
+    __atomic_store_n(&r->discard, r->head, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->dropped, 0, __ATOMIC_RELAXED);
+}
+
+static inline void atm_event_push(AtmEventRing* r, const AtmMusicEvent* ev) {
+    const uint32_t head = r->head;
+    if(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= ATM_EVENT_RING_SIZE) {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    r->ev[head & (ATM_EVENT_RING_SIZE - 1)] = *ev;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static inline bool atm_event_pop(AtmEventRing* r, AtmMusicEvent* out) {
+    uint32_t tail = r->tail;
+    const uint32_t discard = __atomic_load_n(&r->discard, __ATOMIC_ACQUIRE);
+    if((int32_t)(discard - tail) > 0) {
+        tail = discard;
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+    if(__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail) return false;
+    *out = r->ev[tail & (ATM_EVENT_RING_SIZE - 1)];
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Samples per scope frame and the output samples each of them stands for.
+#define ATM_SCOPE_SAMPLES   128
+#define ATM_SCOPE_DECIMATE  8
+#define ATM_SCOPE_FRESH     0x80
+
+// One screen of the visualizer: every ATM_SCOPE_DECIMATE-th sample of the mix, centered on 128, and the note each channel
+// was sounding when the frame completed (0 for silence).
+typedef struct {
+    uint8_t samples[ATM_SCOPE_SAMPLES];
+    uint8_t notes[4];
+    uint32_t seq;
+} AtmScopeFrame;
+
+// Triple buffer between one writer (the audio interrupt) and one reader (the UI). The writer owns
+// frames[back], the reader frames[front], and middle holds the index of the latest complete
+// frame, flagged ATM_SCOPE_FRESH until the reader takes it. Either side hands a frame over with a
+// single exchange of middle, so neither ever waits for the other.
+typedef struct {
+    AtmScopeFrame frames[3];
+    uint8_t back;
+    uint8_t front;
+    uint8_t middle;
+    uint8_t fill;
+    uint32_t seq;
+} AtmScopeTap;
+
+static inline void atm_scope_init(AtmScopeTap* t) {
+    for(uint8_t i = 0; i < 3; i++) {
+        for(size_t s = 0; s < ATM_SCOPE_SAMPLES; s++) {
+            t->frames[i].samples[s] = 128;
+        }
+        for(uint8_t c = 0; c < 4; c++) {
+            t->frames[i].notes[c] = 0;
+        }
+        t->frames[i].seq = 0;
+    }
+    t->back = 0;
+    t->middle = 1;
+    t->front = 2;
+    t->fill = 0;
+    t->seq = 0;
+}
+
+// Writer side. Folds a block of output into the back frame; once the frame is full, returns it
+// so the caller can add the notes before atm_scope_publish(). Returns NULL otherwise. count must
+// be a multiple of ATM_SCOPE_DECIMATE; output past a full frame is dropped. Point-sampled: the
+// interrupt cannot afford an average, and at this width the screen shows no difference.
+static inline AtmScopeFrame* atm_scope_write(AtmScopeTap* t, const uint8_t* pcm, size_t count) {
+    AtmScopeFrame* f = &t->frames[t->back];
+    const uint8_t fill = t->fill;
+    size_t n = count / ATM_SCOPE_DECIMATE;
+    if(n > (size_t)(ATM_SCOPE_SAMPLES - fill)) n = ATM_SCOPE_SAMPLES - fill;
+    // Through a local pointer, so the byte stores do not make the compiler reload t.
+    uint8_t* dst = f->samples + fill;
+    for(size_t i = 0; i < n; i++) {
+        dst[i] = pcm[i * ATM_SCOPE_DECIMATE];
+    }
+    t->fill = (uint8_t)(fill + n);
+    return t->fill == ATM_SCOPE_SAMPLES ? f : NULL;
+}
+
+static inline void atm_scope_publish(AtmScopeTap* t) {
+    t->frames[t->back].seq = ++t->seq;
+    const uint8_t old =
+        __atomic_exchange_n(&t->middle, (uint8_t)(t->back | ATM_SCOPE_FRESH), __ATOMIC_ACQ_REL);
+    t->back = (uint8_t)(old & 3);
+    t->fill = 0;
+}
+
+// Reader side. Returns the newest complete frame if one arrived since the last call, else NULL.
+// The frame stays valid until the next call.
+static inline const AtmScopeFrame* atm_scope_read(AtmScopeTap* t) {
+    if(!(__atomic_load_n(&t->middle, __ATOMIC_ACQUIRE) & ATM_SCOPE_FRESH)) return NULL;
+    const uint8_t old = __atomic_exchange_n(&t->middle, t->front, __ATOMIC_ACQ_REL);
+    t->front = (uint8_t)(old & 3);
+    return &t->frames[t->front];
+}
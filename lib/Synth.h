@@ -0,0 +1,296 @@
+#pragma once
+
+#include "ATMlib.h"
+#include "Mix.h"
+
+#include <stdint.h>
+
+// Per-sample synthesis, configured at compile time. A configuration names the output sample type
+// and the waveform of each oscillator, up to eight. An oscillator set to AtmWaveOff costs nothing
+// and stays silent; the voice count is simply the number of the others. Everything is resolved
+// by the compiler, so an instance is as fast as code written for it by hand.
+enum AtmWave : uint8_t {
+    AtmWaveOff,
+    // 25% duty cycle.
+    AtmWavePulse,
+    AtmWaveSquare,
+    AtmWaveTriangle,
+    // 15-bit LFSR kept in the oscillator's freq.
+    AtmWaveNoise,
+};
+
+static constexpr uint8_t atm_synth_on(const AtmWave* wave, uint8_t slots) {
+    uint8_t on = 0;
+    for(uint8_t n = 0; n < slots; n++) {
+        if(wave[n] != AtmWaveOff) on |= (uint8_t)(1 << n);
+    }
+    return on;
+}
+
+// Bits of attenuation voices summed at full volume need: ceil(log2(voices)).
+static constexpr uint8_t atm_synth_bits(uint8_t voices) {
+    return voices > 1 ? (uint8_t)(1 + atm_synth_bits((uint8_t)((voices + 1) / 2))) : 0;
+}
+
+// Slot n is osc[n], one per oscillator of the engine (ATM_VOICES): the four song channels, and in
+// the extended build their sound effects. Sample is uint8_t (PWM duty, centered on 128) or
+// int16_t (signed PCM). Headroom adds bits of attenuation on top of what the voice count needs.
+template <typename SampleT, uint8_t Headroom, AtmWave... W>
+struct AtmSynth {
+    typedef SampleT Sample;
+    static constexpr uint8_t slots = sizeof...(W);
+    typedef AtmMix<slots> Mix;
+    static constexpr AtmWave wave[slots] = {W...};
+    static constexpr uint8_t voices = ((W != AtmWaveOff) + ...);
+    // Bit n set if oscillator n is synthesized at all.
+    static constexpr uint8_t on = atm_synth_on(wave, slots);
+    // Shift applied to the mix times the Q8 gain: 9 for four voices, one bit more or less per
+    // doubling or halving.
+    static constexpr uint8_t shift = 7 + atm_synth_bits(voices) + Headroom;
+    static_assert(slots <= 8, "a synth has at most eight oscillators");
+    static_assert(voices > 0, "a synth needs at least one voice");
+};
+
+// What ATM has always played: pulse, square, triangle and noise, and the uniform-tone variant
+// with four squares, which needs a bit more headroom since similar waveforms fold into each
+// other harder.
+template <typename Sample>
+using AtmSynthNormal = AtmSynth<Sample, 0, AtmWavePulse, AtmWaveSquare, AtmWaveTriangle, AtmWaveNoise>;
+template <typename Sample>
+using AtmSynthUniform =
+    AtmSynth<Sample, 1, AtmWaveSquare, AtmWaveSquare, AtmWaveSquare, AtmWaveSquare>;
+// Two voices for low-CPU builds: the lead on channel 0 and the bass on channel 2, with the
+// waveforms the songs were written for. Channels 1 and 3 still run, only unheard.
+template <typename Sample>
+using AtmSynthLite = AtmSynth<Sample, 0, AtmWavePulse, AtmWaveOff, AtmWaveTriangle, AtmWaveOff>;
+template <typename Sample>
+using AtmSynthLiteUniform = AtmSynth<Sample, 1, AtmWaveSquare, AtmWaveOff, AtmWaveSquare, AtmWaveOff>;
+// Eight voices: the four song channels and, on oscillators of their own, the sound effects
+// played on them, with the same waveforms as their channel.
+template <typename Sample>
+using AtmSynthExtended = AtmSynth<
+    Sample,
+    0,
+    AtmWavePulse,
+    AtmWaveSquare,
+    AtmWaveTriangle,
+    AtmWaveNoise,
+    AtmWavePulse,
+    AtmWaveSquare,
+    AtmWaveTriangle,
+    AtmWaveNoise>;
+template <typename Sample>
+using AtmSynthExtendedUniform = AtmSynth<
+    Sample,
+    1,
+    AtmWaveSquare,
+    AtmWaveSquare,
+    AtmWaveSquare,
+    AtmWaveSquare,
+    AtmWaveSquare,
+    AtmWaveSquare,
+    AtmWaveSquare,
+    AtmWaveSquare>;
+
+// Advances oscillator n by one sample and adds its output to v. peak[n] collects the largest
+// absolute triangle sample for the meters; the other waveforms sit at plus or minus their
+// volume, so their peak needs no per-sample work.
+template <class Mix, AtmWave W, uint8_t n>
+static inline typename Mix::Voices
+    atm_synth_voice(osc_t* osc, typename Mix::Voices v, uint8_t* peak) {
+    osc_t* o = &osc[n];
+    int8_t c = (int8_t)o->vol;
+    if constexpr(W == AtmWaveOff) {
+        return v;
+    } else if constexpr(W == AtmWavePulse) {
+        o->phase += o->inc;
+        if(o->phase >= 0xC0000000u) c = (int8_t)(-c);
+    } else if constexpr(W == AtmWaveSquare) {
+        o->phase += o->inc;
+        if(o->phase & 0x80000000u) c = (int8_t)(-c);
+    } else if constexpr(W == AtmWaveTriangle) {
+        o->phase += o->inc;
+        int8_t t = (int8_t)(o->phase >> 24);
+        if(t < 0) t = (int8_t)(~t);
+        t = (int8_t)(t << 1);
+        t = (int8_t)(t - 128);
+        c = (int8_t)((((int16_t)t * c) << 1) >> 8);
+        const uint8_t a = (uint8_t)(c < 0 ? -c : c);
+        if(a > peak[n]) peak[n] = a;
+    } else if constexpr(W == AtmWaveNoise) {
+        uint16_t freq = o->freq;
+        freq <<= 1;
+        if(freq & 0x8000) freq ^= 1;
+        if(freq & 0x4000) freq ^= 1;
+        o->freq = freq;
+        if(freq & 0x8000) c = (int8_t)(-c);
+    }
+    return Mix::add(v, n, c);
+}
+
+// atm_synth_voice() for oscillators n and up that are in mask, unrolled.
+template <class Synth, uint8_t mask, uint8_t n = 0>
+static inline typename Synth::Mix::Voices
+    atm_synth_voices(osc_t* osc, typename Synth::Mix::Voices v, uint8_t* peak) {
+    if constexpr(n == Synth::slots) {
+        return v;
+    } else {
+        constexpr AtmWave w = (mask & (1 << n)) ? Synth::wave[n] : AtmWaveOff;
+        v = atm_synth_voice<typename Synth::Mix, w, n>(osc, v, peak);
+        return atm_synth_voices<Synth, mask, n + 1>(osc, v, peak);
+    }
+}
+
+// One output sample of the oscillators in mask, after gain and clamp. The others contribute
+// nothing and are not advanced.
+template <class Synth, uint8_t mask>
+static inline typename Synth::Sample atm_synth_sample(osc_t* osc, uint16_t gain_q8, uint8_t* peak) {
+    const int32_t mix = Synth::Mix::sum(atm_synth_voices<Synth, mask>(osc, 0, peak));
+    if constexpr(sizeof(typename Synth::Sample) == 1) {
+        return atm_mix_out_u8(mix, gain_q8, Synth::shift);
+    } else {
+        return atm_mix_out_s16(mix, gain_q8, Synth::shift);
+    }
+}
+
+template <class Synth, uint8_t mask>
+static void atm_synth_block(
+    osc_t* osc,
+    typename Synth::Sample* out,
+    size_t count,
+    uint16_t gain_q8,
+    uint8_t* peak) {
+    for(size_t i = 0; i < count; i++) {
+        out[i] = atm_synth_sample<Synth, mask>(osc, gain_q8, peak);
+    }
+}
+
+// Voices that would only add zeros: the oscillators the configuration synthesizes that are at
+// volume 0 (stopped, muted, resting or simply quiet).
+template <class Synth>
+static inline uint8_t atm_synth_active(const osc_t* osc) {
+    uint8_t mask = 0;
+    for(uint8_t n = 0; n < Synth::slots; n++) {
+        if(osc[n].vol) mask |= (uint8_t)(1 << n);
+    }
+    return mask & Synth::on;
+}
+
+// atm_synth_block() for each set of active voices among the first four, fully specialized; mask
+// 0 is a plain fill. Past four oscillators (sound effects in the extended build, mostly silent)
+// any of them active runs every voice. 16-bit output is for the host, which gets the fill but
+// not the other kernels; it synthesizes every voice instead. Returns the voices actually
+// synthesized.
+template <class Synth>
+static inline uint8_t atm_synth_render(
+    uint8_t mask,
+    osc_t* osc,
+    typename Synth::Sample* out,
+    size_t count,
+    uint16_t gain_q8,
+    uint8_t* peak) {
+    if constexpr(sizeof(typename Synth::Sample) != 1) {
+        if(mask) {
+            mask = Synth::on;
+            atm_synth_block<Synth, Synth::on>(osc, out, count, gain_q8, peak);
+        } else {
+            atm_synth_block<Synth, 0>(osc, out, count, gain_q8, peak);
+        }
+    } else {
+        typedef void (*Block)(osc_t*, typename Synth::Sample*, size_t, uint16_t, uint8_t*);
+        static constexpr Block blocks[16] = {
+            atm_synth_block<Synth, 0>,
+            atm_synth_block<Synth, 1>,
+            atm_synth_block<Synth, 2>,
+            atm_synth_block<Synth, 3>,
+            atm_synth_block<Synth, 4>,
+            atm_synth_block<Synth, 5>,
+            atm_synth_block<Synth, 6>,
+            atm_synth_block<Synth, 7>,
+            atm_synth_block<Synth, 8>,
+            atm_synth_block<Synth, 9>,
+            atm_synth_block<Synth, 10>,
+            atm_synth_block<Synth, 11>,
+            atm_synth_block<Synth, 12>,
+            atm_synth_block<Synth, 13>,
+            atm_synth_block<Synth, 14>,
+            atm_synth_block<Synth, 15>,
+        };
+        if(mask & 0xF0) {
+            mask = Synth::on;
+            atm_synth_block<Synth, Synth::on>(osc, out, count, gain_q8, peak);
+        } else {
+            blocks[mask](osc, out, count, gain_q8, peak);
+        }
+    }
+    return mask;
+}
+
+// Transition matrices of the noise LFSR, which is linear over GF(2): col[k][i] is where 2^k
+// steps take state bit i.
+struct AtmNoiseJump {
+    uint16_t col[16][16];
+};
+
+static constexpr uint16_t atm_noise_apply(const uint16_t col[16], uint16_t s) {
+    uint16_t r = 0;
+    for(uint8_t i = 0; i < 16; i++) {
+        if(s & (1u << i)) r ^= col[i];
+    }
+    return r;
+}
+
+static constexpr AtmNoiseJump atm_noise_jump_table() {
+    AtmNoiseJump t = {};
+    for(uint8_t i = 0; i < 16; i++) {
+        const uint16_t s = (uint16_t)(1u << i);
+        t.col[0][i] = (uint16_t)((s << 1) ^ (((s >> 14) ^ (s >> 13)) & 1));
+    }
+    for(uint8_t k = 1; k < 16; k++) {
+        for(uint8_t i = 0; i < 16; i++) {
+            t.col[k][i] = atm_noise_apply(t.col[k - 1], t.col[k - 1][i]);
+        }
+    }
+    return t;
+}
+
+static constexpr AtmNoiseJump atm_noise_jump = atm_noise_jump_table();
+
+// The noise LFSR state after count steps.
+static inline uint16_t atm_noise_skip(uint16_t s, size_t count) {
+    for(; count >> 16; count -= 1u << 16) {
+        s = atm_noise_apply(atm_noise_jump.col[15], atm_noise_apply(atm_noise_jump.col[15], s));
+    }
+    for(uint8_t k = 0; count; k++, count >>= 1) {
+        if(count & 1) s = atm_noise_apply(atm_noise_jump.col[k], s);
+    }
+    return s;
+}
+
+// Brings the oscillators in mask to where count samples of synthesis would have left them,
+// so a voice that comes back picks up its waveform where it would have been.
+template <class Synth>
+static inline void atm_synth_skip(osc_t* osc, uint8_t mask, size_t count) {
+    for(uint8_t n = 0; n < Synth::slots; n++) {
+        if(!(mask & (1 << n))) continue;
+        if(Synth::wave[n] == AtmWaveNoise) {
+            osc[n].freq = atm_noise_skip(osc[n].freq, count);
+        } else {
+            osc[n].phase += osc[n].inc * (uint32_t)count;
+        }
+    }
+}
+
+// Meter peaks of the voices after a block: the triangle peaks collected by atm_synth_sample(),
+// the volume for the other waveforms, nothing for oscillators that are off.
+template <class Synth>
+static inline void atm_synth_peaks(const osc_t* osc, uint8_t* peak) {
+    for(uint8_t n = 0; n < Synth::slots; n++) {
+        if(Synth::wave[n] == AtmWaveOff) {
+            peak[n] = 0;
+        } else if(Synth::wave[n] != AtmWaveTriangle) {
+            const int8_t v = (int8_t)osc[n].vol;
+            peak[n] = (uint8_t)(v < 0 ? -v : v);
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Player view refresh, free of the GUI so the host can drive it (tools/atm_ui.cpp). The refresh
+// is fast while the meters move, slower once nothing on screen has changed for
+// ATM_UI_IDLE_TICKS refreshes, slowest when nothing is playing.
+#define ATM_UI_FAST_MS    33
+#define ATM_UI_IDLE_MS    100
+#define ATM_UI_STOPPED_MS 500
+#define ATM_UI_IDLE_TICKS 15
+
+#define ATM_UI_METER_MAX   63
+#define ATM_UI_METER_WIDTH 120
+
+typedef struct {
+    // Smoothed meter levels and the dither that spreads their fractions over refreshes.
+    uint16_t level_q8[4];
+    uint8_t dither_phase;
+    // What the view currently shows; a refresh that would not change it is skipped.
+    uint8_t widths[4];
+    uint32_t elapsed_s;
+    uint8_t progress_fill;
+    uint8_t idle_ticks;
+} AtmUiState;
+
+static inline void atm_ui_reset_meters(AtmUiState* ui) {
+    memset(ui->level_q8, 0, sizeof(ui->level_q8));
+    ui->dither_phase = 0;
+}
+
+// Bar widths for the channel levels of this refresh. Dithering only runs while the song does
+// (live); a paused or stopped meter holds still.
+static inline void atm_ui_meter_widths(AtmUiState* ui, const uint8_t levels[4], bool live, uint8_t widths[4]) {
+    if(live) ui->dither_phase++;
+
+    for(uint8_t i = 0; i < 4; i++) {
+        const uint16_t target_q8 = (uint16_t)levels[i] << 8;
+        uint16_t cur_q8 = ui->level_q8[i];
+
+        if(target_q8 >= cur_q8) {
+            cur_q8 = target_q8;
+        } else {
+            const uint16_t delta = (uint16_t)(cur_q8 - target_q8);
+            const uint16_t decay = (uint16_t)((delta >> 3) + 1);
+            cur_q8 = (cur_q8 > decay) ? (uint16_t)(cur_q8 - decay) : 0;
+        }
+
+        ui->level_q8[i] = cur_q8;
+
+        const uint32_t w_q8 = ((uint32_t)cur_q8 * ATM_UI_METER_WIDTH) / ATM_UI_METER_MAX;
+        uint8_t w = (uint8_t)(w_q8 >> 8);
+        const uint8_t frac = (uint8_t)(w_q8 & 0xFF);
+
+        if(live && w < ATM_UI_METER_WIDTH && frac > ui->dither_phase) w++;
+        widths[i] = w;
+    }
+}
+
+// Whether the view would change, recording what it will show if so.
+static inline bool atm_ui_update(AtmUiState* ui, const uint8_t widths[4], uint32_t elapsed_s, uint8_t fill) {
+    if(!memcmp(widths, ui->widths, sizeof(ui->widths)) && elapsed_s == ui->elapsed_s &&
+       fill == ui->progress_fill)
+        return false;
+    memcpy(ui->widths, widths, sizeof(ui->widths));
+    ui->elapsed_s = elapsed_s;
+    ui->progress_fill = fill;
+    return true;
+}
+
+// Refresh period after a refresh that did or did not change anything.
+static inline uint32_t atm_ui_next_period(AtmUiState* ui, bool changed, bool live) {
+    if(changed) {
+        ui->idle_ticks = 0;
+    } else if(ui->idle_ticks < ATM_UI_IDLE_TICKS) {
+        ui->idle_ticks++;
+    }
+
+    if(ui->idle_ticks < ATM_UI_IDLE_TICKS) return ATM_UI_FAST_MS;
+    return live ? ATM_UI_IDLE_MS : ATM_UI_STOPPED_MS;
+}
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 
+// Peak meter envelope: instant attack, release of 1/16 of the level plus one Q8 step per sample.
 typedef struct {
     uint16_t env_q8;
 } VolMeter;
@@ -10,15 +11,29 @@ static inline void vol_meter_reset(VolMeter* m) {
     m->env_q8 = 0;
 }
 
-static inline uint8_t vol_meter_step(VolMeter* m, uint8_t sample_abs) {
-    const uint16_t target = (uint16_t)sample_abs << 8;
-
-    if(target >= m->env_q8) {
-        m->env_q8 = target;
-    } else {
-        uint16_t decay = (uint16_t)((m->env_q8 >> 4) + 1);
-        m->env_q8 = (m->env_q8 > decay) ? (uint16_t)(m->env_q8 - decay) : 0;
+// (15/16)^n in Q16: the share of the envelope left after n samples of release.
+static inline uint32_t vol_meter_decay_q16(uint32_t n) {
+    uint32_t result = 1u << 16;
+    uint32_t base = 15u << 12;
+    while(n && result) {
+        if(n & 1) result = (result * base + (1u << 15)) >> 16;
+        base = (base * base + (1u << 15)) >> 16;
+        n >>= 1;
     }
+    return result;
+}
+
+// Advances the meter over a whole block instead of sample by sample. peak_abs is the largest
+// absolute sample in the block, taken as if it came at the end; decay_q16 is
+// vol_meter_decay_q16() of the block length. The release x -> x - x/16 - 1 has its fixed point
+// at -16, so n samples of it take x to (x + 16) * (15/16)^n - 16.
+static inline uint8_t vol_meter_block(VolMeter* m, uint8_t peak_abs, uint32_t decay_q16) {
+    int32_t env = (int32_t)((((uint32_t)m->env_q8 + 16) * decay_q16) >> 16) - 16;
+    if(env < 0) env = 0;
+
+    const int32_t target = (int32_t)peak_abs << 8;
+    if(target >= env) env = target;
+    m->env_q8 = (uint16_t)env;
 
     uint16_t lvl = (uint16_t)(m->env_q8 >> 8);
     if(lvl > 63) lvl = 63;
@@ -2,6 +2,7 @@
 
 #include <gui/gui.h>
 #include <gui/modules/file_browser.h>
+#include <gui/modules/submenu.h>
 #include <gui/view.h>
 #include <gui/view_dispatcher.h>
 #include <input/input.h>
@@ -12,49 +13,41 @@
 #include <string.h>
 
 #include "lib/ATMlib.h"
+#include "lib/ATManalyze.h"
+#include "lib/ATMbank.h"
+#include "lib/ATMpager.h"
+#include "lib/ATMparse.h"
+#include "lib/Ui.h"
 #include "atm_icons.h"
 
-#define ATM_TXT_MAGIC        "ATM1"
-#define ATM_TXT_CMD_NAME     "NAME"
-#define ATM_TXT_CMD_ENTRY    "ENTRY"
-#define ATM_TXT_CMD_TRACK    "TRACK"
-#define ATM_TXT_CMD_ENDTRACK "ENDTRACK"
-#define ATM_TXT_CMD_END      "END"
-#define ATM_TXT_COMMENT      '#'
-#define ATM_TXT_SEPARATOR    ','
-
-#define ATM_TXT_OP_DB                "DB"
-#define ATM_TXT_OP_NOTE              "NOTE"
-#define ATM_TXT_OP_DELAY             "DELAY"
-#define ATM_TXT_OP_STOP              "STOP"
-#define ATM_TXT_OP_RETURN            "RETURN"
-#define ATM_TXT_OP_GOTO              "GOTO"
-#define ATM_TXT_OP_REPEAT            "REPEAT"
-#define ATM_TXT_OP_SET_TEMPO         "SET_TEMPO"
-#define ATM_TXT_OP_ADD_TEMPO         "ADD_TEMPO"
-#define ATM_TXT_OP_SET_VOLUME        "SET_VOLUME"
-#define ATM_TXT_OP_VOLUME_SLIDE_ON   "VOLUME_SLIDE_ON"
-#define ATM_TXT_OP_VOLUME_SLIDE_OFF  "VOLUME_SLIDE_OFF"
-#define ATM_TXT_OP_SET_NOTE_CUT      "SET_NOTE_CUT"
-#define ATM_TXT_OP_NOTE_CUT_OFF      "NOTE_CUT_OFF"
-#define ATM_TXT_OP_SET_TRANSPOSITION "SET_TRANSPOSITION"
-#define ATM_TXT_OP_TRANSPOSITION_OFF "TRANSPOSITION_OFF"
-#define ATM_TXT_OP_GOTO_ADVANCED     "GOTO_ADVANCED"
-#define ATM_TXT_OP_SET_VIBRATO       "SET_VIBRATO"
-
 #define ATM_SONG_MAX_TEXT_SIZE (32 * 1024)
 #define ATM_VOLUME_UNIT_STEP 0.1f
 #define ATM_VOLUME_UNIT_MAX  8
+#define ATM_SEEK_STEP_MS     5000
+#define ATM_TEMPO_UNIT_STEP  0.1f
+#define ATM_TEMPO_UNIT_MIN   -5
+#define ATM_TEMPO_UNIT_MAX   10
+#define ATM_PROGRESS_INNER_W 50
+
+// How often a playing text song is checked for edits on the SD card.
+#define ATM_WATCH_PERIOD_MS 1000
+
+// Scope page: the waveform on top, a piano roll with one column per scope frame below it.
+#define ATM_ROLL_COLUMNS 128
+#define ATM_SCOPE_MID_Y  15
+#define ATM_ROLL_BOTTOM  63
 
 typedef enum {
     AtmViewBrowser = 0,
     AtmViewPlayer,
+    AtmViewBank,
 } AtmView;
 
 typedef enum {
     AtmEventFileSelected = 1,
     AtmEventOpenBrowser,
     AtmEventUiTick,
+    AtmEventBankEntrySelected,
 } AtmEvent;
 
 typedef struct {
@@ -62,33 +55,28 @@ typedef struct {
     char state_line[24];
     uint8_t levels[4];
     int8_t volume_units;
+    int8_t tempo_units;
+    uint32_t elapsed_ms;
+    uint32_t total_ms;
+    uint32_t loop_start_ms;
+    bool has_duration;
+    bool looped;
     bool playing;
     bool paused;
     bool loaded;
+    bool scope_page;
+    uint8_t scope[ATM_SCOPE_SAMPLES];
+    uint8_t roll[ATM_ROLL_COLUMNS][4];
+    uint8_t roll_head;
 } AtmPlayerModel;
 
-typedef struct {
-    const char* cur;
-} AtmTokenizer;
-
-typedef struct {
-    uint8_t* bytes;
-    size_t size;
-    size_t capacity;
-} ByteBuffer;
-
-typedef struct {
-    uint16_t* items;
-    size_t size;
-    size_t capacity;
-} OffsetBuffer;
-
 typedef struct {
     Gui* gui;
     Storage* storage;
     ViewDispatcher* dispatcher;
     FileBrowser* file_browser;
     View* player_view;
+    Submenu* bank_menu;
     FuriString* selected_path;
 
     bool browser_started;
@@ -96,13 +84,36 @@ typedef struct {
 
     uint8_t* song_buf;
     size_t song_size;
+    // The image replaced by the last reload; the player may still be reading it until the reload
+    // command has run, so it is freed one reload later.
+    uint8_t* song_prev_buf;
+    // The song is a paged image the player streams from selected_path; song_buf is unused.
+    bool paged;
+    // Text songs are recompiled on the fly when their file changes: the cache keeps the previous
+    // compile, watch_mtime and watch_size what the file looked like when it was made.
+    AtmCompileCache compile_cache;
+    bool watch_enabled;
+    uint32_t watch_mtime;
+    uint64_t watch_size;
+    uint32_t watch_checked_ms;
+    AtmSongInfo song_info;
+    bool has_song_info;
+    // Auto gain of song_buf, scanned once when it is loaded.
+    uint16_t song_gain_q8;
+    AtmBankEntry* bank_entries;
+    uint16_t bank_count;
+    uint16_t bank_index;
     bool playing;
     bool paused;
     char song_name[48];
     FuriTimer* ui_timer;
-    uint16_t ui_level_q8[4];
-    uint8_t ui_dither_phase;
+    uint32_t ui_period_ms;
+    AtmUiState ui;
+    // Channels the player reported stopped for running away, once shown.
+    uint8_t ui_runaway;
+    bool scope_page;
     int8_t volume_units;
+    int8_t tempo_units;
 } FlipperAtmApp;
 
 static void atm_extract_file_name(const char* path, char* out, size_t out_size);
@@ -114,15 +125,6 @@ static bool atm_file_browser_item_callback(
     uint8_t** icon,
     FuriString* item_name);
 
-static bool atm_is_space(char c) {
-    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
-}
-
-static char atm_char_upper(char c) {
-    if(c >= 'a' && c <= 'z') return (char)(c - ('a' - 'A'));
-    return c;
-}
-
 static bool atm_str_contains_ci(const char* haystack, const char* needle) {
     if(!haystack || !needle || !needle[0]) return false;
     for(const char* h = haystack; *h; h++) {
@@ -137,13 +139,34 @@ static bool atm_str_contains_ci(const char* haystack, const char* needle) {
     return false;
 }
 
-static bool atm_token_equals(const char* token, const char* keyword) {
-    while(*token && *keyword) {
-        if(atm_char_upper(*token) != atm_char_upper(*keyword)) return false;
-        token++;
-        keyword++;
+static uint32_t atm_song_elapsed_ms(const FlipperAtmApp* app) {
+    if(!app->playing || !app->has_song_info) return 0;
+
+    const AtmSongInfo* info = &app->song_info;
+    uint32_t pos = atm_get_position_ms();
+    if(info->looped && pos >= info->loop_end_ms && info->loop_end_ms > info->loop_start_ms) {
+        pos = info->loop_start_ms +
+              (pos - info->loop_start_ms) % (info->loop_end_ms - info->loop_start_ms);
     }
-    return (*token == '\0') && (*keyword == '\0');
+    if(pos > info->duration_ms) pos = info->duration_ms;
+    return pos;
+}
+
+static uint8_t atm_progress_fill(uint32_t elapsed_ms, uint32_t total_ms) {
+    if(!total_ms) return 0;
+    if(elapsed_ms > total_ms) elapsed_ms = total_ms;
+    return (uint8_t)(((uint64_t)elapsed_ms * ATM_PROGRESS_INNER_W) / total_ms);
+}
+
+static void atm_ui_set_period(FlipperAtmApp* app, uint32_t period_ms) {
+    if(!app->ui_timer || app->ui_period_ms == period_ms) return;
+    app->ui_period_ms = period_ms;
+    furi_timer_start(app->ui_timer, furi_ms_to_ticks(period_ms));
+}
+
+// Picks the refresh rate for the next UI tick from whether this one changed anything.
+static void atm_ui_pace(FlipperAtmApp* app, bool changed) {
+    atm_ui_set_period(app, atm_ui_next_period(&app->ui, changed, app->playing && !app->paused));
 }
 
 static void atm_set_player_status(
@@ -160,63 +183,79 @@ static void atm_set_player_status(
                 model->song_name, sizeof(model->song_name), "%s", song_name ? song_name : "-");
             snprintf(model->state_line, sizeof(model->state_line), "%s", state ? state : "-");
             model->volume_units = app->volume_units;
+            model->tempo_units = app->tempo_units;
+            model->elapsed_ms = atm_song_elapsed_ms(app);
+            model->total_ms = app->song_info.duration_ms;
+            model->loop_start_ms = app->song_info.loop_start_ms;
+            model->has_duration = loaded && app->has_song_info;
+            model->looped = app->song_info.looped;
             model->playing = app->playing;
             model->paused = app->paused;
             model->loaded = loaded;
         },
         true);
+    atm_ui_pace(app, true);
+}
+
+static void atm_scope_to_model(AtmPlayerModel* model, const AtmScopeFrame* frame) {
+    memcpy(model->scope, frame->samples, sizeof(model->scope));
+    memcpy(model->roll[model->roll_head], frame->notes, sizeof(model->roll[0]));
+    model->roll_head = (uint8_t)((model->roll_head + 1) % ATM_ROLL_COLUMNS);
 }
 
 static void atm_update_levels(FlipperAtmApp* app) {
+    atm_set_scope_enabled(app->scope_page && app->current_view == AtmViewPlayer);
+    if(app->current_view != AtmViewPlayer) {
+        atm_ui_pace(app, false);
+        return;
+    }
+
     uint8_t raw_levels[4] = {0, 0, 0, 0};
     uint8_t smooth_widths[4] = {0, 0, 0, 0};
-    const uint16_t meter_max_level = 63;
-    const uint16_t meter_inner_w = 120;
     atm_get_channel_levels(raw_levels);
     // raw_levels[3] = (uint8_t)(raw_levels[3] > 31 ? 63 : raw_levels[3] * 2);
-    app->ui_dither_phase++;
-
-    for(size_t i = 0; i < 4; i++) {
-        uint16_t target_q8 = (uint16_t)raw_levels[i] << 8;
-        uint16_t cur_q8 = app->ui_level_q8[i];
-
-        if(target_q8 >= cur_q8) {
-            cur_q8 = target_q8;
-        } else {
-            uint16_t delta = (uint16_t)(cur_q8 - target_q8);
-            uint16_t decay = (uint16_t)((delta >> 3) + 1);
-            cur_q8 = (cur_q8 > decay) ? (uint16_t)(cur_q8 - decay) : 0;
-        }
-
-        app->ui_level_q8[i] = cur_q8;
-
-        uint32_t w_q8 = ((uint32_t)cur_q8 * meter_inner_w) / meter_max_level;
-        uint8_t w = (uint8_t)(w_q8 >> 8);
-        uint8_t frac = (uint8_t)(w_q8 & 0xFF);
-
-        if(w < meter_inner_w && frac > app->ui_dither_phase) w++;
-        smooth_widths[i] = w;
+    atm_ui_meter_widths(&app->ui, raw_levels, app->playing && !app->paused, smooth_widths);
+
+    const uint32_t elapsed_ms = atm_song_elapsed_ms(app);
+    const uint32_t elapsed_s = elapsed_ms / 1000;
+    const uint8_t fill = atm_progress_fill(elapsed_ms, app->song_info.duration_ms);
+
+    const AtmScopeFrame* frame = app->scope_page ? atm_get_scope_frame() : NULL;
+
+    // The update goes first: it records what the view will show even when a scope frame alone
+    // forces the redraw.
+    const bool changed = atm_ui_update(&app->ui, smooth_widths, elapsed_s, fill) || frame;
+    if(changed) {
+        with_view_model_cpp(
+            app->player_view,
+            AtmPlayerModel*,
+            model,
+            {
+                for(size_t i = 0; i < 4; i++) {
+                    model->levels[i] = smooth_widths[i];
+                }
+                model->elapsed_ms = elapsed_ms;
+                if(frame) atm_scope_to_model(model, frame);
+            },
+            true);
     }
+    atm_ui_pace(app, changed);
+}
 
-    with_view_model_cpp(
-        app->player_view,
-        AtmPlayerModel*,
-        model,
-        {
-            for(size_t i = 0; i < 4; i++) {
-                model->levels[i] = smooth_widths[i];
-            }
-        },
-        true);
+// Paged songs are not checked for loops before they play; a channel the player had to stop is
+// reported in the state line.
+static void atm_runaway_poll(FlipperAtmApp* app) {
+    const uint8_t runaway = atm_get_runaway_channels();
+    if(runaway && !app->ui_runaway) atm_set_player_status(app, app->song_name, "Loop error", true);
+    app->ui_runaway = runaway;
 }
 
 static void atm_reset_ui_level_meters(FlipperAtmApp* app) {
-    memset(app->ui_level_q8, 0, sizeof(app->ui_level_q8));
-    app->ui_dither_phase = 0;
+    atm_ui_reset_meters(&app->ui);
 }
 
 static void atm_set_playback_state(FlipperAtmApp* app) {
-    atm_set_player_status(app, app->song_name, "", app->song_buf != NULL);
+    atm_set_player_status(app, app->song_name, "", app->song_buf != NULL || app->paged);
 }
 
 static void atm_apply_volume_units(FlipperAtmApp* app) {
@@ -228,6 +267,13 @@ static void atm_apply_volume_units(FlipperAtmApp* app) {
     ATM.setMasterVolume(gain);
 }
 
+static void atm_apply_tempo_units(FlipperAtmApp* app) {
+    if(app->tempo_units > ATM_TEMPO_UNIT_MAX) app->tempo_units = ATM_TEMPO_UNIT_MAX;
+    if(app->tempo_units < ATM_TEMPO_UNIT_MIN) app->tempo_units = ATM_TEMPO_UNIT_MIN;
+
+    ATM.setTempoScale(1.0f + (float)app->tempo_units * ATM_TEMPO_UNIT_STEP);
+}
+
 static void atm_extract_file_name(const char* path, char* out, size_t out_size) {
     const char* file = strrchr(path, '/');
     file = file ? (file + 1) : path;
@@ -257,372 +303,298 @@ static void atm_free_name_list(char** names, size_t count) {
     free(names);
 }
 
-static bool byte_buffer_push(ByteBuffer* b, uint8_t value) {
-    if(b->size == b->capacity) {
-        size_t next = (b->capacity == 0) ? 128 : (b->capacity * 2);
-        uint8_t* n = (uint8_t*)realloc(b->bytes, next);
-        if(!n) return false;
-        b->bytes = n;
-        b->capacity = next;
-    }
-    b->bytes[b->size++] = value;
-    return true;
-}
-
-static bool byte_buffer_push_u8_from_i32(ByteBuffer* b, int32_t value) {
-    return byte_buffer_push(b, (uint8_t)(value & 0xFF));
-}
-
-static bool byte_buffer_push_vle(ByteBuffer* b, uint32_t value) {
-    uint8_t groups[5];
-    size_t n = 0;
+static char* atm_read_song_text(FlipperAtmApp* app, const char* path) {
+    char* text = NULL;
+    File* file = storage_file_alloc(app->storage);
+    if(!file) return NULL;
 
     do {
-        groups[n++] = (uint8_t)(value & 0x7F);
-        value >>= 7;
-    } while(value && n < sizeof(groups));
-
-    for(size_t i = n; i > 0; i--) {
-        uint8_t out = groups[i - 1];
-        if(i != 1) out |= 0x80;
-        if(!byte_buffer_push(b, out)) return false;
-    }
-
-    return true;
-}
+        if(!storage_file_open(file, path, FSAM_READ, FSOM_OPEN_EXISTING)) break;
 
-static bool offset_buffer_push(OffsetBuffer* b, uint16_t value) {
-    if(b->size == b->capacity) {
-        size_t next = (b->capacity == 0) ? 16 : (b->capacity * 2);
-        uint16_t* n = (uint16_t*)realloc(b->items, next * sizeof(uint16_t));
-        if(!n) return false;
-        b->items = n;
-        b->capacity = next;
-    }
-    b->items[b->size++] = value;
-    return true;
-}
+        uint64_t file_size = storage_file_size(file);
+        if(file_size == 0 || file_size > ATM_SONG_MAX_TEXT_SIZE) break;
 
-static bool atm_next_token(AtmTokenizer* tz, char* token, size_t token_size) {
-    const char* p = tz->cur;
+        text = (char*)malloc((size_t)file_size + 1);
+        if(!text) break;
 
-    while(*p) {
-        if(*p == ATM_TXT_COMMENT) {
-            while(*p && *p != '\n')
-                p++;
-            continue;
+        size_t read_total = 0;
+        while(read_total < (size_t)file_size) {
+            size_t r = storage_file_read(file, text + read_total, (size_t)file_size - read_total);
+            if(r == 0) break;
+            read_total += r;
         }
+        text[read_total] = '\0';
 
-        if(atm_is_space(*p) || *p == ATM_TXT_SEPARATOR) {
-            p++;
-            continue;
+        if(read_total != (size_t)file_size) {
+            free(text);
+            text = NULL;
         }
+    } while(false);
 
-        break;
-    }
-
-    if(!*p) {
-        tz->cur = p;
-        return false;
-    }
-
-    size_t n = 0;
-    while(*p && !atm_is_space(*p) && (*p != ATM_TXT_SEPARATOR) && (*p != ATM_TXT_COMMENT)) {
-        if((n + 1) < token_size) token[n++] = *p;
-        p++;
-    }
-
-    token[n] = '\0';
-    tz->cur = p;
-    return n > 0;
+    storage_file_close(file);
+    storage_file_free(file);
+    return text;
 }
 
-static bool atm_parse_i32(const char* token, int32_t* out) {
-    char* end = NULL;
-    long value = strtol(token, &end, 0);
-    if(!end || (*end != '\0')) return false;
-    *out = (int32_t)value;
+static bool atm_watch_stat(FlipperAtmApp* app, const char* path, uint32_t* mtime, uint64_t* size) {
+    FileInfo info;
+    if(storage_common_stat(app->storage, path, &info) != FSE_OK) return false;
+    if(storage_common_timestamp(app->storage, path, mtime) != FSE_OK) return false;
+    *size = info.size;
     return true;
 }
 
-static bool atm_parse_arg_i32(AtmTokenizer* tz, int32_t* out) {
-    char token[32];
-    if(!atm_next_token(tz, token, sizeof(token))) return false;
-    return atm_parse_i32(token, out);
+static void atm_watch_stop(FlipperAtmApp* app) {
+    app->watch_enabled = false;
+    atm_compile_cache_free(&app->compile_cache);
 }
 
-static bool atm_parse_name_line(AtmTokenizer* tz, char* out, size_t out_size) {
-    if(!out || out_size == 0) return false;
-
-    const char* p = tz->cur;
-    while(*p == ' ' || *p == '\t' || *p == ATM_TXT_SEPARATOR)
-        p++;
-
-    if(*p == '\0' || *p == '\n' || *p == '\r' || *p == ATM_TXT_COMMENT) return false;
-
-    size_t n = 0;
-    while(*p && *p != '\n' && *p != '\r' && *p != ATM_TXT_COMMENT) {
-        if((n + 1) < out_size) out[n++] = *p;
-        p++;
-    }
-
-    while(n > 0 && (out[n - 1] == ' ' || out[n - 1] == '\t' || out[n - 1] == ATM_TXT_SEPARATOR))
-        n--;
-    out[n] = '\0';
-
-    tz->cur = p;
-    return n > 0;
+static void atm_set_song_buf(FlipperAtmApp* app, uint8_t* image, size_t size) {
+    if(app->song_prev_buf) free(app->song_prev_buf);
+    app->song_prev_buf = NULL;
+    if(app->song_buf) free(app->song_buf);
+    app->song_buf = image;
+    app->song_size = size;
+    app->paged = false;
+    app->has_song_info = image && atm_analyze_song(image, size, &app->song_info);
+    app->song_gain_q8 = image ? atm_song_auto_gain_q8(image) : 256;
 }
 
-static bool atm_emit_instruction(AtmTokenizer* tz, const char* op, ByteBuffer* data) {
-    int32_t a = 0;
-    int32_t b = 0;
-    int32_t c = 0;
-    int32_t d = 0;
-
-    if(atm_token_equals(op, ATM_TXT_OP_DB)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        return byte_buffer_push_u8_from_i32(data, a);
-    }
-
-    if(atm_token_equals(op, ATM_TXT_OP_NOTE)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        if(a < 0 || a > 63) return false;
-        return byte_buffer_push_u8_from_i32(data, a);
-    }
-
-    if(atm_token_equals(op, ATM_TXT_OP_DELAY)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        if(a < 1) return false;
-
-        if(a <= 64) {
-            return byte_buffer_push_u8_from_i32(data, 159 + a);
-        } else {
-            if(!byte_buffer_push(data, 224)) return false;
-            return byte_buffer_push_vle(data, (uint32_t)(a - 65));
-        }
-    }
-
-    if(atm_token_equals(op, ATM_TXT_OP_STOP)) {
-        return byte_buffer_push(data, 0x9F);
-    }
-
-    if(atm_token_equals(op, ATM_TXT_OP_RETURN)) {
-        return byte_buffer_push(data, 0xFE);
-    }
-
-    if(atm_token_equals(op, ATM_TXT_OP_GOTO)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        return byte_buffer_push(data, 0xFC) && byte_buffer_push_u8_from_i32(data, a);
-    }
-
-    if(atm_token_equals(op, ATM_TXT_OP_REPEAT)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        if(!atm_parse_arg_i32(tz, &b)) return false;
-        return byte_buffer_push(data, 0xFD) && byte_buffer_push_u8_from_i32(data, a) &&
-               byte_buffer_push_u8_from_i32(data, b);
-    }
-
-    if(atm_token_equals(op, ATM_TXT_OP_SET_TEMPO)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        return byte_buffer_push(data, 0x9D) && byte_buffer_push_u8_from_i32(data, a);
-    }
-
-    if(atm_token_equals(op, ATM_TXT_OP_ADD_TEMPO)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        return byte_buffer_push(data, 0x9C) && byte_buffer_push_u8_from_i32(data, a);
-    }
-
-    if(atm_token_equals(op, ATM_TXT_OP_SET_VOLUME)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        return byte_buffer_push(data, 0x40) && byte_buffer_push_u8_from_i32(data, a);
-    }
+// A song with a loop that never delays would only play until the player's command limit stops
+// its channels, so it is refused up front.
+static bool atm_song_loops(const uint8_t* image, size_t size) {
+    uint8_t track;
+    return atm_find_delay_free_cycle(image, size, &track);
+}
 
-    if(atm_token_equals(op, ATM_TXT_OP_VOLUME_SLIDE_ON)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        return byte_buffer_push(data, 0x41) && byte_buffer_push_u8_from_i32(data, a);
+static bool atm_load_song_from_file(
+    FlipperAtmApp* app,
+    const char* path,
+    char* out_song_name,
+    size_t out_song_name_size) {
+    atm_watch_stop(app);
+
+    // Stat first: an edit saved while the file is being read is then picked up by the watch.
+    uint32_t mtime = 0;
+    uint64_t size = 0;
+    const bool watch = atm_watch_stat(app, path, &mtime, &size);
+
+    char* text = atm_read_song_text(app, path);
+    if(!text) return false;
+
+    uint8_t* compiled = NULL;
+    size_t compiled_size = 0;
+    const bool ok = atm_parse_song_text_cached(
+        text, &app->compile_cache, &compiled, &compiled_size, out_song_name, out_song_name_size);
+    free(text);
+    if(!ok) return false;
+    if(atm_song_loops(compiled, compiled_size)) {
+        free(compiled);
+        return false;
     }
 
-    if(atm_token_equals(op, ATM_TXT_OP_VOLUME_SLIDE_OFF)) {
-        return byte_buffer_push(data, 0x43);
-    }
+    atm_set_song_buf(app, compiled, compiled_size);
+    app->watch_enabled = watch;
+    app->watch_mtime = mtime;
+    app->watch_size = size;
+    app->watch_checked_ms = furi_get_tick();
+    return true;
+}
 
-    if(atm_token_equals(op, ATM_TXT_OP_SET_NOTE_CUT)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        return byte_buffer_push(data, 0x54) && byte_buffer_push_u8_from_i32(data, a);
-    }
+// Recompiles the playing text song if its file changed and hands the result to the player,
+// which continues from the same spot. A file that does not compile (half-saved, or a typo), or
+// that loops without delaying, is tried again on the next change; the old version keeps playing
+// meanwhile.
+static void atm_watch_poll(FlipperAtmApp* app) {
+    if(!app->watch_enabled || !app->song_buf) return;
 
-    if(atm_token_equals(op, ATM_TXT_OP_NOTE_CUT_OFF)) {
-        return byte_buffer_push(data, 0x55);
-    }
+    const uint32_t now = furi_get_tick();
+    if(now - app->watch_checked_ms < furi_ms_to_ticks(ATM_WATCH_PERIOD_MS)) return;
+    app->watch_checked_ms = now;
 
-    if(atm_token_equals(op, ATM_TXT_OP_SET_TRANSPOSITION)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        return byte_buffer_push(data, 0x4C) && byte_buffer_push_u8_from_i32(data, a);
-    }
+    const char* path = furi_string_get_cstr(app->selected_path);
+    uint32_t mtime = 0;
+    uint64_t size = 0;
+    if(!atm_watch_stat(app, path, &mtime, &size)) return;
+    if(mtime == app->watch_mtime && size == app->watch_size) return;
 
-    if(atm_token_equals(op, ATM_TXT_OP_TRANSPOSITION_OFF)) {
-        return byte_buffer_push(data, 0x4D);
-    }
+    char* text = atm_read_song_text(app, path);
+    if(!text) return;
 
-    if(atm_token_equals(op, ATM_TXT_OP_GOTO_ADVANCED)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        if(!atm_parse_arg_i32(tz, &b)) return false;
-        if(!atm_parse_arg_i32(tz, &c)) return false;
-        if(!atm_parse_arg_i32(tz, &d)) return false;
-        return byte_buffer_push(data, 0x9E) && byte_buffer_push_u8_from_i32(data, a) &&
-               byte_buffer_push_u8_from_i32(data, b) && byte_buffer_push_u8_from_i32(data, c) &&
-               byte_buffer_push_u8_from_i32(data, d);
+    char song_name[48] = {0};
+    uint8_t* compiled = NULL;
+    size_t compiled_size = 0;
+    const bool ok = atm_parse_song_text_cached(
+        text, &app->compile_cache, &compiled, &compiled_size, song_name, sizeof(song_name));
+    free(text);
+    if(!ok) return;
+    if(atm_song_loops(compiled, compiled_size)) {
+        // The cache now holds the refused compile; the next one starts from scratch.
+        free(compiled);
+        atm_compile_cache_free(&app->compile_cache);
+        return;
     }
 
-    if(atm_token_equals(op, ATM_TXT_OP_SET_VIBRATO)) {
-        if(!atm_parse_arg_i32(tz, &a)) return false;
-        if(!atm_parse_arg_i32(tz, &b)) return false;
-        return byte_buffer_push(data, 0x4E) && byte_buffer_push_u8_from_i32(data, a) &&
-               byte_buffer_push_u8_from_i32(data, b);
-    }
+    app->watch_mtime = mtime;
+    app->watch_size = size;
 
-    if(atm_parse_i32(op, &a)) {
-        return byte_buffer_push_u8_from_i32(data, a);
+    uint32_t relaid[8] = {0};
+    for(size_t i = 0; i < app->compile_cache.count; i++) {
+        if(app->compile_cache.tracks[i].change == AtmTrackRelaid) relaid[i >> 5] |= 1u << (i & 31);
     }
-
-    return false;
+    ATM.reload(compiled, relaid);
+
+    if(app->song_prev_buf) free(app->song_prev_buf);
+    app->song_prev_buf = app->song_buf;
+    app->song_buf = compiled;
+    app->song_size = compiled_size;
+    app->has_song_info = atm_analyze_song(compiled, compiled_size, &app->song_info);
+    // The playing song keeps its gain; the next play of this image uses the new one.
+    app->song_gain_q8 = atm_song_auto_gain_q8(compiled);
+
+    if(song_name[0]) snprintf(app->song_name, sizeof(app->song_name), "%s", song_name);
+    atm_set_player_status(app, app->song_name, "", true);
 }
 
-static bool atm_parse_song_text(
-    const char* text,
-    uint8_t** out_buf,
-    size_t* out_size,
-    char* out_song_name,
-    size_t out_song_name_size) {
-    AtmTokenizer tz = {.cur = text};
-    char token[64];
-
-    uint8_t entry[4] = {0};
-    int32_t value = 0;
-
-    ByteBuffer data = {NULL, 0, 0};
-    OffsetBuffer offsets = {NULL, 0, 0};
+static void atm_bank_close(FlipperAtmApp* app) {
+    if(app->bank_entries) free(app->bank_entries);
+    app->bank_entries = NULL;
+    app->bank_count = 0;
+    app->bank_index = 0;
+}
 
-    uint8_t* song = NULL;
-    size_t song_size = 0;
-    size_t p = 0;
+// Reads the index of an ATMB bank. Returns false for anything else, including ATM1 text.
+static bool atm_bank_open(FlipperAtmApp* app, const char* path) {
     bool ok = false;
-    char ignored_song_name[2] = {0};
-    char* song_name_dst = out_song_name ? out_song_name : ignored_song_name;
-    size_t song_name_dst_size = out_song_name ? out_song_name_size : sizeof(ignored_song_name);
-
-    if(song_name_dst_size > 0) song_name_dst[0] = '\0';
-
-    if(!atm_next_token(&tz, token, sizeof(token)) || !atm_token_equals(token, ATM_TXT_MAGIC))
-        goto out;
+    File* file = storage_file_alloc(app->storage);
+    if(!file) return false;
 
-    if(!atm_next_token(&tz, token, sizeof(token))) goto out;
-    if(atm_token_equals(token, ATM_TXT_CMD_NAME)) {
-        if(!atm_parse_name_line(&tz, song_name_dst, song_name_dst_size)) goto out;
-        if(!atm_next_token(&tz, token, sizeof(token))) goto out;
-    }
+    uint8_t* index = NULL;
+    AtmBankEntry* entries = NULL;
 
-    if(!atm_token_equals(token, ATM_TXT_CMD_ENTRY))
-        goto out;
-    for(size_t i = 0; i < 4; i++) {
-        if(!atm_parse_arg_i32(&tz, &value)) goto out;
-        entry[i] = (uint8_t)(value & 0xFF);
-    }
+    do {
+        if(!storage_file_open(file, path, FSAM_READ, FSOM_OPEN_EXISTING)) break;
 
-    while(atm_next_token(&tz, token, sizeof(token))) {
-        if(atm_token_equals(token, ATM_TXT_CMD_END)) {
-            break;
-        }
+        uint8_t header[ATM_BANK_HEADER_SIZE];
+        if(storage_file_read(file, header, sizeof(header)) != sizeof(header)) break;
 
-        if(!atm_token_equals(token, ATM_TXT_CMD_TRACK)) goto out;
+        const int32_t count = atm_bank_parse_header(header);
+        if(count <= 0) break;
 
-        if(!offset_buffer_push(&offsets, (uint16_t)data.size)) goto out;
+        const size_t index_size = (size_t)count * ATM_BANK_ENTRY_SIZE;
+        index = (uint8_t*)malloc(index_size);
+        entries = (AtmBankEntry*)malloc((size_t)count * sizeof(AtmBankEntry));
+        if(!index || !entries) break;
+        if(storage_file_read(file, index, index_size) != index_size) break;
 
-        while(atm_next_token(&tz, token, sizeof(token))) {
-            if(atm_token_equals(token, ATM_TXT_CMD_ENDTRACK)) break;
-            if(!atm_emit_instruction(&tz, token, &data)) goto out;
+        for(int32_t i = 0; i < count; i++) {
+            atm_bank_parse_entry(index + (size_t)i * ATM_BANK_ENTRY_SIZE, &entries[i]);
         }
 
-        if(!atm_token_equals(token, ATM_TXT_CMD_ENDTRACK)) goto out;
-    }
-
-    if(!atm_token_equals(token, ATM_TXT_CMD_END)) goto out;
-    if(offsets.size == 0 || offsets.size > 255) goto out;
-
-    song_size = 1 + offsets.size * 2 + 4 + data.size;
-    song = (uint8_t*)malloc(song_size);
-    if(!song) goto out;
-
-    song[p++] = (uint8_t)offsets.size;
-    for(size_t i = 0; i < offsets.size; i++) {
-        uint16_t off = offsets.items[i];
-        song[p++] = (uint8_t)(off & 0xFF);
-        song[p++] = (uint8_t)((off >> 8) & 0xFF);
-    }
-    for(size_t i = 0; i < 4; i++) {
-        song[p++] = entry[i];
-    }
-    memcpy(song + p, data.bytes, data.size);
-
-    *out_buf = song;
-    *out_size = song_size;
-    song = NULL;
-    ok = true;
+        atm_bank_close(app);
+        app->bank_entries = entries;
+        app->bank_count = (uint16_t)count;
+        entries = NULL;
+        ok = true;
+    } while(false);
 
-out:
-    if(song) free(song);
-    if(data.bytes) free(data.bytes);
-    if(offsets.items) free(offsets.items);
+    if(index) free(index);
+    if(entries) free(entries);
+    storage_file_close(file);
+    storage_file_free(file);
     return ok;
 }
 
-static bool atm_load_song_from_file(
-    FlipperAtmApp* app,
-    const char* path,
-    char* out_song_name,
-    size_t out_song_name_size) {
+static bool atm_load_bank_entry(FlipperAtmApp* app, const char* path, const AtmBankEntry* entry) {
+    if(entry->size == 0 || entry->size > ATM_BANK_MAX_SONG_SIZE) return false;
+
     bool ok = false;
     File* file = storage_file_alloc(app->storage);
     if(!file) return false;
 
+    uint8_t* image = (uint8_t*)malloc(entry->size);
     do {
+        if(!image) break;
         if(!storage_file_open(file, path, FSAM_READ, FSOM_OPEN_EXISTING)) break;
+        if(!storage_file_seek(file, entry->offset, true)) break;
+        if(storage_file_read(file, image, entry->size) != entry->size) break;
+        if(atm_song_loops(image, entry->size)) break;
+
+        atm_watch_stop(app);
+        atm_set_song_buf(app, image, entry->size);
+        image = NULL;
+        ok = true;
+    } while(false);
 
-        uint64_t file_size = storage_file_size(file);
-        if(file_size == 0 || file_size > ATM_SONG_MAX_TEXT_SIZE) break;
+    if(image) free(image);
+    storage_file_close(file);
+    storage_file_free(file);
+    return ok;
+}
 
-        char* text = (char*)malloc((size_t)file_size + 1);
-        if(!text) break;
+static bool atm_play_bank_entry(FlipperAtmApp* app, uint16_t index) {
+    if(index >= app->bank_count) return false;
+    app->bank_index = index;
 
-        size_t read_total = 0;
-        while(read_total < (size_t)file_size) {
-            size_t r = storage_file_read(file, text + read_total, (size_t)file_size - read_total);
-            if(r == 0) break;
-            read_total += r;
-        }
-        text[read_total] = '\0';
+    const AtmBankEntry* entry = &app->bank_entries[index];
+    snprintf(app->song_name, sizeof(app->song_name), "%s", entry->name);
+    atm_reset_ui_level_meters(app);
 
-        uint8_t* compiled = NULL;
-        size_t compiled_size = 0;
-        if(read_total == (size_t)file_size &&
-           atm_parse_song_text(text, &compiled, &compiled_size, out_song_name, out_song_name_size)) {
-            if(app->song_buf) free(app->song_buf);
-            app->song_buf = compiled;
-            app->song_size = compiled_size;
-            ok = true;
-        }
+    if(atm_load_bank_entry(app, furi_string_get_cstr(app->selected_path), entry)) {
+        ATM.setUniformToneMode(atm_str_contains_ci(entry->name, "blheli32"));
+        ATM.play(app->song_buf, app->song_gain_q8);
+        app->playing = true;
+        app->paused = false;
+        atm_set_playback_state(app);
+        return true;
+    }
 
-        free(text);
-    } while(false);
+    ATM.stop();
+    app->playing = false;
+    app->paused = false;
+    atm_set_player_status(app, app->song_name, "Load error", false);
+    return false;
+}
+
+// True for a paged song image (ATMP), which is played from storage instead of being loaded.
+static bool atm_paged_probe(FlipperAtmApp* app, const char* path) {
+    File* file = storage_file_alloc(app->storage);
+    if(!file) return false;
+
+    uint8_t header[ATM_PAGED_HEADER_SIZE];
+    const bool ok = storage_file_open(file, path, FSAM_READ, FSOM_OPEN_EXISTING) &&
+                    storage_file_read(file, header, sizeof(header)) == sizeof(header) &&
+                    memcmp(header, ATM_PAGED_MAGIC, 4) == 0 && header[4] == ATM_PAGED_VERSION;
 
     storage_file_close(file);
     storage_file_free(file);
     return ok;
 }
 
+static void atm_play_paged(FlipperAtmApp* app, const char* path) {
+    atm_watch_stop(app);
+    atm_set_song_buf(app, NULL, 0);
+    app->paged = true;
+
+    atm_extract_file_name(path, app->song_name, sizeof(app->song_name));
+    atm_reset_ui_level_meters(app);
+    ATM.setUniformToneMode(atm_str_contains_ci(path, "blheli32"));
+    ATM.playPaged(path);
+    app->playing = true;
+    app->paused = false;
+    atm_set_playback_state(app);
+}
+
 static bool atm_play_selected_file(FlipperAtmApp* app) {
     const char* selected_path = furi_string_get_cstr(app->selected_path);
+    if(atm_bank_open(app, selected_path)) return atm_play_bank_entry(app, 0);
+    atm_bank_close(app);
+
+    if(atm_paged_probe(app, selected_path)) {
+        atm_play_paged(app, selected_path);
+        return true;
+    }
+
     char short_name[48];
     atm_extract_file_name(selected_path, short_name, sizeof(short_name));
 
@@ -631,7 +603,7 @@ static bool atm_play_selected_file(FlipperAtmApp* app) {
         snprintf(app->song_name, sizeof(app->song_name), "%s", song_name[0] ? song_name : short_name);
         atm_reset_ui_level_meters(app);
         ATM.setUniformToneMode(atm_str_contains_ci(selected_path, "blheli32"));
-        ATM.play(app->song_buf);
+        ATM.play(app->song_buf, app->song_gain_q8);
         app->playing = true;
         app->paused = false;
         atm_set_playback_state(app);
@@ -648,6 +620,16 @@ static bool atm_play_selected_file(FlipperAtmApp* app) {
 }
 
 static bool atm_switch_track(FlipperAtmApp* app, int8_t step) {
+    if(app->bank_count) {
+        uint16_t next = app->bank_index;
+        if(step > 0) {
+            next = (uint16_t)((next + 1) % app->bank_count);
+        } else {
+            next = (next == 0) ? (uint16_t)(app->bank_count - 1) : (uint16_t)(next - 1);
+        }
+        return atm_play_bank_entry(app, next);
+    }
+
     const char* current_path = furi_string_get_cstr(app->selected_path);
     const char* slash = strrchr(current_path, '/');
     if(!slash) return false;
@@ -751,11 +733,88 @@ static void atm_open_browser(FlipperAtmApp* app) {
     view_dispatcher_switch_to_view(app->dispatcher, AtmViewBrowser);
 }
 
+static void atm_bank_menu_callback(void* context, uint32_t index) {
+    FlipperAtmApp* app = (FlipperAtmApp*)context;
+    app->bank_index = (uint16_t)index;
+    view_dispatcher_send_custom_event(app->dispatcher, AtmEventBankEntrySelected);
+}
+
+static void atm_open_bank_menu(FlipperAtmApp* app) {
+    char short_name[48];
+    atm_extract_file_name(furi_string_get_cstr(app->selected_path), short_name, sizeof(short_name));
+
+    submenu_reset(app->bank_menu);
+    submenu_set_header(app->bank_menu, short_name);
+    for(uint16_t i = 0; i < app->bank_count; i++) {
+        submenu_add_item(app->bank_menu, app->bank_entries[i].name, i, atm_bank_menu_callback, app);
+    }
+    submenu_set_selected_item(app->bank_menu, app->bank_index);
+
+    app->current_view = AtmViewBank;
+    view_dispatcher_switch_to_view(app->dispatcher, AtmViewBank);
+}
+
 static void atm_ui_timer_callback(void* context) {
     FlipperAtmApp* app = (FlipperAtmApp*)context;
     view_dispatcher_send_custom_event(app->dispatcher, AtmEventUiTick);
 }
 
+static void atm_draw_progress(Canvas* canvas, const AtmPlayerModel* model) {
+    const uint8_t bar_x = 15;
+    const uint8_t bar_y = 16;
+    const uint8_t bar_inner_w = ATM_PROGRESS_INNER_W;
+    const uint8_t bar_w = bar_inner_w + 2;
+    const uint8_t bar_h = 5;
+
+    canvas_draw_frame(canvas, bar_x, bar_y, bar_w, bar_h);
+
+    if(model->total_ms) {
+        const uint8_t w = atm_progress_fill(model->elapsed_ms, model->total_ms);
+        if(w) canvas_draw_box(canvas, (uint8_t)(bar_x + 1), (uint8_t)(bar_y + 1), w, (uint8_t)(bar_h - 2));
+
+        if(model->looped) {
+            const uint8_t lx = (uint8_t)(
+                bar_x + 1 + ((uint64_t)model->loop_start_ms * bar_inner_w) / model->total_ms);
+            canvas_draw_dot(canvas, lx, (uint8_t)(bar_y - 1));
+            canvas_draw_dot(canvas, lx, (uint8_t)(bar_y + bar_h));
+        }
+    }
+
+    char time_line[24];
+    const uint32_t es = model->elapsed_ms / 1000;
+    const uint32_t ts = model->total_ms / 1000;
+    snprintf(
+        time_line,
+        sizeof(time_line),
+        "%lu:%02lu/%lu:%02lu",
+        (unsigned long)(es / 60),
+        (unsigned long)(es % 60),
+        (unsigned long)(ts / 60),
+        (unsigned long)(ts % 60));
+    canvas_draw_str_aligned(canvas, 126, 22, AlignRight, AlignBottom, time_line);
+}
+
+static void atm_draw_scope(Canvas* canvas, const AtmPlayerModel* model) {
+    uint8_t prev_y = ATM_SCOPE_MID_Y;
+    for(uint8_t x = 0; x < ATM_SCOPE_SAMPLES; x++) {
+        // 8 px of swing per 64 steps keeps a full-scale mix inside the top 31 rows.
+        int32_t y = ATM_SCOPE_MID_Y - (((int32_t)model->scope[x] - 128) / 8);
+        if(y < 0) y = 0;
+        if(y > 2 * ATM_SCOPE_MID_Y) y = 2 * ATM_SCOPE_MID_Y;
+        if(x) canvas_draw_line(canvas, (uint8_t)(x - 1), prev_y, x, (uint8_t)y);
+        prev_y = (uint8_t)y;
+    }
+
+    canvas_draw_line(canvas, 0, 32, 127, 32);
+    for(uint8_t x = 0; x < ATM_ROLL_COLUMNS; x++) {
+        const uint8_t* notes = model->roll[(model->roll_head + x) % ATM_ROLL_COLUMNS];
+        for(uint8_t c = 0; c < 4; c++) {
+            // Notes 1..63, two per row.
+            if(notes[c]) canvas_draw_dot(canvas, x, (uint8_t)(ATM_ROLL_BOTTOM - ((notes[c] - 1) >> 1)));
+        }
+    }
+}
+
 static void atm_player_draw_callback(Canvas* canvas, void* model_ptr) {
     AtmPlayerModel* model = (AtmPlayerModel*)model_ptr;
 
@@ -774,9 +833,26 @@ static void atm_player_draw_callback(Canvas* canvas, void* model_ptr) {
     const uint8_t vol_inner_w = 96;
 
     canvas_clear(canvas);
+    if(model->scope_page) {
+        atm_draw_scope(canvas, model);
+        return;
+    }
+
     canvas_set_font(canvas, FontPrimary);
     canvas_draw_str(canvas, 2, 11, model->song_name);
 
+    if(model->tempo_units) {
+        char tempo_line[8];
+        const int32_t tenths = 10 + model->tempo_units;
+        snprintf(tempo_line, sizeof(tempo_line), "x%ld.%ld", (long)(tenths / 10), (long)(tenths % 10));
+        canvas_set_font(canvas, FontSecondary);
+        const uint16_t w = canvas_string_width(canvas, tempo_line);
+        canvas_set_color(canvas, ColorWhite);
+        canvas_draw_box(canvas, (int32_t)(126 - w - 2), 0, (size_t)(w + 4), 12);
+        canvas_set_color(canvas, ColorBlack);
+        canvas_draw_str_aligned(canvas, 126, 10, AlignRight, AlignBottom, tempo_line);
+    }
+
     canvas_set_font(canvas, FontSecondary);
     canvas_draw_str(canvas, 2, 31, "Vol:");
 
@@ -808,7 +884,10 @@ static void atm_player_draw_callback(Canvas* canvas, void* model_ptr) {
         state_icon = model->paused ? &I_pause : &I_play;
     }
 
-    if(state_icon) {
+    if(state_icon && model->has_duration) {
+        canvas_draw_icon(canvas, 2, 14, state_icon);
+        atm_draw_progress(canvas, model);
+    } else if(state_icon) {
         const int32_t icon_x = ((int32_t)128 - (int32_t)icon_get_width(state_icon)) / 2;
         const int32_t icon_y = 14;
         canvas_draw_icon(canvas, icon_x, icon_y, state_icon);
@@ -831,10 +910,56 @@ static bool atm_player_input_callback(InputEvent* event, void* context) {
     FlipperAtmApp* app = (FlipperAtmApp*)context;
     bool consumed = false;
 
+    if((event->key == InputKeyRight || event->key == InputKeyLeft) &&
+       (event->type == InputTypeLong || event->type == InputTypeRepeat)) {
+        if(app->playing) {
+            ATM.seekRelative((event->key == InputKeyRight) ? ATM_SEEK_STEP_MS : -ATM_SEEK_STEP_MS);
+            atm_ui_pace(app, true);
+        }
+        return true;
+    }
+
+    if((event->key == InputKeyUp || event->key == InputKeyDown) &&
+       (event->type == InputTypeLong || event->type == InputTypeRepeat)) {
+        const int8_t step = (event->key == InputKeyUp) ? 1 : -1;
+        if((step > 0 && app->tempo_units < ATM_TEMPO_UNIT_MAX) ||
+           (step < 0 && app->tempo_units > ATM_TEMPO_UNIT_MIN)) {
+            app->tempo_units = (int8_t)(app->tempo_units + step);
+            atm_apply_tempo_units(app);
+            atm_set_playback_state(app);
+        }
+        return true;
+    }
+
+    // Holding OK switches the page once; the repeats that follow must not toggle pause.
+    if(event->key == InputKeyOk && event->type == InputTypeRepeat) return true;
+
+    if(event->key == InputKeyOk && event->type == InputTypeLong) {
+        app->scope_page = !app->scope_page;
+        with_view_model_cpp(
+            app->player_view,
+            AtmPlayerModel*,
+            model,
+            {
+                model->scope_page = app->scope_page;
+                memset(model->scope, 128, sizeof(model->scope));
+                memset(model->roll, 0, sizeof(model->roll));
+                model->roll_head = 0;
+            },
+            true);
+        atm_set_scope_enabled(app->scope_page);
+        atm_ui_pace(app, true);
+        return true;
+    }
+
     if(event->type == InputTypeShort || event->type == InputTypeRepeat) {
-        if(event->key == InputKeyOk && app->song_buf) {
+        if(event->key == InputKeyOk && (app->song_buf || app->paged)) {
             if(!app->playing) {
-                ATM.play(app->song_buf);
+                if(app->paged) {
+                    ATM.playPaged(furi_string_get_cstr(app->selected_path));
+                } else {
+                    ATM.play(app->song_buf, app->song_gain_q8);
+                }
                 app->playing = true;
                 app->paused = false;
             } else {
@@ -873,6 +998,8 @@ static bool atm_custom_event_callback(void* context, uint32_t event) {
     FlipperAtmApp* app = (FlipperAtmApp*)context;
 
     if(event == AtmEventUiTick) {
+        atm_watch_poll(app);
+        atm_runaway_poll(app);
         atm_update_levels(app);
         return true;
     }
@@ -882,12 +1009,24 @@ static bool atm_custom_event_callback(void* context, uint32_t event) {
         return true;
     }
 
+    if(event == AtmEventBankEntrySelected) {
+        atm_play_bank_entry(app, app->bank_index);
+        app->current_view = AtmViewPlayer;
+        view_dispatcher_switch_to_view(app->dispatcher, AtmViewPlayer);
+        return true;
+    }
+
     if(event == AtmEventFileSelected) {
         if(app->browser_started) {
             file_browser_stop(app->file_browser);
             app->browser_started = false;
         }
 
+        if(atm_bank_open(app, furi_string_get_cstr(app->selected_path))) {
+            atm_open_bank_menu(app);
+            return true;
+        }
+
         atm_play_selected_file(app);
 
         app->current_view = AtmViewPlayer;
@@ -901,7 +1040,12 @@ static bool atm_custom_event_callback(void* context, uint32_t event) {
 static bool atm_navigation_event_callback(void* context) {
     FlipperAtmApp* app = (FlipperAtmApp*)context;
 
-    if(app->current_view == AtmViewPlayer) {
+    if(app->current_view == AtmViewPlayer && app->bank_count) {
+        atm_open_bank_menu(app);
+        return true;
+    }
+
+    if(app->current_view == AtmViewPlayer || app->current_view == AtmViewBank) {
         view_dispatcher_send_custom_event(app->dispatcher, AtmEventOpenBrowser);
         return true;
     }
@@ -956,14 +1100,14 @@ extern "C" int32_t flipper_atm_app(void* p) {
     view_set_draw_callback(app->player_view, atm_player_draw_callback);
     view_set_input_callback(app->player_view, atm_player_input_callback);
 
+    app->bank_menu = submenu_alloc();
+
     atm_apply_volume_units(app);
     atm_set_player_status(app, "-", "Choose file", false);
     atm_update_levels(app);
 
     app->ui_timer = furi_timer_alloc(atm_ui_timer_callback, FuriTimerTypePeriodic, app);
-    if(app->ui_timer) {
-        furi_timer_start(app->ui_timer, furi_ms_to_ticks(33));
-    }
+    atm_ui_set_period(app, ATM_UI_FAST_MS);
 
     view_dispatcher_set_event_callback_context(app->dispatcher, app);
     view_dispatcher_set_custom_event_callback(app->dispatcher, atm_custom_event_callback);
@@ -972,6 +1116,7 @@ extern "C" int32_t flipper_atm_app(void* p) {
     view_dispatcher_add_view(
         app->dispatcher, AtmViewBrowser, file_browser_get_view(app->file_browser));
     view_dispatcher_add_view(app->dispatcher, AtmViewPlayer, app->player_view);
+    view_dispatcher_add_view(app->dispatcher, AtmViewBank, submenu_get_view(app->bank_menu));
     view_dispatcher_attach_to_gui(app->dispatcher, app->gui, ViewDispatcherTypeFullscreen);
 
     atm_system_init();
@@ -993,11 +1138,16 @@ extern "C" int32_t flipper_atm_app(void* p) {
     }
 
     if(app->song_buf) free(app->song_buf);
+    if(app->song_prev_buf) free(app->song_prev_buf);
+    atm_compile_cache_free(&app->compile_cache);
+    atm_bank_close(app);
 
     view_dispatcher_remove_view(app->dispatcher, AtmViewBrowser);
     view_dispatcher_remove_view(app->dispatcher, AtmViewPlayer);
+    view_dispatcher_remove_view(app->dispatcher, AtmViewBank);
     file_browser_free(app->file_browser);
     view_free(app->player_view);
+    submenu_free(app->bank_menu);
 
     view_dispatcher_free(app->dispatcher);
     furi_string_free(app->selected_path);
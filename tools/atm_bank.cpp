@@ -0,0 +1,109 @@
+// Host tool: packs every ATM1 text song of a directory into one ATMB bank file.
+//
+//   g++ -std=c++17 -O2 -o atm_bank tools/atm_bank.cpp ATMparse.cpp
+//   ./atm_bank assets/arduventure arduventure.atm
+//
+// Entries are stored in file name order, which is also the order the player steps through them.
+
+#include "../lib/ATMbank.h"
+#include "../lib/ATMparse.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct BankSong {
+    std::string name;
+    std::vector<uint8_t> image;
+};
+
+static bool has_atm_ext(const fs::path& p) {
+    std::string ext = p.extension().string();
+    if(ext.size() != 4) return false;
+    return ext[0] == '.' && atm_char_upper(ext[1]) == 'A' && atm_char_upper(ext[2]) == 'T' &&
+           atm_char_upper(ext[3]) == 'M';
+}
+
+static bool compile_file(const fs::path& path, BankSong* out) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return false;
+    std::stringstream ss;
+    ss << in.rdbuf();
+    const std::string text = ss.str();
+
+    uint8_t* image = NULL;
+    size_t image_size = 0;
+    char song_name[ATM_BANK_NAME_SIZE] = {0};
+    if(!atm_parse_song_text(text.c_str(), &image, &image_size, song_name, sizeof(song_name)))
+        return false;
+
+    out->name = song_name[0] ? song_name : path.stem().string();
+    out->image.assign(image, image + image_size);
+    free(image);
+    return image_size <= ATM_BANK_MAX_SONG_SIZE;
+}
+
+int main(int argc, char** argv) {
+    if(argc != 3) {
+        fprintf(stderr, "usage: %s <song dir> <out bank>\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<fs::path> files;
+    for(const auto& e : fs::directory_iterator(argv[1])) {
+        if(e.is_regular_file() && has_atm_ext(e.path())) files.push_back(e.path());
+    }
+    std::sort(files.begin(), files.end(), [](const fs::path& a, const fs::path& b) {
+        return a.filename().string() < b.filename().string();
+    });
+
+    if(files.empty() || files.size() > ATM_BANK_MAX_ENTRIES) {
+        fprintf(stderr, "%s: need 1..%d .atm files, found %zu\n", argv[1], ATM_BANK_MAX_ENTRIES, files.size());
+        return 1;
+    }
+
+    std::vector<BankSong> songs(files.size());
+    for(size_t i = 0; i < files.size(); i++) {
+        if(!compile_file(files[i], &songs[i])) {
+            fprintf(stderr, "%s: compile error\n", files[i].string().c_str());
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> out(ATM_BANK_HEADER_SIZE + songs.size() * ATM_BANK_ENTRY_SIZE, 0);
+    memcpy(out.data(), ATM_BANK_MAGIC, 4);
+    out[4] = ATM_BANK_VERSION;
+    out[6] = (uint8_t)(songs.size() & 0xFF);
+    out[7] = (uint8_t)((songs.size() >> 8) & 0xFF);
+
+    for(size_t i = 0; i < songs.size(); i++) {
+        uint8_t* entry = out.data() + ATM_BANK_HEADER_SIZE + i * ATM_BANK_ENTRY_SIZE;
+        strncpy((char*)entry, songs[i].name.c_str(), ATM_BANK_NAME_SIZE - 1);
+        atm_bank_write_u32(entry + ATM_BANK_NAME_SIZE, (uint32_t)out.size());
+        atm_bank_write_u32(entry + ATM_BANK_NAME_SIZE + 4, (uint32_t)songs[i].image.size());
+        out.insert(out.end(), songs[i].image.begin(), songs[i].image.end());
+    }
+
+    FILE* f = fopen(argv[2], "wb");
+    if(!f || fwrite(out.data(), 1, out.size(), f) != out.size()) {
+        fprintf(stderr, "%s: write error\n", argv[2]);
+        if(f) fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    printf("%s: %zu songs, %zu bytes\n", argv[2], songs.size(), out.size());
+    for(size_t i = 0; i < songs.size(); i++) {
+        printf("  %3zu  %5zu  %s\n", i, songs[i].image.size(), songs[i].name.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,234 @@
+// Host tool: compiles and validates every ATM1 text song under a directory tree in parallel.
+//
+//   g++ -std=c++17 -O2 -pthread -o atm_batch tools/atm_batch.cpp ATMparse.cpp ATManalyze.cpp
+//   ./atm_batch [-j threads] [-s rounds] [-o out_dir] <song dir>
+//
+// Prints one tab-separated line per file (status, image size, tracks, duration, compile time,
+// analysis time, path, and for a compile error its line, column and reason) and a summary with
+// throughput and the slowest analysis, which the player runs on device at every load and which
+// has to stay well under 50 ms there. With -o, compiled images are written to out_dir as
+// <relative path>.atmc, in the format ATMsynth::play() consumes.
+//
+// With -s the whole tree is then compiled and analyzed again rounds times over with 1, 2, ...
+// up to threads workers, writing nothing, and the throughput and the speedup over one worker
+// are printed for each count.
+// Exits non-zero if any file failed.
+
+#include "atm_host.h"
+
+#include "../lib/ATManalyze.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+struct FileReport {
+    std::string status;
+    size_t image_size = 0;
+    size_t tracks = 0;
+    uint32_t duration_ms = 0;
+    bool looped = false;
+    uint64_t compile_us = 0;
+    uint64_t analyze_us = 0;
+    AtmParseError error = {};
+};
+
+static bool write_image(const fs::path& path, const uint8_t* image, size_t size) {
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    FILE* f = fopen(path.string().c_str(), "wb");
+    if(!f) return false;
+    const bool ok = fwrite(image, 1, size, f) == size;
+    fclose(f);
+    return ok;
+}
+
+static FileReport process_file(const fs::path& root, const fs::path& path, const fs::path& out_dir) {
+    FileReport r;
+    std::string text;
+    if(!read_text(path, &text)) {
+        r.status = "read-error";
+        return r;
+    }
+
+    uint8_t* image = NULL;
+    size_t image_size = 0;
+    const Clock::time_point t0 = Clock::now();
+    const bool compiled =
+        atm_parse_song_text_diag(text.c_str(), &image, &image_size, NULL, 0, &r.error);
+    r.compile_us =
+        (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+
+    if(!compiled) {
+        r.status = "compile-error";
+        return r;
+    }
+
+    r.image_size = image_size;
+    r.tracks = image[0];
+
+    AtmSongInfo info;
+    const Clock::time_point t1 = Clock::now();
+    const bool analyzed = atm_analyze_song(image, image_size, &info);
+    r.analyze_us =
+        (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t1).count();
+    if(!analyzed) {
+        r.status = "invalid-flow";
+    } else if(image_size > 64 * 1024) {
+        r.status = "too-big";
+    } else {
+        r.status = "ok";
+        r.duration_ms = info.duration_ms;
+        r.looped = info.looped;
+    }
+
+    if(r.status == "ok" && !out_dir.empty()) {
+        fs::path dst = out_dir / fs::relative(path, root);
+        dst += "c";
+        if(!write_image(dst, image, image_size)) r.status = "write-error";
+    }
+
+    free(image);
+    return r;
+}
+
+// Runs process_file() over rounds passes of files on threads workers; returns the wall time.
+static double run_batch(
+    const fs::path& root,
+    const std::vector<fs::path>& files,
+    const fs::path& out_dir,
+    size_t threads,
+    size_t rounds,
+    std::vector<FileReport>* reports) {
+    const size_t jobs = files.size() * rounds;
+    WorkStealingPool pool(threads);
+    for(size_t i = 0; i < jobs; i++) {
+        pool.push(i % threads, i);
+    }
+    reports->assign(files.size(), FileReport());
+    const Clock::time_point start = Clock::now();
+
+    std::vector<std::thread> workers;
+    for(size_t w = 0; w < threads; w++) {
+        workers.emplace_back([&, w]() {
+            size_t job;
+            while(pool.take(w, &job)) {
+                const size_t i = job % files.size();
+                FileReport r = process_file(root, files[i], out_dir);
+                if(job < files.size()) (*reports)[i] = std::move(r);
+            }
+        });
+    }
+    for(auto& t : workers)
+        t.join();
+
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t scale_rounds = 0;
+    fs::path out_dir;
+    fs::path root;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = std::max(1, atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+            scale_rounds = std::max(1, atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if(root.empty()) {
+            root = argv[i];
+        } else {
+            root.clear();
+            break;
+        }
+    }
+    if(root.empty()) {
+        fprintf(stderr, "usage: %s [-j threads] [-s rounds] [-o out_dir] <song dir>\n", argv[0]);
+        return 2;
+    }
+
+    const std::vector<fs::path> files = find_atm_files(root);
+    const size_t max_threads = threads;
+    if(threads > files.size()) threads = std::max<size_t>(1, files.size());
+
+    std::vector<FileReport> reports;
+    const double wall_s = files.empty() ? 0.0 : run_batch(root, files, out_dir, threads, 1, &reports);
+
+    size_t failed = 0;
+    uint64_t compile_us = 0;
+    uint64_t analyze_us = 0;
+    size_t slowest = files.size();
+    printf("status\tsize\ttracks\tduration_ms\tcompile_us\tanalyze_us\tpath\terror\n");
+    for(size_t i = 0; i < files.size(); i++) {
+        const FileReport& r = reports[i];
+        if(r.status != "ok") failed++;
+        compile_us += r.compile_us;
+        analyze_us += r.analyze_us;
+        if(slowest == files.size() || r.analyze_us > reports[slowest].analyze_us) slowest = i;
+        char error[96] = "";
+        if(r.status == "compile-error" && r.error.message) {
+            snprintf(error, sizeof(error), "%u:%u: %s", r.error.line, r.error.column, r.error.message);
+        }
+        printf(
+            "%s\t%zu\t%zu\t%u%s\t%llu\t%llu\t%s\t%s\n",
+            r.status.c_str(),
+            r.image_size,
+            r.tracks,
+            r.duration_ms,
+            r.looped ? "+" : "",
+            (unsigned long long)r.compile_us,
+            (unsigned long long)r.analyze_us,
+            files[i].string().c_str(),
+            error);
+    }
+
+    fprintf(
+        stderr,
+        "%zu files, %zu failed, %zu threads, %.3f s wall, %.0f files/s, %.1f us/file compile\n",
+        files.size(),
+        failed,
+        threads,
+        wall_s,
+        wall_s > 0 ? (double)files.size() / wall_s : 0.0,
+        files.empty() ? 0.0 : (double)compile_us / (double)files.size());
+    if(slowest < files.size()) {
+        fprintf(
+            stderr,
+            "%.1f us/file analysis, slowest %llu us: %s\n",
+            (double)analyze_us / (double)files.size(),
+            (unsigned long long)reports[slowest].analyze_us,
+            files[slowest].string().c_str());
+    }
+
+    if(scale_rounds && !files.empty()) {
+        std::vector<FileReport> scratch;
+        double one_s = 0;
+        for(size_t t = 1; t <= max_threads; t++) {
+            const double s = run_batch(root, files, fs::path(), t, scale_rounds, &scratch);
+            if(t == 1) one_s = s;
+            const double rate = s > 0 ? (double)(files.size() * scale_rounds) / s : 0.0;
+            fprintf(
+                stderr,
+                "%zu threads: %.0f files/s, %.2fx one thread\n",
+                t,
+                rate,
+                s > 0 ? one_s / s : 0.0);
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,191 @@
+// Host tool: records a song the way the player does while playing (ATMsynth::startRecording()),
+// onto a fake storage that is as slow as asked, and checks the file.
+//
+//   g++ -std=c++17 -O2 -pthread -o atm_capture tools/atm_capture.cpp ATMcapture.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp
+//   ./atm_capture [-t seconds] [-p block_us] [-w write_ms] [-s stall_ms] [-e every] [-x seed] [-o out.wav] <song.atm>
+//
+// An audio thread renders the song block by block, one every block_us microseconds (4096 is
+// real time, the default 500 runs faster), and feeds each block to the capture the way the DMA
+// interrupt does. A writer thread drains it every 20 ms like the player's. Each write to the
+// fake storage takes write_ms (2 by default) plus, on about one write in every (50), a stall of
+// up to stall_ms (200). The song plays for seconds (30) or to its end.
+//
+// Checks that the header is right and that the file holds exactly the blocks the capture took,
+// in order; reports the blocks dropped and the longest the audio thread spent feeding one. -o
+// keeps the file.
+
+#include "atm_host.h"
+
+#include "../lib/ATMcapture.h"
+#include "../lib/ATMengine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// The player's writer poll (ATM_CAPTURE_POLL_MS).
+static constexpr auto POLL = std::chrono::milliseconds(20);
+
+struct FakeStorage {
+    std::vector<uint8_t> file;
+    double write_ms;
+    double stall_ms;
+    uint32_t every;
+    uint64_t rng;
+    uint32_t writes;
+};
+
+static bool fake_write(void* ctx, uint32_t offset, const uint8_t* src, size_t size) {
+    FakeStorage* s = (FakeStorage*)ctx;
+    double ms = s->write_ms;
+    s->rng ^= s->rng << 13;
+    s->rng ^= s->rng >> 7;
+    s->rng ^= s->rng << 17;
+    if(s->every && s->rng % s->every == 0) ms += (double)(s->rng >> 32) / 4294967296.0 * s->stall_ms;
+    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms));
+
+    if(s->file.size() < offset + size) s->file.resize(offset + size);
+    memcpy(s->file.data() + offset, src, size);
+    s->writes++;
+    return true;
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool write_file(const char* path, const std::vector<uint8_t>& data) {
+    FILE* f = fopen(path, "wb");
+    if(!f) return false;
+    const bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char** argv) {
+    double seconds = 30;
+    double block_us = 500;
+    FakeStorage storage = {{}, 2, 200, 50, 1, 0};
+    const char* out_path = NULL;
+    uint64_t seed = 1;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-'; i++) {
+        if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if(!strcmp(argv[i], "-p") && i + 1 < argc) {
+            block_us = atof(argv[++i]);
+        } else if(!strcmp(argv[i], "-w") && i + 1 < argc) {
+            storage.write_ms = atof(argv[++i]);
+        } else if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+            storage.stall_ms = atof(argv[++i]);
+        } else if(!strcmp(argv[i], "-e") && i + 1 < argc) {
+            storage.every = (uint32_t)atoi(argv[++i]);
+        } else if(!strcmp(argv[i], "-x") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if(!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            break;
+        }
+    }
+    if(argc - i != 1) {
+        fprintf(
+            stderr,
+            "usage: %s [-t seconds] [-p block_us] [-w write_ms] [-s stall_ms] [-e every] [-x seed] "
+            "[-o out.wav] <song.atm>\n",
+            argv[0]);
+        return 2;
+    }
+    storage.rng = seed * 0x9E3779B97F4A7C15ull + 1;
+
+    std::string text;
+    uint8_t* song = NULL;
+    size_t song_size = 0;
+    if(!read_text(argv[i], &text) || !atm_parse_song_text(text.c_str(), &song, &song_size, NULL, 0)) {
+        fprintf(stderr, "%s: cannot read or compile\n", argv[i]);
+        return 1;
+    }
+
+    static AtmCapture capture;
+    if(!atm_capture_open(&capture, ATM_LOGICAL_HZ) ||
+       !atm_capture_begin(&capture, fake_write, &storage)) {
+        fprintf(stderr, "cannot start the capture\n");
+        return 1;
+    }
+
+    std::atomic<bool> quit(false);
+    std::thread writer([&] {
+        while(!quit.load(std::memory_order_acquire)) {
+            std::this_thread::sleep_for(POLL);
+            while(atm_capture_service(&capture, fake_write, &storage, false)) {
+            }
+        }
+    });
+
+    // The audio side, as atm_fill_half() does it: render, run the due ticks, feed.
+    static AtmEngine e;
+    atm_engine_init(&e);
+    atm_engine_load(&e, song);
+    const size_t blocks = (size_t)(seconds * ATM_LOGICAL_HZ / ATM_BLOCK_SAMPLES);
+    const auto period = std::chrono::duration<double, std::micro>(block_us);
+    std::vector<uint8_t> taken;
+    double worst_feed_us = 0;
+    size_t played = 0;
+    const Clock::time_point start = Clock::now();
+    for(; played < blocks && !e.song_ended; played++) {
+        std::this_thread::sleep_until(
+            start + std::chrono::duration_cast<Clock::duration>(period * (double)played));
+        AtmBlock block;
+        atm_engine_render(&e, block, ATM_BLOCK_SAMPLES);
+        while(e.tick_pending && !e.song_ended) {
+            e.tick_pending--;
+            atm_engine_tick(&e);
+        }
+
+        const uint32_t dropped = __atomic_load_n(&capture.dropped, __ATOMIC_RELAXED);
+        const Clock::time_point t0 = Clock::now();
+        atm_capture_feed(&capture, block);
+        const double us = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+        if(us > worst_feed_us) worst_feed_us = us;
+        if(capture.dropped == dropped) taken.insert(taken.end(), block, block + ATM_BLOCK_SAMPLES);
+    }
+
+    quit.store(true, std::memory_order_release);
+    writer.join();
+    const bool finished = atm_capture_finish(&capture, fake_write, &storage);
+
+    const std::vector<uint8_t>& f = storage.file;
+    const bool header_ok = f.size() >= ATM_CAPTURE_HEADER_SIZE && !memcmp(f.data(), "RIFF", 4) &&
+                           get_u32(f.data() + 4) == f.size() - 8 &&
+                           !memcmp(f.data() + 8, "WAVEfmt ", 8) &&
+                           get_u32(f.data() + 24) == ATM_LOGICAL_HZ &&
+                           !memcmp(f.data() + ATM_CAPTURE_HEADER_SIZE - 8, "data", 4) &&
+                           get_u32(f.data() + ATM_CAPTURE_HEADER_SIZE - 4) ==
+                               f.size() - ATM_CAPTURE_HEADER_SIZE;
+    const bool data_ok = f.size() == ATM_CAPTURE_HEADER_SIZE + taken.size() &&
+                         !memcmp(f.data() + ATM_CAPTURE_HEADER_SIZE, taken.data(), taken.size());
+
+    printf(
+        "%s: %zu blocks played, %u dropped, %zu bytes in %u writes, longest feed %.1f us\n",
+        argv[i],
+        played,
+        capture.dropped,
+        f.size(),
+        storage.writes,
+        worst_feed_us);
+    printf("header %s, samples %s\n", header_ok ? "ok" : "BAD", data_ok ? "match" : "DIFFER");
+
+    if(out_path && !write_file(out_path, f)) {
+        fprintf(stderr, "%s: cannot write\n", out_path);
+        return 1;
+    }
+    atm_capture_close(&capture);
+    free(song);
+    return finished && header_ok && data_ok ? 0 : 1;
+}
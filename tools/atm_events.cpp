@@ -0,0 +1,233 @@
+// Host tool: checks that music event timestamps (atm_poll_event()) match the rendered audio.
+//
+//   g++ -std=c++17 -O2 -o atm_events tools/atm_events.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp
+//   ./atm_events [-t seconds] <song dir>
+//
+// Each song is rendered per tone channel with the other channels muted, for seconds (60 by
+// default) or to its end, and the events of that channel are collected as they are queued. The
+// noise channel keeps sounding through rests, so it is left out. Every channel is rendered
+// twice: with each tick run right where it falls due, as atm_engine_run() does, where an event
+// is heard from pos; and block by block with the ticks in between, as the device does, where it
+// is heard from the first block boundary at or after pos. Against the channel's own output:
+//   - from a NoteOff (a rest or STOP) to the next NoteOn the output holds still, or slides
+//     toward the middle with the volume, but never swings across it;
+//   - a note (NoteOn with a volume, lasting at least MIN_RUNS half-waves) starts and ends on
+//     pos: the stretch of equal samples at either end is no longer than the longest one inside.
+// Events stamped a couple of samples early or late already break one or the other at some notes.
+// Queue overflows are reported too; none should happen with the queue drained every block.
+//
+// Prints the notes and rests checked and the mismatches per file, and the first few mismatches;
+// exits non-zero if there are any.
+
+#include "atm_host.h"
+
+#include "../lib/Blocks.h"
+#include "../lib/ATMengine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// Half-waves a note needs to have its ends checked.
+static constexpr size_t MIN_RUNS = 6;
+static constexpr int SHOW = 3;
+
+struct Check {
+    uint32_t notes;
+    uint32_t rests;
+    uint32_t bad;
+    uint32_t dropped;
+};
+
+// Length of the stretch of samples equal to pcm[at], going forward or backward from it.
+static size_t run_from(const std::vector<uint8_t>& pcm, size_t at, size_t end, bool back) {
+    size_t n = 1;
+    if(back) {
+        while(at >= n && at - n >= end && pcm[at - n] == pcm[at]) n++;
+    } else {
+        while(at + n < end && pcm[at + n] == pcm[at]) n++;
+    }
+    return n;
+}
+
+static void check_note(
+    const std::vector<uint8_t>& pcm,
+    size_t from,
+    size_t to,
+    Check* c,
+    const char* name,
+    uint8_t ch) {
+    // Interior runs: from the end of the first to the start of the last.
+    const size_t first = run_from(pcm, from, to, false);
+    const size_t last = run_from(pcm, to - 1, from, true);
+    if(first + last >= to - from) return;
+    size_t longest = 0;
+    size_t runs = 0;
+    for(size_t i = from + first; i < to - last;) {
+        const size_t n = run_from(pcm, i, to - last, false);
+        if(n > longest) longest = n;
+        runs++;
+        i += n;
+    }
+    if(runs + 2 < MIN_RUNS) return;
+
+    c->notes++;
+    // A note that faded out holds still at the end; only its start tells.
+    const bool faded = pcm[to - 1] == 128;
+    // Slides and vibrato stretch half-waves a little.
+    const size_t most = longest + longest / 8 + 1;
+    if(first > most || (!faded && last > most)) {
+        if(c->bad++ < SHOW)
+            printf(
+                "%s: channel %u note at %zu..%zu: ends hold %zu and %zu samples, half-wave %zu\n",
+                name,
+                ch,
+                from,
+                to,
+                first,
+                last,
+                longest);
+    }
+}
+
+// A rest freezes the channel's square wave where it was; a volume slide may still move its level
+// toward the middle, but it never crosses over the way a wave does.
+static void check_rest(
+    const std::vector<uint8_t>& pcm,
+    size_t from,
+    size_t to,
+    Check* c,
+    const char* name,
+    uint8_t ch) {
+    c->rests++;
+    int side = 0;
+    for(size_t i = from; i < to; i++) {
+        const int s = pcm[i] > 128 ? 1 : pcm[i] < 128 ? -1 : 0;
+        if(!side) side = s;
+        if(s && s != side) {
+            if(c->bad++ < SHOW)
+                printf("%s: channel %u rest at %zu..%zu: sound at %zu\n", name, ch, from, to, i);
+            return;
+        }
+    }
+}
+
+// Runs the due ticks, keeping all but channel ch muted: a song that loops unmutes its channels.
+static void run_ticks(AtmEngine* e, uint8_t ch) {
+    while(e->tick_pending && !e->song_ended) {
+        e->tick_pending--;
+        atm_engine_tick(e);
+    }
+    e->ChannelActiveMute |= (uint8_t)(0x0F & ~(1 << ch));
+    for(uint8_t n = 0; n < 4; n++) {
+        if(n != ch) e->osc[n].vol = 0;
+    }
+}
+
+static void check_channel(
+    const uint8_t* song,
+    uint8_t ch,
+    size_t limit,
+    bool blocks,
+    Check* c,
+    const char* name) {
+    static AtmEngine e;
+    atm_engine_init(&e);
+    atm_engine_load(&e, song);
+    run_ticks(&e, ch);
+    e.events_enabled = true;
+
+    std::vector<uint8_t> pcm;
+    std::vector<AtmMusicEvent> events;
+    AtmBlock block;
+    while(pcm.size() < limit && !e.song_ended) {
+        if(blocks) {
+            atm_engine_render(&e, block, ATM_BLOCK_SAMPLES);
+            run_ticks(&e, ch);
+        } else {
+            // As atm_engine_run() does it: each tick before the sample after it falls due.
+            for(size_t done = 0; done < ATM_BLOCK_SAMPLES;) {
+                size_t n = e.tick_acc < e.tick_period ? e.tick_period - e.tick_acc : 1;
+                if(n > ATM_BLOCK_SAMPLES - done) n = ATM_BLOCK_SAMPLES - done;
+                atm_engine_render(&e, block + done, n);
+                done += n;
+                run_ticks(&e, ch);
+            }
+        }
+        pcm.insert(pcm.end(), block, block + ATM_BLOCK_SAMPLES);
+        AtmMusicEvent ev;
+        while(atm_event_pop(&e.events, &ev)) {
+            if(ev.ch == ch) events.push_back(ev);
+        }
+    }
+    c->dropped += e.events.dropped;
+
+    // Events stamped past what was rendered have nothing to check against.
+    bool started = false;
+    bool sounding = false;
+    bool audible = false;
+    size_t since = 0;
+    for(const AtmMusicEvent& ev : events) {
+        if(ev.type != AtmMusicNoteOn && ev.type != AtmMusicNoteOff) continue;
+        // Rendered in blocks, what a tick changes is heard from the block after it fell due.
+        size_t heard = ev.pos;
+        if(blocks) heard = (heard + ATM_BLOCK_SAMPLES - 1) / ATM_BLOCK_SAMPLES * ATM_BLOCK_SAMPLES;
+        if(heard > pcm.size()) break;
+        if(started && heard > since) {
+            if(!sounding) check_rest(pcm, since, heard, c, name, ch);
+            if(sounding && audible) check_note(pcm, since, heard, c, name, ch);
+        }
+        started = true;
+        sounding = ev.type == AtmMusicNoteOn;
+        audible = ev.vol > 0;
+        since = heard;
+    }
+}
+
+int main(int argc, char** argv) {
+    double seconds = 60;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-'; i++) {
+        if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else {
+            break;
+        }
+    }
+    if(argc - i != 1) {
+        fprintf(stderr, "usage: %s [-t seconds] <song dir>\n", argv[0]);
+        return 2;
+    }
+
+    const size_t limit = (size_t)(seconds * ATM_LOGICAL_HZ);
+    uint32_t bad = 0;
+    for(const auto& path : find_atm_files(argv[i])) {
+        const std::string name = path.string();
+        std::string text;
+        uint8_t* song = NULL;
+        size_t song_size = 0;
+        if(!read_text(path, &text) || !atm_parse_song_text(text.c_str(), &song, &song_size, NULL, 0)) {
+            printf("%s: cannot read or compile\n", name.c_str());
+            bad++;
+            continue;
+        }
+        Check c = {0, 0, 0, 0};
+        for(uint8_t ch = 0; ch < 3; ch++) {
+            check_channel(song, ch, limit, false, &c, name.c_str());
+            check_channel(song, ch, limit, true, &c, name.c_str());
+        }
+        printf(
+            "%s: %u notes, %u rests, %u mismatches, %u events dropped\n",
+            name.c_str(),
+            c.notes,
+            c.rests,
+            c.bad,
+            c.dropped);
+        bad += c.bad + c.dropped;
+        free(song);
+    }
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,366 @@
+// Host tool: coverage-guided fuzzer for the player's tick loop. Every input is turned into a
+// valid ATM1 text song (tracks calling each other, tempo changes, repeat points), compiled, and
+// played tick by tick without synthesis. It reports the most commands a tick ran without the
+// player stopping a channel, and the songs it had to stop channels of, next to what the load-time
+// loop check (atm_find_delay_free_cycle()) said about them.
+//
+//   g++ -std=c++17 -O2 -fsanitize-coverage=trace-pc -c ATMengine.cpp ATMpager.cpp ATMparse.cpp ATManalyze.cpp
+//   g++ -std=c++17 -O2 -o atm_fuzz tools/atm_fuzz.cpp ATMengine.o ATMpager.o ATMparse.o ATManalyze.o
+//   ./atm_fuzz [-n execs] [-s seed] [-t ticks] [-o worst.atm]
+//
+// Only the player sources are instrumented, so coverage means paths through the parser, the
+// engine and the analyzer. Built without the flag the search still runs, keeping only inputs
+// that raise the worst tick. -t is how many ticks each song plays (default 1000); -o writes the
+// song with the worst tick. With -DATM_FUZZ_LIBFUZZER and clang's -fsanitize=fuzzer instead, the
+// file is a libFuzzer target and the report comes at exit.
+
+#include "../lib/ATMengine.h"
+#include "../lib/ATMparse.h"
+#include "../lib/ATManalyze.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+static constexpr size_t MAX_INPUT = 512;
+static constexpr uint8_t MAX_TRACKS = 8;
+static constexpr uint8_t MAX_TRACK_COMMANDS = 48;
+
+
+struct InputReader {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+
+    bool done() const {
+        return pos >= size;
+    }
+
+    uint8_t next() {
+        return pos < size ? data[pos++] : 0;
+    }
+};
+
+// The song an input stands for. Every byte sequence makes a song that compiles.
+static std::string input_to_song(const uint8_t* data, size_t size) {
+    InputReader in = {data, size, 0};
+    const uint8_t tracks = (uint8_t)(1 + in.next() % MAX_TRACKS);
+    std::string s = "ATM1\nENTRY";
+    for(uint8_t n = 0; n < 4; n++) {
+        s += " " + std::to_string(in.next() % tracks);
+    }
+    s += "\n";
+
+    char line[64];
+    for(uint8_t t = 0; t < tracks; t++) {
+        s += "TRACK # " + std::to_string(t) + "\n";
+        bool ended = false;
+        for(uint8_t i = 0; i < MAX_TRACK_COMMANDS && !ended && !in.done(); i++) {
+            const uint8_t a = in.next();
+            const uint8_t b = in.next();
+            switch(in.next() % 16) {
+            case 0:
+            case 1:
+                snprintf(line, sizeof(line), "NOTE %u\n", a % 64);
+                break;
+            case 2:
+            case 3:
+                // Past 64 ticks a delay is the variable-length form.
+                snprintf(line, sizeof(line), "DELAY %u\n", 1 + a % 80);
+                break;
+            case 4:
+                snprintf(line, sizeof(line), "SET_VOLUME %u\n", a % 64);
+                break;
+            case 5:
+                snprintf(line, sizeof(line), "GOTO %u\n", a % tracks);
+                break;
+            case 6:
+                snprintf(line, sizeof(line), "REPEAT %u %u\n", b % 8, a % tracks);
+                break;
+            case 7:
+                snprintf(line, sizeof(line), "RETURN\n");
+                ended = true;
+                break;
+            case 8:
+                snprintf(line, sizeof(line), "STOP\n");
+                ended = true;
+                break;
+            case 9:
+                snprintf(line, sizeof(line), "SET_TEMPO %u\n", 1 + a % 48);
+                break;
+            case 10:
+                snprintf(line, sizeof(line), "ADD_TEMPO %u\n", a % 8);
+                break;
+            case 11:
+                snprintf(line, sizeof(line), "VOLUME_SLIDE_ON %u\n", a % 8);
+                break;
+            case 12:
+                snprintf(line, sizeof(line), "SET_VIBRATO %u %u\n", a % 16, b % 16);
+                break;
+            case 13:
+                snprintf(line, sizeof(line), "SET_TRANSPOSITION %u\n", a % 13);
+                break;
+            case 14:
+                snprintf(line, sizeof(line), "SET_NOTE_CUT %u\n", a % 8);
+                break;
+            default:
+                snprintf(
+                    line,
+                    sizeof(line),
+                    "GOTO_ADVANCED %u %u %u %u\n",
+                    a % tracks,
+                    b % tracks,
+                    in.next() % tracks,
+                    in.next() % tracks);
+                break;
+            }
+            s += line;
+        }
+        if(!ended) s += "RETURN\n";
+        s += "ENDTRACK\n";
+    }
+    s += "END\n";
+    return s;
+}
+
+struct RunResult {
+    bool compiled;
+    // Most commands in a tick that stopped no channel.
+    uint32_t worst_tick;
+    // A channel was stopped at the command limit, or when a call found the stack full.
+    bool over_limit;
+    bool out_of_stack;
+    bool cycle;
+};
+
+static uint32_t run_ticks = 1000;
+
+static RunResult run_input(const uint8_t* data, size_t size) {
+    static AtmEngine e;
+    RunResult r = {};
+    const std::string text = input_to_song(data, size);
+
+    uint8_t* song = NULL;
+    size_t song_size = 0;
+    if(!atm_parse_song_text(text.c_str(), &song, &song_size, NULL, 0)) return r;
+    r.compiled = true;
+    uint8_t track;
+    r.cycle = atm_find_delay_free_cycle(song, song_size, &track);
+
+    atm_engine_init(&e);
+    atm_engine_load(&e, song);
+    for(uint32_t i = 0; i < run_ticks && !e.song_ended; i++) {
+        const uint8_t runaway = e.runaway;
+        atm_engine_tick(&e);
+        if(e.runaway == runaway) {
+            if(e.tick_commands > r.worst_tick) r.worst_tick = e.tick_commands;
+        } else {
+            if(e.tick_commands >= ATM_STEP_MAX_COMMANDS) {
+                r.over_limit = true;
+            } else {
+                r.out_of_stack = true;
+            }
+        }
+    }
+    free(song);
+    return r;
+}
+
+struct Report {
+    uint64_t execs;
+    uint64_t failed;
+    uint64_t over_limit;
+    uint64_t over_limit_flagged;
+    uint64_t out_of_stack;
+    uint64_t flagged_quiet;
+    uint32_t worst_tick;
+    std::vector<uint8_t> worst_input;
+};
+
+static Report report;
+
+static void report_add(const RunResult& r, const uint8_t* data, size_t size) {
+    report.execs++;
+    if(!r.compiled) {
+        report.failed++;
+        return;
+    }
+    if(r.over_limit) {
+        report.over_limit++;
+        if(r.cycle) report.over_limit_flagged++;
+    }
+    if(r.out_of_stack) report.out_of_stack++;
+    if(r.cycle && !r.over_limit && !r.out_of_stack) report.flagged_quiet++;
+    if(r.worst_tick > report.worst_tick || report.worst_input.empty()) {
+        report.worst_tick = r.worst_tick;
+        report.worst_input.assign(data, data + size);
+    }
+}
+
+static void report_print(size_t corpus, size_t edges) {
+    printf("execs %llu, corpus %zu, edges %zu\n", (unsigned long long)report.execs, corpus, edges);
+    printf(
+        "worst tick that stopped no channel: %u commands (limit %u per channel)\n",
+        report.worst_tick,
+        (unsigned)ATM_STEP_MAX_COMMANDS);
+    printf(
+        "songs stopped at the command limit: %llu, %llu of them flagged by the loop check\n",
+        (unsigned long long)report.over_limit,
+        (unsigned long long)report.over_limit_flagged);
+    printf("songs stopped with the call stack full: %llu\n", (unsigned long long)report.out_of_stack);
+    printf(
+        "flagged songs that ran %u ticks without being stopped: %llu\n",
+        run_ticks,
+        (unsigned long long)report.flagged_quiet);
+    if(report.failed) printf("inputs that did not compile: %llu\n", (unsigned long long)report.failed);
+}
+
+#ifdef ATM_FUZZ_LIBFUZZER
+
+static void report_at_exit(void) {
+    report_print(0, 0);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static bool registered = false;
+    if(!registered) {
+        atexit(report_at_exit);
+        registered = true;
+    }
+    if(size > MAX_INPUT) return 0;
+    report_add(run_input(data, size), data, size);
+    return 0;
+}
+
+#else
+
+static constexpr size_t MAP_SIZE = 1 << 16;
+
+// Edges hit by the current run, as in AFL: the hash of each pc with the one before it.
+static uint8_t cov_run[MAP_SIZE];
+static uintptr_t cov_prev;
+
+extern "C" __attribute__((no_sanitize_coverage)) void __sanitizer_cov_trace_pc(void) {
+    const uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+    cov_run[(pc ^ cov_prev) & (MAP_SIZE - 1)] = 1;
+    cov_prev = pc >> 1;
+}
+
+static uint64_t rng_state;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 32);
+}
+
+static std::vector<uint8_t> mutate(const std::vector<std::vector<uint8_t>>& corpus) {
+    std::vector<uint8_t> in = corpus[rng() % corpus.size()];
+    const uint32_t rounds = 1 + rng() % 4;
+    for(uint32_t i = 0; i < rounds; i++) {
+        const size_t at = in.empty() ? 0 : rng() % in.size();
+        switch(rng() % 6) {
+        case 0:
+            if(!in.empty()) in[at] ^= (uint8_t)(1 << (rng() % 8));
+            break;
+        case 1:
+            if(!in.empty()) in[at] = (uint8_t)rng();
+            break;
+        case 2:
+            in.insert(in.begin() + at, (uint8_t)rng());
+            break;
+        case 3:
+            if(!in.empty()) in.erase(in.begin() + at);
+            break;
+        case 4: {
+            // Repeat a run of commands (three bytes each).
+            const size_t len = 3 * (1 + rng() % 4);
+            if(at + len <= in.size()) {
+                std::vector<uint8_t> run(in.begin() + at, in.begin() + at + len);
+                in.insert(in.begin() + at, run.begin(), run.end());
+            }
+            break;
+        }
+        default: {
+            // Splice in the tail of another input.
+            const std::vector<uint8_t>& other = corpus[rng() % corpus.size()];
+            if(!other.empty()) {
+                in.resize(at);
+                in.insert(in.end(), other.begin() + rng() % other.size(), other.end());
+            }
+            break;
+        }
+        }
+    }
+    if(in.size() > MAX_INPUT) in.resize(MAX_INPUT);
+    return in;
+}
+
+int main(int argc, char** argv) {
+    uint64_t execs = 200000;
+    uint64_t seed = 1;
+    const char* out_path = NULL;
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-n") && i + 1 < argc) {
+            execs = strtoull(argv[++i], NULL, 10);
+        } else if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            run_ticks = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-n execs] [-s seed] [-t ticks] [-o worst.atm]\n", argv[0]);
+            return 2;
+        }
+    }
+    rng_state = seed * 0x9E3779B97F4A7C15ull + 1;
+
+    static uint8_t cov_seen[MAP_SIZE];
+    size_t edges = 0;
+    std::vector<std::vector<uint8_t>> corpus;
+    for(uint8_t i = 0; i < 16; i++) {
+        std::vector<uint8_t> in(3 * (4 + rng() % 32));
+        for(uint8_t& b : in)
+            b = (uint8_t)rng();
+        corpus.push_back(in);
+    }
+
+    for(uint64_t n = 0; n < execs; n++) {
+        const std::vector<uint8_t> in = mutate(corpus);
+        memset(cov_run, 0, sizeof(cov_run));
+        cov_prev = 0;
+        const uint32_t worst = report.worst_tick;
+        const RunResult r = run_input(in.data(), in.size());
+        report_add(r, in.data(), in.size());
+
+        bool keep = r.worst_tick > worst;
+        for(size_t i = 0; i < MAP_SIZE; i++) {
+            if(cov_run[i] && !cov_seen[i]) {
+                cov_seen[i] = 1;
+                edges++;
+                keep = true;
+            }
+        }
+        if(keep) corpus.push_back(in);
+    }
+    report_print(corpus.size(), edges);
+
+    if(out_path) {
+        const std::string text =
+            input_to_song(report.worst_input.data(), report.worst_input.size());
+        FILE* f = fopen(out_path, "w");
+        if(!f || fputs(text.c_str(), f) < 0 || fclose(f) != 0) {
+            fprintf(stderr, "%s: cannot write\n", out_path);
+            return 1;
+        }
+        printf("wrote %s\n", out_path);
+    }
+    return 0;
+}
+
+#endif
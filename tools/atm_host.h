@@ -0,0 +1,86 @@
+#pragma once
+
+// Shared pieces of the host tools. Not part of the app build.
+
+#include "../lib/ATMparse.h"
+
+#include <algorithm>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Each worker owns a deque of job indices, takes work from its front and, once empty, steals
+// from the back of the others. Jobs are dealt out round-robin, so stealing only evens out the
+// tail where some songs are much bigger than others.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(size_t workers)
+        : queues_(workers) {
+    }
+
+    void push(size_t worker, size_t job) {
+        queues_[worker].jobs.push_back(job);
+    }
+
+    bool take(size_t worker, size_t* job) {
+        if(pop_front(worker, job)) return true;
+        for(size_t i = 1; i < queues_.size(); i++) {
+            if(pop_back((worker + i) % queues_.size(), job)) return true;
+        }
+        return false;
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> jobs;
+    };
+
+    std::vector<Queue> queues_;
+
+    bool pop_front(size_t q, size_t* job) {
+        std::lock_guard<std::mutex> guard(queues_[q].lock);
+        if(queues_[q].jobs.empty()) return false;
+        *job = queues_[q].jobs.front();
+        queues_[q].jobs.pop_front();
+        return true;
+    }
+
+    bool pop_back(size_t q, size_t* job) {
+        std::lock_guard<std::mutex> guard(queues_[q].lock);
+        if(queues_[q].jobs.empty()) return false;
+        *job = queues_[q].jobs.back();
+        queues_[q].jobs.pop_back();
+        return true;
+    }
+};
+
+static inline bool has_atm_ext(const std::filesystem::path& p) {
+    std::string ext = p.extension().string();
+    if(ext.size() != 4) return false;
+    return ext[0] == '.' && atm_char_upper(ext[1]) == 'A' && atm_char_upper(ext[2]) == 'T' &&
+           atm_char_upper(ext[3]) == 'M';
+}
+
+static inline bool read_text(const std::filesystem::path& path, std::string* out) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return false;
+    std::stringstream ss;
+    ss << in.rdbuf();
+    *out = ss.str();
+    return true;
+}
+
+// Every .atm file under root, sorted so reports come out in a stable order.
+static inline std::vector<std::filesystem::path> find_atm_files(const std::filesystem::path& root) {
+    std::vector<std::filesystem::path> files;
+    for(const auto& e : std::filesystem::recursive_directory_iterator(root)) {
+        if(e.is_regular_file() && has_atm_ext(e.path())) files.push_back(e.path());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+// Lane renderer for the host tools: ATM_LANES independent songs synthesized side by side, one
+// song per SIMD lane. Not part of the app build.
+//
+// Each lane is an ordinary AtmEngine. Ticks stay scalar and run on that engine; only the
+// per-sample work (oscillators, mix, gain, clamp) is vectorized, over structure-of-arrays copies
+// of the four oscillators. The vectors are GCC vector extensions: -O2 alone gives SSE2, -mavx2
+// one register per vector. Output is bit-identical to atm_engine_run() on the same engine.
+// Meters are not updated.
+
+#include "../lib/ATMengine.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ATM_LANES 8
+
+static_assert(ATM_VOICES == 4, "the lanes synthesize the four-voice mix");
+#define ATM_LANES_SEGMENT_MAX 4096
+
+typedef int32_t AtmLaneI __attribute__((vector_size(ATM_LANES * sizeof(int32_t))));
+typedef uint32_t AtmLaneU __attribute__((vector_size(ATM_LANES * sizeof(uint32_t))));
+
+struct AtmLanes {
+    // NULL for an idle lane.
+    AtmEngine* engine[ATM_LANES];
+    // Tone mode of every lane; lanes cannot mix modes.
+    bool uniform;
+
+    // Oscillator state of the lanes, osc[n] of lane l in element l of each vector. vol holds
+    // the signed 8-bit value the mixer starts from, noise the LFSR in osc[3].freq.
+    AtmLaneU phase[4];
+    AtmLaneU inc[4];
+    AtmLaneI vol[4];
+    AtmLaneI noise;
+    AtmLaneI gain;
+
+    // Where the samples of lanes that sit a segment out go.
+    uint8_t scratch[ATM_LANES][ATM_LANES_SEGMENT_MAX];
+};
+
+// Macros rather than functions: vectors wider than the enabled ISA cannot be passed by value
+// without an ABI warning.
+#define ATM_LANE_SEXT8(x) (((x) << 24) >> 24)
+// Applies the sign mask neg (all ones or zero per lane) the way the mixer negates an int8_t.
+#define ATM_LANE_SIGN(v, neg) ATM_LANE_SEXT8(((v) ^ (neg)) - (neg))
+
+static inline void atm_lanes_load(AtmLanes* s, size_t l) {
+    const AtmEngine* e = s->engine[l];
+    for(uint8_t n = 0; n < 4; n++) {
+        s->phase[n][l] = e->osc[n].phase;
+        s->inc[n][l] = e->osc[n].inc;
+        s->vol[n][l] = (int8_t)e->osc[n].vol;
+    }
+    s->noise[l] = e->osc[3].freq;
+    s->gain[l] = e->master_gain_q8;
+}
+
+static inline void atm_lanes_store(const AtmLanes* s, size_t l) {
+    AtmEngine* e = s->engine[l];
+    for(uint8_t n = 0; n < 4; n++) {
+        e->osc[n].phase = s->phase[n][l];
+    }
+    if(!s->uniform) e->osc[3].freq = (uint16_t)s->noise[l];
+}
+
+// Renders count samples of every lane, sample i of lane l to out[l][i]. Every lane advances,
+// idle ones included; atm_lanes_run() puts back the state of those that sit out.
+template <bool uniform>
+static inline void atm_lanes_synth(AtmLanes* s, uint8_t* const out[ATM_LANES], size_t count) {
+    AtmLaneU p0 = s->phase[0], p1 = s->phase[1], p2 = s->phase[2], p3 = s->phase[3];
+    const AtmLaneU i0 = s->inc[0], i1 = s->inc[1], i2 = s->inc[2], i3 = s->inc[3];
+    const AtmLaneI v0 = s->vol[0], v1 = s->vol[1], v2 = s->vol[2], v3 = s->vol[3];
+    const AtmLaneI gain = s->gain;
+    AtmLaneI noise = s->noise;
+
+    for(size_t i = 0; i < count; i++) {
+        AtmLaneI mix;
+        if(uniform) {
+            p0 += i0;
+            p1 += i1;
+            p2 += i2;
+            p3 += i3;
+            mix = ATM_LANE_SIGN(v0, (AtmLaneI)p0 >> 31) + ATM_LANE_SIGN(v1, (AtmLaneI)p1 >> 31) +
+                  ATM_LANE_SIGN(v2, (AtmLaneI)p2 >> 31) + ATM_LANE_SIGN(v3, (AtmLaneI)p3 >> 31);
+        } else {
+            // Triangle: fold the top byte of the phase, then scale by the volume.
+            p2 += i2;
+            AtmLaneI t = (AtmLaneI)p2 >> 24;
+            t ^= t >> 31;
+            t = (t << 25) >> 24;
+            t = ATM_LANE_SEXT8(t - 128);
+            const AtmLaneI c2 = ATM_LANE_SEXT8(((t * v2) << 1) >> 8);
+
+            p0 += i0;
+            const AtmLaneI c0 = ATM_LANE_SIGN(v0, (AtmLaneI)(p0 >= 0xC0000000u));
+
+            p1 += i1;
+            const AtmLaneI c1 = ATM_LANE_SIGN(v1, (AtmLaneI)p1 >> 31);
+
+            noise = (noise << 1) & 0xFFFF;
+            noise ^= ((noise >> 15) ^ (noise >> 14)) & 1;
+            const AtmLaneI c3 = ATM_LANE_SIGN(v3, -(noise >> 15));
+
+            mix = c2 + c0 + c1 + c3;
+        }
+
+        AtmLaneI c = (mix * gain) >> (uniform ? 10 : 9);
+        c = c > 127 ? 127 : c;
+        c = c < -127 ? -127 : c;
+        c += 128;
+        for(size_t l = 0; l < ATM_LANES; l++) {
+            out[l][i] = (uint8_t)c[l];
+        }
+    }
+
+    s->phase[0] = p0;
+    s->phase[1] = p1;
+    s->phase[2] = p2;
+    s->phase[3] = p3;
+    s->noise = noise;
+}
+
+// atm_engine_run() for every lane: renders lane l into out[l] until it has limit[l] samples or
+// its song ends, running each lane's ticks between samples exactly where atm_engine_run() would.
+// Returns the samples written per lane in done[]. Engines must not be touched while their lane
+// runs, gain and tone mode included.
+static inline void atm_lanes_run(
+    AtmLanes* s,
+    uint8_t* const out[ATM_LANES],
+    const size_t limit[ATM_LANES],
+    size_t done[ATM_LANES]) {
+    for(size_t l = 0; l < ATM_LANES; l++) {
+        done[l] = 0;
+        if(s->engine[l]) atm_lanes_load(s, l);
+    }
+
+    while(true) {
+        // A segment ends at the earliest tick boundary or limit of any lane still running.
+        size_t seg = SIZE_MAX;
+        bool live[ATM_LANES];
+        for(size_t l = 0; l < ATM_LANES; l++) {
+            AtmEngine* e = s->engine[l];
+            live[l] = e && !e->song_ended && done[l] < limit[l];
+            if(!live[l]) continue;
+            size_t n = e->tick_acc < e->tick_period ? e->tick_period - e->tick_acc : 1;
+            if(n > limit[l] - done[l]) n = limit[l] - done[l];
+            if(n < seg) seg = n;
+        }
+        if(seg == SIZE_MAX) break;
+        if(seg > ATM_LANES_SEGMENT_MAX) seg = ATM_LANES_SEGMENT_MAX;
+
+        uint8_t* dst[ATM_LANES];
+        for(size_t l = 0; l < ATM_LANES; l++) {
+            dst[l] = live[l] ? out[l] + done[l] : s->scratch[l];
+        }
+
+        // Lanes that sit out keep their state: save and restore it around the segment.
+        AtmLaneU saved_phase[4];
+        AtmLaneI saved_noise = s->noise;
+        for(uint8_t n = 0; n < 4; n++) {
+            saved_phase[n] = s->phase[n];
+        }
+        if(s->uniform) {
+            atm_lanes_synth<true>(s, dst, seg);
+        } else {
+            atm_lanes_synth<false>(s, dst, seg);
+        }
+
+        for(size_t l = 0; l < ATM_LANES; l++) {
+            if(!live[l]) {
+                for(uint8_t n = 0; n < 4; n++) {
+                    s->phase[n][l] = saved_phase[n][l];
+                }
+                s->noise[l] = saved_noise[l];
+                continue;
+            }
+
+            AtmEngine* e = s->engine[l];
+            done[l] += seg;
+            e->tick_acc += (uint32_t)seg;
+            if(e->tick_acc < e->tick_period) continue;
+            e->tick_acc = 0;
+
+            atm_lanes_store(s, l);
+            atm_engine_tick(e);
+            atm_lanes_load(s, l);
+        }
+    }
+
+    for(size_t l = 0; l < ATM_LANES; l++) {
+        if(s->engine[l]) atm_lanes_store(s, l);
+    }
+}
@@ -0,0 +1,239 @@
+// Host tool: compiles an ATM1 text song into a paged image (ATMP, see lib/ATMpager.h), and
+// checks that it plays from slow storage exactly as it does from RAM.
+//
+//   g++ -std=c++17 -O2 -o atm_page tools/atm_page.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp
+//   ./atm_page long_song.atm long_song_paged.atm
+//   ./atm_page -s 20 long_song.atm
+//
+// -s ms plays the song the way the device does, with a reader that takes ms milliseconds per
+// page: 128-sample blocks, after each block the due ticks that find their pages cached, each
+// followed by the prefetch. The result is compared sample by sample against the same loop on
+// the classic image in RAM, or, for songs over 64 KB, on the paged image with instant reads.
+// -t limits the song to that many seconds (default 120).
+
+#include "../lib/ATMengine.h"
+#include "../lib/ATMparse.h"
+#include "../lib/ATMpager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static constexpr size_t BLOCK_SAMPLES = 128;
+static constexpr uint32_t LOOKAHEAD_TICKS = 8;
+
+// Serial reader with a fixed latency per page, serving the pager from the image in memory.
+struct SimReader {
+    const std::vector<uint8_t>* image;
+    uint64_t latency;
+    bool busy;
+    uint64_t done_at;
+};
+
+static bool sim_read(void* ctx, uint32_t offset, uint8_t* dst, size_t size) {
+    const std::vector<uint8_t>* image = (const std::vector<uint8_t>*)ctx;
+    if(offset > image->size() || size > image->size() - offset) return false;
+    memcpy(dst, image->data() + offset, size);
+    return true;
+}
+
+// Finishes the reads due by now and starts the next one. Returns true if a page arrived.
+static bool sim_reader_step(SimReader* r, AtmPager* p, uint64_t now) {
+    bool arrived = false;
+    while(true) {
+        if(!r->busy) {
+            if(!atm_pager_pending(p)) break;
+            r->busy = true;
+            r->done_at = now + r->latency;
+        }
+        if(r->done_at > now) break;
+        atm_pager_service(p, sim_read, (void*)r->image);
+        r->busy = false;
+        arrived = true;
+    }
+    return arrived;
+}
+
+struct SimStats {
+    uint32_t ticks;
+    uint32_t late_ticks;
+    uint64_t max_late;
+};
+
+// Renders up to limit samples of e with the device's tick loop. pager and reader are NULL for a
+// song in RAM.
+static std::vector<uint8_t> sim_play(
+    AtmEngine* e,
+    AtmPager* pager,
+    SimReader* reader,
+    size_t limit,
+    SimStats* stats) {
+    static AtmEngine scratch;
+    std::vector<uint8_t> out;
+    memset(stats, 0, sizeof(*stats));
+    bool stalled = false;
+    uint64_t stalled_at = 0;
+
+    // Like the player, read the pages of the first tick before starting.
+    if(pager) {
+        for(int i = 0; i < 16 && !atm_engine_tick_ready(e, &scratch); i++) {
+            while(atm_pager_service(pager, sim_read, (void*)reader->image)) {
+            }
+        }
+        atm_engine_prefetch(e, &scratch, LOOKAHEAD_TICKS);
+    }
+    while(out.size() < limit && !e->song_ended) {
+        uint8_t block[BLOCK_SAMPLES];
+        atm_engine_render(e, block, BLOCK_SAMPLES);
+        out.insert(out.end(), block, block + BLOCK_SAMPLES);
+        const uint64_t now = out.size();
+
+        while(true) {
+            const bool arrived = pager && sim_reader_step(reader, pager, now);
+            bool ticked = false;
+            while(e->tick_pending && !e->song_ended) {
+                if(!atm_engine_tick_ready(e, &scratch)) {
+                    if(!stalled) stalled_at = now;
+                    stalled = true;
+                    break;
+                }
+                if(stalled) {
+                    stats->late_ticks++;
+                    if(now - stalled_at > stats->max_late) stats->max_late = now - stalled_at;
+                    stalled = false;
+                }
+                e->tick_pending--;
+                atm_engine_tick(e);
+                stats->ticks++;
+                ticked = true;
+                if(pager) atm_engine_prefetch(e, &scratch, LOOKAHEAD_TICKS);
+            }
+            if(!arrived && !ticked) break;
+        }
+        if(pager && pager->error) {
+            fprintf(stderr, "pager error at sample %zu\n", out.size());
+            break;
+        }
+    }
+    if(out.size() > limit) out.resize(limit);
+    return out;
+}
+
+static bool write_file(const char* path, const uint8_t* data, size_t size) {
+    FILE* f = fopen(path, "wb");
+    if(!f) return false;
+    const bool ok = fwrite(data, 1, size, f) == size;
+    return fclose(f) == 0 && ok;
+}
+
+static double samples_ms(uint64_t samples) {
+    return (double)samples * 1000.0 / ATM_LOGICAL_HZ;
+}
+
+int main(int argc, char** argv) {
+    double latency_ms = -1;
+    double seconds = 120;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-'; i++) {
+        if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+            latency_ms = atof(argv[++i]);
+        } else if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else {
+            break;
+        }
+    }
+    if(argc - i < 1 || argc - i > 2 || (argc - i == 1 && latency_ms < 0)) {
+        fprintf(stderr, "usage: %s [-s latency_ms] [-t seconds] <song.atm> [<out.atm>]\n", argv[0]);
+        return 2;
+    }
+
+    std::ifstream in(argv[i], std::ios::binary);
+    if(!in) {
+        fprintf(stderr, "%s: cannot read\n", argv[i]);
+        return 1;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    const std::string text = ss.str();
+
+    uint8_t* buf = NULL;
+    size_t size = 0;
+    if(!atm_parse_song_text_paged(text.c_str(), &buf, &size, NULL, 0)) {
+        fprintf(stderr, "%s: compile error\n", argv[i]);
+        return 1;
+    }
+    std::vector<uint8_t> image(buf, buf + size);
+    free(buf);
+
+    AtmPager* pager = new AtmPager;
+    if(!atm_pager_open(pager, image.data(), image.size())) {
+        fprintf(stderr, "%s: bad paged image\n", argv[i]);
+        return 1;
+    }
+    printf("%s: %u tracks, %u bytes of track data\n", argv[i], pager->track_count, pager->data_size);
+
+    if(argc - i == 2) {
+        if(!write_file(argv[i + 1], image.data(), image.size())) {
+            fprintf(stderr, "%s: cannot write\n", argv[i + 1]);
+            return 1;
+        }
+        printf("wrote %s (%zu bytes)\n", argv[i + 1], image.size());
+    }
+    if(latency_ms < 0) return 0;
+
+    const size_t limit = (size_t)(seconds * ATM_LOGICAL_HZ);
+    static AtmEngine e;
+    SimStats stats;
+
+    // Reference: the classic image if the song fits one, else the paged one with instant reads.
+    std::vector<uint8_t> ref;
+    uint8_t* classic = NULL;
+    size_t classic_size = 0;
+    if(atm_parse_song_text(text.c_str(), &classic, &classic_size, NULL, 0)) {
+        atm_engine_init(&e);
+        atm_engine_load(&e, classic);
+        ref = sim_play(&e, NULL, NULL, limit, &stats);
+        free(classic);
+        printf("reference: classic image in RAM, %zu samples\n", ref.size());
+    } else {
+        AtmPager* instant = new AtmPager;
+        atm_pager_open(instant, image.data(), image.size());
+        SimReader r = {&image, 0, false, 0};
+        atm_engine_init(&e);
+        atm_engine_load_paged(&e, instant);
+        ref = sim_play(&e, instant, &r, limit, &stats);
+        atm_pager_close(instant);
+        delete instant;
+        printf("reference: over 64 KB, paged with instant reads, %zu samples\n", ref.size());
+    }
+
+    SimReader reader = {&image, (uint64_t)(latency_ms * ATM_LOGICAL_HZ / 1000.0 + 0.5), false, 0};
+    atm_engine_init(&e);
+    atm_engine_load_paged(&e, pager);
+    const std::vector<uint8_t> out = sim_play(&e, pager, &reader, limit, &stats);
+
+    printf(
+        "paged, %.1f ms per page: %u ticks, %u page loads, %u late ticks, max %.1f ms late\n",
+        latency_ms,
+        stats.ticks,
+        pager->loads,
+        stats.late_ticks,
+        samples_ms(stats.max_late));
+
+    size_t diff = 0;
+    while(diff < out.size() && diff < ref.size() && out[diff] == ref[diff]) diff++;
+    atm_pager_close(pager);
+    delete pager;
+    if(diff == out.size() && diff == ref.size()) {
+        printf("identical to the reference\n");
+        return 0;
+    }
+    printf("differs from the reference from sample %zu (%.1f ms)\n", diff, samples_ms(diff));
+    return 1;
+}
@@ -0,0 +1,243 @@
+// Host tool: simulates render-ahead playback (ATMsynth::setRenderAhead()) with a player thread
+// that stalls, and counts the underruns each ring depth gives.
+//
+//   g++ -std=c++17 -O2 -o atm_pipe tools/atm_pipe.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp
+//   ./atm_pipe [-t seconds] [-c render_us] [-s stall_ms] [-e every_ms] [-x seed] <song.atm>
+//
+// Simulated time, the real engine and the real ring (lib/Blocks.h): the interrupt takes a block
+// every ATM_BLOCK_SAMPLES samples; the thread wakes every millisecond, renders blocks at
+// render_us each (500 by default) while the ring has room and runs the ticks due after each.
+// Stalls of up to stall_ms (40) hit the thread about every every_ms (250), at the same moments
+// for every depth. A stall that starts mid-block holds that block up too. The song plays for
+// seconds (60) or to its end.
+//
+// Prints, per depth, the delay it adds, the underruns, the fewest blocks the interrupt found
+// queued, and whether the blocks it did get are the song as rendered without the ring.
+
+#include "atm_host.h"
+
+#include "../lib/Blocks.h"
+#include "../lib/ATMengine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+static constexpr uint64_t BLOCK_NS = (uint64_t)ATM_BLOCK_SAMPLES * 1000000000ull / ATM_LOGICAL_HZ;
+// How often the player thread looks at the ring when it is full (its message queue timeout).
+static constexpr uint64_t POLL_NS = 1000000;
+static constexpr uint32_t MAX_AHEAD = 16;
+static const uint32_t depths[] = {1, 2, 3, 4, 6, 8, 12, 16};
+
+struct Stall {
+    uint64_t start;
+    uint64_t end;
+};
+
+static uint64_t rng_state;
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static std::vector<Stall> make_stalls(uint64_t until, uint64_t every, uint64_t longest) {
+    std::vector<Stall> stalls;
+    uint64_t t = 0;
+    while(every && longest) {
+        t += rng() % (2 * every);
+        const uint64_t len = 1 + rng() % longest;
+        if(t >= until) break;
+        stalls.push_back({t, t + len});
+        t += len;
+    }
+    return stalls;
+}
+
+// When work of length ns started at t is done, with the stalls in between added.
+static uint64_t run_until(const std::vector<Stall>& stalls, uint64_t t, uint64_t ns) {
+    for(const Stall& s : stalls) {
+        if(s.end <= t) continue;
+        if(s.start <= t) {
+            t = s.end;
+        } else if(s.start < t + ns) {
+            ns -= s.start - t;
+            t = s.end;
+        } else {
+            break;
+        }
+    }
+    return t + ns;
+}
+
+// What the thread does after each block, as the device does.
+static void run_ticks(AtmEngine* e) {
+    while(e->tick_pending && !e->song_ended) {
+        e->tick_pending--;
+        atm_engine_tick(e);
+    }
+}
+
+struct PipeResult {
+    uint32_t underruns;
+    uint32_t lowest;
+    bool same;
+};
+
+static PipeResult simulate(
+    const uint8_t* song,
+    uint32_t depth,
+    uint64_t render_ns,
+    const std::vector<Stall>& stalls,
+    size_t blocks,
+    const std::vector<uint8_t>& ref) {
+    static AtmEngine e;
+    static AtmBlock storage[MAX_AHEAD];
+    AtmBlockRing ring;
+    atm_block_ring_init(&ring, storage, MAX_AHEAD, depth);
+    atm_engine_init(&e);
+    atm_engine_load(&e, song);
+
+    PipeResult r = {0, depth, true};
+    std::vector<uint8_t> out;
+    bool finished = false;
+    bool rendering = false;
+
+    // Filled before the DMA starts, like tim16_dma_start().
+    while(AtmBlock* back = atm_block_ring_back(&ring)) {
+        atm_engine_render(&e, *back, ATM_BLOCK_SAMPLES);
+        atm_block_ring_push(&ring);
+        run_ticks(&e);
+    }
+
+    uint64_t tp = 0;
+    uint64_t tc = 0;
+    size_t taken = 0;
+    while(taken < blocks && !(finished && atm_block_ring_count(&ring) == 0)) {
+        if(!finished && tp <= tc) {
+            // The thread.
+            if(rendering) {
+                atm_block_ring_push(&ring);
+                run_ticks(&e);
+                rendering = false;
+                if(e.song_ended) {
+                    finished = true;
+                    continue;
+                }
+            }
+            if(AtmBlock* back = atm_block_ring_back(&ring)) {
+                atm_engine_render(&e, *back, ATM_BLOCK_SAMPLES);
+                rendering = true;
+                tp = run_until(stalls, tp, render_ns);
+            } else {
+                tp = run_until(stalls, tp + POLL_NS, 0);
+            }
+        } else {
+            // The interrupt.
+            const uint32_t queued = atm_block_ring_count(&ring);
+            if(!finished && queued < r.lowest) r.lowest = queued;
+            if(const AtmBlock* ready = atm_block_ring_front(&ring)) {
+                out.insert(out.end(), *ready, *ready + ATM_BLOCK_SAMPLES);
+                atm_block_ring_pop(&ring);
+            }
+            taken++;
+            tc += BLOCK_NS;
+        }
+    }
+
+    r.underruns = ring.underruns;
+    r.same = out.size() <= ref.size() && memcmp(out.data(), ref.data(), out.size()) == 0;
+    return r;
+}
+
+int main(int argc, char** argv) {
+    double seconds = 60;
+    double render_us = 500;
+    double stall_ms = 40;
+    double every_ms = 250;
+    uint64_t seed = 1;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-'; i++) {
+        if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if(!strcmp(argv[i], "-c") && i + 1 < argc) {
+            render_us = atof(argv[++i]);
+        } else if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+            stall_ms = atof(argv[++i]);
+        } else if(!strcmp(argv[i], "-e") && i + 1 < argc) {
+            every_ms = atof(argv[++i]);
+        } else if(!strcmp(argv[i], "-x") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            break;
+        }
+    }
+    if(argc - i != 1) {
+        fprintf(
+            stderr,
+            "usage: %s [-t seconds] [-c render_us] [-s stall_ms] [-e every_ms] [-x seed] <song.atm>\n",
+            argv[0]);
+        return 2;
+    }
+
+    std::string text;
+    uint8_t* song = NULL;
+    size_t song_size = 0;
+    if(!read_text(argv[i], &text) || !atm_parse_song_text(text.c_str(), &song, &song_size, NULL, 0)) {
+        fprintf(stderr, "%s: cannot read or compile\n", argv[i]);
+        return 1;
+    }
+
+    // The song as the interrupt would render it, block by block with the ticks in between.
+    const size_t blocks = (size_t)(seconds * ATM_LOGICAL_HZ / ATM_BLOCK_SAMPLES);
+    std::vector<uint8_t> ref;
+    {
+        static AtmEngine e;
+        atm_engine_init(&e);
+        atm_engine_load(&e, song);
+        AtmBlock block;
+        for(size_t b = 0; b < blocks + MAX_AHEAD && !e.song_ended; b++) {
+            atm_engine_render(&e, block, ATM_BLOCK_SAMPLES);
+            ref.insert(ref.end(), block, block + ATM_BLOCK_SAMPLES);
+            run_ticks(&e);
+        }
+    }
+
+    const size_t played = std::min(blocks, ref.size() / ATM_BLOCK_SAMPLES);
+    rng_state = seed * 0x9E3779B97F4A7C15ull + 1;
+    const std::vector<Stall> stalls = make_stalls(
+        (uint64_t)played * BLOCK_NS, (uint64_t)(every_ms * 1e6), (uint64_t)(stall_ms * 1e6));
+    uint64_t longest = 0;
+    for(const Stall& s : stalls) {
+        if(s.end - s.start > longest) longest = s.end - s.start;
+    }
+    printf(
+        "%s: %.1f s, %zu stalls up to %.1f ms, %.0f us per block of %.2f ms\n",
+        argv[i],
+        (double)played * ATM_BLOCK_SAMPLES / ATM_LOGICAL_HZ,
+        stalls.size(),
+        (double)longest / 1e6,
+        render_us,
+        (double)BLOCK_NS / 1e6);
+
+    int failed = 0;
+    printf("ahead\tdelay ms\tunderruns\tlowest\toutput\n");
+    for(uint32_t depth : depths) {
+        const PipeResult r =
+            simulate(song, depth, (uint64_t)(render_us * 1000), stalls, blocks, ref);
+        printf(
+            "%u\t%.1f\t%u\t%u\t%s\n",
+            depth,
+            (double)depth * BLOCK_NS / 1e6,
+            r.underruns,
+            r.lowest,
+            r.same ? "same" : "DIFFERS");
+        if(!r.same) failed++;
+    }
+    free(song);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+// Host tool: measures how close to the ATM_LOGICAL_HZ pitch every note plays at every output
+// rate, and what each voice costs to synthesize.
+//
+//   g++ -std=c++17 -O2 -o atm_pitch tools/atm_pitch.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp
+//   ./atm_pitch
+//
+// Pitch: every note 1..63 is held on channel 0 in uniform-tone mode (a square wave) for SECONDS
+// at each supported rate, with the other channels muted. Its frequency is taken from the output,
+// as cycles between the first and the last rising edge over the samples between them, and
+// compared with what the note's table frequency plays at ATM_LOGICAL_HZ. Next to it is the
+// error a plain 16-bit phase step, rounded at that rate, would have. Edges are whole samples,
+// so the measurement itself is good to about 2 / (SECONDS * rate) of the frequency.
+//
+// Cost: the mix is rendered with 0 to 4 voices sounding, block by block, and timed. Prints the
+// time per sample for each, the added time per voice, and what four voices cost per second of
+// audio at each rate.
+//
+// Exits non-zero if any note is off by more than MAX_CENTS.
+
+#include "atm_host.h"
+
+#include "../lib/Blocks.h"
+#include "../lib/ATMengine.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const uint32_t rates[] = {ATM_LOGICAL_HZ, 62500, 48000, 44100, 22050};
+static constexpr double SECONDS = 8;
+static constexpr double MAX_CENTS = 0.05;
+static constexpr size_t COST_BLOCKS = 100000;
+
+// Keeps the timed renders from being optimized out.
+static volatile uint8_t sink;
+
+static uint8_t* compile_note(uint8_t note) {
+    const std::string text = "ATM1\nENTRY 0 0 0 0\nTRACK # 0\nSET_VOLUME 30\nNOTE " +
+                             std::to_string(note) +
+                             "\nDELAY 255\nDELAY 255\nSTOP\nENDTRACK\nEND\n";
+    uint8_t* song = NULL;
+    size_t size = 0;
+    if(!atm_parse_song_text(text.c_str(), &song, &size, NULL, 0)) return NULL;
+    return song;
+}
+
+static double cents(double got, double want) {
+    return 1200.0 * log2(got / want);
+}
+
+// Frequency of channel 0 of song at hz, and its note-table frequency in *freq.
+static double measure(const uint8_t* song, uint32_t hz, uint16_t* freq) {
+    static AtmEngine e;
+    atm_engine_init(&e);
+    atm_engine_set_output_rate(&e, hz);
+    e.uniform_tone_mode = 1;
+    atm_engine_load(&e, song);
+
+    std::vector<uint8_t> pcm;
+    AtmBlock block;
+    bool started = false;
+    while(pcm.size() < (size_t)(SECONDS * hz) && !e.song_ended) {
+        atm_engine_render(&e, block, ATM_BLOCK_SAMPLES);
+        // The note starts with the first tick; what came before it is silence.
+        if(started) pcm.insert(pcm.end(), block, block + ATM_BLOCK_SAMPLES);
+        while(e.tick_pending && !e.song_ended) {
+            e.tick_pending--;
+            atm_engine_tick(&e);
+            started = true;
+        }
+        for(uint8_t n = 1; n < 4; n++) e.osc[n].vol = 0;
+    }
+    *freq = e.osc[0].freq;
+
+    size_t first = 0;
+    size_t last = 0;
+    size_t cycles = 0;
+    for(size_t i = 1; i < pcm.size(); i++) {
+        if(pcm[i - 1] > 128 || pcm[i] <= 128) continue;
+        if(!first) {
+            first = i;
+        } else {
+            cycles++;
+        }
+        last = i;
+    }
+    if(!cycles) return 0;
+    return (double)cycles * hz / (double)(last - first);
+}
+
+// Nanoseconds per sample of the mix with voices sounding.
+static double cost(uint8_t voices) {
+    static AtmEngine e;
+    atm_engine_init(&e);
+    static const uint16_t freqs[4] = {440, 659, 220, 1};
+    for(uint8_t n = 0; n < voices; n++) {
+        e.osc[n].freq = freqs[n];
+        e.osc[n].vol = 30;
+    }
+    atm_engine_sync_osc(&e);
+
+    AtmBlock block;
+    const Clock::time_point t0 = Clock::now();
+    for(size_t b = 0; b < COST_BLOCKS; b++) {
+        atm_engine_render(&e, block, ATM_BLOCK_SAMPLES);
+        e.tick_pending = 0;
+        sink = block[b % ATM_BLOCK_SAMPLES];
+    }
+    const double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+    return ns / (double)(COST_BLOCKS * ATM_BLOCK_SAMPLES);
+}
+
+int main() {
+    int failed = 0;
+    printf("rate\tworst cents\tnote\t16-bit step worst cents\n");
+    for(uint32_t hz : rates) {
+        double worst = 0;
+        double worst_plain = 0;
+        uint8_t worst_note = 0;
+        for(uint8_t note = 1; note < 64; note++) {
+            uint8_t* song = compile_note(note);
+            if(!song) {
+                fprintf(stderr, "cannot compile the test song\n");
+                return 1;
+            }
+            uint16_t freq = 0;
+            const double got = measure(song, hz, &freq);
+            free(song);
+
+            const double want = freq * (double)ATM_LOGICAL_HZ / 65536.0;
+            const double off = got > 0 ? fabs(cents(got, want)) : INFINITY;
+            const double plain_step = round(freq * (double)ATM_LOGICAL_HZ / hz);
+            const double plain = fabs(cents(plain_step * hz / 65536.0, want));
+            if(off > worst) {
+                worst = off;
+                worst_note = note;
+            }
+            if(plain > worst_plain) worst_plain = plain;
+            if(off > MAX_CENTS) {
+                printf("%u Hz, note %u: %.2f Hz, want %.2f Hz\n", hz, note, got, want);
+                failed++;
+            }
+        }
+        printf("%u\t%.4f\t%u\t%.3f\n", hz, worst, worst_note, worst_plain);
+    }
+
+    printf("\nvoices\tns/sample\n");
+    double ns[5];
+    for(uint8_t v = 0; v <= 4; v++) {
+        ns[v] = cost(v);
+        printf("%u\t%.2f\n", v, ns[v]);
+    }
+    printf("%.2f ns/sample per voice\n", (ns[4] - ns[0]) / 4);
+    for(uint32_t hz : rates) {
+        printf("%u Hz: four voices %.2f ms per second of audio\n", hz, ns[4] * hz / 1e6);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+// Host tool: regression check of what the engine plays. Renders every ATM1 text song under a
+// directory tree and hashes the output, the level meters and the music events, to compare
+// against a reference taken before a change that should not alter any of them.
+//
+//   g++ -std=c++17 -O2 -o atm_regress tools/atm_regress.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp
+//   ./atm_regress [-t seconds] [-c reference] <song dir>
+//
+// Each song plays for seconds (60 by default) or to its end, in normal and in uniform-tone mode,
+// rendered block by block with the ticks in between as the device does, from a freshly
+// initialized engine with events on. Prints one line per song and mode: the FNV-1a hashes of the
+// samples, of the meter levels read after each block and of the events, the mode and the path
+// relative to the song dir. With -c the lines are compared against a file of such lines (e.g.
+// tools/atm_regress.ref for assets/); differing and missing ones are printed and the exit status
+// is non-zero. Building with -DATM_SYNTH_LITE or -DATM_SYNTH_EXTENDED checks the two- or
+// eight-voice build instead, each against its own reference.
+
+#include "atm_host.h"
+
+#include "../lib/Blocks.h"
+#include "../lib/ATMengine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct Fnv {
+    uint64_t h = 1469598103934665603ull;
+
+    void add(const uint8_t* p, size_t n) {
+        for(size_t i = 0; i < n; i++) h = (h ^ p[i]) * 1099511628211ull;
+    }
+};
+
+static std::string render_line(const uint8_t* song, size_t limit, uint8_t uniform) {
+    static AtmEngine e;
+    atm_engine_init(&e);
+    e.uniform_tone_mode = uniform;
+    e.events_enabled = true;
+    atm_engine_load(&e, song);
+
+    Fnv pcm;
+    Fnv levels;
+    Fnv events;
+    AtmBlock block;
+    for(size_t done = 0; done < limit && !e.song_ended; done += ATM_BLOCK_SAMPLES) {
+        atm_engine_render(&e, block, ATM_BLOCK_SAMPLES);
+        pcm.add(block, ATM_BLOCK_SAMPLES);
+        uint8_t l[4];
+        atm_engine_read_levels(&e, l);
+        levels.add(l, 4);
+        while(e.tick_pending && !e.song_ended) {
+            e.tick_pending--;
+            atm_engine_tick(&e);
+        }
+        AtmMusicEvent ev;
+        while(atm_event_pop(&e.events, &ev)) {
+            const uint8_t b[8] = {
+                (uint8_t)ev.pos,
+                (uint8_t)(ev.pos >> 8),
+                (uint8_t)(ev.pos >> 16),
+                (uint8_t)(ev.pos >> 24),
+                (uint8_t)ev.type,
+                ev.ch,
+                ev.value,
+                ev.vol};
+            events.add(b, sizeof(b));
+        }
+    }
+
+    char line[80];
+    snprintf(
+        line,
+        sizeof(line),
+        "%016llx %016llx %016llx uni=%u",
+        (unsigned long long)pcm.h,
+        (unsigned long long)levels.h,
+        (unsigned long long)events.h,
+        uniform);
+    return line;
+}
+
+int main(int argc, char** argv) {
+    double seconds = 60;
+    const char* ref_path = NULL;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-'; i++) {
+        if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if(!strcmp(argv[i], "-c") && i + 1 < argc) {
+            ref_path = argv[++i];
+        } else {
+            break;
+        }
+    }
+    if(argc - i != 1) {
+        fprintf(stderr, "usage: %s [-t seconds] [-c reference] <song dir>\n", argv[0]);
+        return 2;
+    }
+
+    std::set<std::string> ref;
+    if(ref_path) {
+        std::string text;
+        if(!read_text(ref_path, &text)) {
+            fprintf(stderr, "%s: cannot read\n", ref_path);
+            return 2;
+        }
+        size_t start = 0;
+        while(start < text.size()) {
+            size_t end = text.find('\n', start);
+            if(end == std::string::npos) end = text.size();
+            if(end > start) ref.insert(text.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
+    const fs::path root(argv[i]);
+    const size_t limit = (size_t)(seconds * ATM_LOGICAL_HZ);
+    size_t lines = 0;
+    int failed = 0;
+    for(const fs::path& path : find_atm_files(root)) {
+        const std::string rel = fs::relative(path, root).generic_string();
+        std::string text;
+        uint8_t* song = NULL;
+        size_t song_size = 0;
+        if(!read_text(path, &text) || !atm_parse_song_text(text.c_str(), &song, &song_size, NULL, 0)) {
+            printf("%s: cannot read or compile\n", rel.c_str());
+            failed++;
+            continue;
+        }
+        for(uint8_t uniform = 0; uniform < 2; uniform++) {
+            const std::string line = render_line(song, limit, uniform) + " " + rel;
+            lines++;
+            if(!ref_path) {
+                printf("%s\n", line.c_str());
+            } else if(!ref.erase(line)) {
+                printf("differs: %s\n", line.c_str());
+                failed++;
+            }
+        }
+        free(song);
+    }
+
+    if(ref_path) {
+        for(const std::string& line : ref) {
+            printf("missing: %s\n", line.c_str());
+            failed++;
+        }
+        printf("%zu renders, %d differ or are missing\n", lines, failed);
+    }
+    return failed ? 1 : 0;
+}
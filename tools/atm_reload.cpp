@@ -0,0 +1,253 @@
+// Host tool: measures how long an edit saved to a playing song takes to be heard, and checks
+// that a reload carries on where the old version was.
+//
+//   g++ -std=c++17 -O2 -o atm_reload tools/atm_reload.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp
+//   ./atm_reload [-p seconds] [-t seconds] <song dir>
+//
+// Every ATM1 text song under the directory is played block by block for -p seconds (5 by
+// default), then edited the two ways a composer does, one line at a time: every NOTE changed to
+// the next note (a value edit) and a DELAY 1 inserted after every NOTE (an edit that moves the
+// instructions after it). For each edit the player's reload path runs as ATMsynth::reload() and
+// the watch in main.cpp run it: atm_parse_song_text_cached() against the cache of the original,
+// then atm_engine_rebase(), or, when a channel is inside a track whose instructions moved, the
+// new version replayed tick by tick from the start to the same position.
+//
+// Recompile-to-audible is the compile and the rebase or replay, plus the rest of the tick
+// playing when the edit lands (the new bytes are read by the next tick) and one block for the
+// renderer to reach the speaker. The watch notices a save within its period (1 s) on top.
+//
+// When the edit had not been heard by then (a fresh play of the new version matches the first
+// -p seconds), a rebased song has to go on exactly as that fresh play does for -t seconds (5).
+// Prints per song the edits, how they were applied and the times, and any that went on
+// differently; exits non-zero if any did.
+
+#include "atm_host.h"
+
+#include "../lib/Blocks.h"
+#include "../lib/ATMengine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Stats {
+    uint32_t edits;
+    uint32_t rebased;
+    uint32_t replayed;
+    uint32_t checked;
+    uint32_t differ;
+    double compile_us;
+    double compile_max_us;
+    double apply_max_us;
+    double audible_max_ms;
+};
+
+static double us_since(Clock::time_point t0) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+}
+
+static void play(AtmEngine* e, size_t blocks, std::vector<uint8_t>* pcm) {
+    AtmBlock block;
+    for(size_t b = 0; b < blocks; b++) {
+        atm_engine_render(e, block, ATM_BLOCK_SAMPLES);
+        if(pcm) pcm->insert(pcm->end(), block, block + ATM_BLOCK_SAMPLES);
+        while(e->tick_pending && !e->song_ended) {
+            e->tick_pending--;
+            atm_engine_tick(e);
+        }
+    }
+}
+
+static std::vector<std::string> split_lines(const std::string& text) {
+    std::vector<std::string> lines;
+    size_t start = 0;
+    while(start <= text.size()) {
+        size_t end = text.find('\n', start);
+        if(end == std::string::npos) end = text.size();
+        lines.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    return lines;
+}
+
+static std::string join_lines(const std::vector<std::string>& lines) {
+    std::string text;
+    for(const std::string& l : lines) text += l + "\n";
+    return text;
+}
+
+// One reload of edited over the playing base, which plays original.
+static void reload(
+    const std::string& original,
+    const std::string& edited,
+    const AtmEngine& base,
+    const std::vector<uint8_t>& heard,
+    size_t after_blocks,
+    Stats* st,
+    const char* name,
+    size_t line) {
+    AtmCompileCache cache;
+    memset(&cache, 0, sizeof(cache));
+    uint8_t* old_song = NULL;
+    size_t size = 0;
+    if(!atm_parse_song_text_cached(original.c_str(), &cache, &old_song, &size, NULL, 0)) return;
+
+    uint8_t* song = NULL;
+    Clock::time_point t0 = Clock::now();
+    const bool ok = atm_parse_song_text_cached(edited.c_str(), &cache, &song, &size, NULL, 0);
+    const double compile_us = us_since(t0);
+    if(!ok) {
+        atm_compile_cache_free(&cache);
+        free(old_song);
+        return;
+    }
+    uint32_t relaid[8] = {0};
+    for(size_t i = 0; i < cache.count; i++) {
+        if(cache.tracks[i].change == AtmTrackRelaid) relaid[i >> 5] |= 1u << (i & 31);
+    }
+
+    static AtmEngine e;
+    e = base;
+    t0 = Clock::now();
+    const bool rebased = atm_engine_rebase(&e, song, relaid);
+    if(!rebased) {
+        const uint32_t pos = e.song_pos;
+        atm_engine_load(&e, song);
+        while(e.song_pos < pos && !e.song_ended) atm_engine_tick(&e);
+        e.tick_pending = 0;
+    }
+    const double apply_us = us_since(t0);
+
+    st->edits++;
+    if(rebased) {
+        st->rebased++;
+    } else {
+        st->replayed++;
+    }
+    st->compile_us += compile_us;
+    if(compile_us > st->compile_max_us) st->compile_max_us = compile_us;
+    if(apply_us > st->apply_max_us) st->apply_max_us = apply_us;
+    const double audible_ms = (compile_us + apply_us) / 1000.0 +
+                              (e.tick_period + ATM_BLOCK_SAMPLES) * 1000.0 / ATM_LOGICAL_HZ;
+    if(audible_ms > st->audible_max_ms) st->audible_max_ms = audible_ms;
+
+    if(rebased) {
+        static AtmEngine fresh;
+        atm_engine_init(&fresh);
+        atm_engine_load(&fresh, song);
+        std::vector<uint8_t> pcm;
+        play(&fresh, heard.size() / ATM_BLOCK_SAMPLES, &pcm);
+        if(pcm == heard) {
+            std::vector<uint8_t> want;
+            std::vector<uint8_t> got;
+            play(&fresh, after_blocks, &want);
+            play(&e, after_blocks, &got);
+            st->checked++;
+            if(got != want) {
+                if(st->differ++ < 3) printf("%s: edit at line %zu goes on differently\n", name, line + 1);
+            }
+        }
+    }
+
+    atm_compile_cache_free(&cache);
+    free(song);
+    free(old_song);
+}
+
+int main(int argc, char** argv) {
+    double at_seconds = 5;
+    double after_seconds = 5;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-'; i++) {
+        if(!strcmp(argv[i], "-p") && i + 1 < argc) {
+            at_seconds = atof(argv[++i]);
+        } else if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            after_seconds = atof(argv[++i]);
+        } else {
+            break;
+        }
+    }
+    if(argc - i != 1) {
+        fprintf(stderr, "usage: %s [-p seconds] [-t seconds] <song dir>\n", argv[0]);
+        return 2;
+    }
+
+    const size_t at_blocks = (size_t)(at_seconds * ATM_LOGICAL_HZ / ATM_BLOCK_SAMPLES);
+    const size_t after_blocks = (size_t)(after_seconds * ATM_LOGICAL_HZ / ATM_BLOCK_SAMPLES);
+    Stats all;
+    memset(&all, 0, sizeof(all));
+    for(const auto& path : find_atm_files(argv[i])) {
+        const std::string name = path.string();
+        std::string text;
+        uint8_t* song = NULL;
+        size_t song_size = 0;
+        if(!read_text(path, &text) || !atm_parse_song_text(text.c_str(), &song, &song_size, NULL, 0)) {
+            printf("%s: cannot read or compile\n", name.c_str());
+            all.differ++;
+            continue;
+        }
+
+        static AtmEngine base;
+        atm_engine_init(&base);
+        atm_engine_load(&base, song);
+        std::vector<uint8_t> heard;
+        play(&base, at_blocks, &heard);
+        if(base.song_ended) {
+            printf("%s: ends before %.0f s, skipped\n", name.c_str(), at_seconds);
+            free(song);
+            continue;
+        }
+
+        Stats st;
+        memset(&st, 0, sizeof(st));
+        const std::vector<std::string> lines = split_lines(text);
+        for(size_t l = 0; l < lines.size(); l++) {
+            int note = 0;
+            if(sscanf(lines[l].c_str(), "NOTE %d", &note) != 1) continue;
+            std::vector<std::string> edited = lines;
+            edited[l] = "NOTE " + std::to_string(note < 63 ? note + 1 : note - 1);
+            reload(text, join_lines(edited), base, heard, after_blocks, &st, name.c_str(), l);
+
+            edited = lines;
+            edited.insert(edited.begin() + (long)l + 1, "DELAY 1");
+            reload(text, join_lines(edited), base, heard, after_blocks, &st, name.c_str(), l);
+        }
+
+        printf(
+            "%s: %u edits, %u rebased, %u replayed; compile %.1f us (max %.1f), apply max %.1f us, "
+            "audible within %.1f ms; %u checked, %u differ\n",
+            name.c_str(),
+            st.edits,
+            st.rebased,
+            st.replayed,
+            st.edits ? st.compile_us / st.edits : 0.0,
+            st.compile_max_us,
+            st.apply_max_us,
+            st.audible_max_ms,
+            st.checked,
+            st.differ);
+        all.edits += st.edits;
+        all.rebased += st.rebased;
+        all.replayed += st.replayed;
+        all.checked += st.checked;
+        all.differ += st.differ;
+        if(st.audible_max_ms > all.audible_max_ms) all.audible_max_ms = st.audible_max_ms;
+        free(song);
+    }
+    printf(
+        "%u edits, %u rebased, %u replayed, audible within %.1f ms of the watch seeing the save; "
+        "%u checked, %u differ\n",
+        all.edits,
+        all.rebased,
+        all.replayed,
+        all.audible_max_ms,
+        all.checked,
+        all.differ);
+    return all.differ ? 1 : 0;
+}
@@ -0,0 +1,495 @@
+// Host tool: renders every ATM1 text song under a directory tree to PCM in parallel.
+//
+//   g++ -std=c++17 -O2 -pthread -o atm_render tools/atm_render.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp ATManalyze.cpp
+//   ./atm_render [-j threads] [-t max_seconds] [-r hz] [-b 8|16] [-u] [-a] [-l] [--verify] [-o out_dir] <song dir>
+//
+// Each worker runs its own AtmEngine, so songs render side by side with no shared state. With
+// -l each worker instead renders ATM_LANES songs at once in SIMD lanes (see atm_lanes.h; add
+// -mavx2 to the build on machines that have it); the output is the same, which --verify checks
+// by rendering every song a second time the scalar way alongside its lane and comparing each
+// block, reporting the song as lanes-differ at the first difference. A song is rendered
+// for its analyzed length (one pass through the loop), capped at max_seconds (300 by default).
+// -r picks another output rate the engine supports (ATM_LOGICAL_HZ by default), -u renders in
+// uniform-tone mode, -a with the auto gain the player applies. Building with -DATM_SYNTH_LITE
+// renders what the two-voice device build plays.
+//
+// Prints one tab-separated line per file (status, samples, peak, RMS, the master volume that
+// would bring the peak to full scale, the auto gain estimated by the loudness scan, render time,
+// path) and a summary with throughput. With -o, output goes to out_dir as <relative path>.wav:
+// mono, 8-bit unsigned by default, at ATM_LOGICAL_HZ exactly the samples the device feeds to the
+// PWM; -b 16 writes signed 16-bit samples with the eight bits the device drops. Peak and RMS are
+// in 8-bit units either way.
+// Exits non-zero if any file failed.
+
+#include "atm_host.h"
+#include "atm_lanes.h"
+
+#include "../lib/ATManalyze.h"
+#include "../lib/ATMengine.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+// Rendered in blocks this size, written out in chunks of ATM_RENDER_WRITE_SIZE.
+static constexpr size_t ATM_RENDER_BLOCK = 4096;
+static constexpr size_t ATM_RENDER_WRITE_SIZE = 256 * 1024;
+static constexpr float ATM_RENDER_GAIN_MAX = 2.0f;
+
+struct RenderOptions {
+    uint32_t max_seconds = 300;
+    uint32_t rate_hz = ATM_LOGICAL_HZ;
+    bool uniform = false;
+    bool auto_gain = false;
+    bool lanes = false;
+    bool verify = false;
+    uint8_t bits = 8;
+    fs::path out_dir;
+};
+
+struct RenderReport {
+    std::string status;
+    uint64_t samples = 0;
+    uint32_t peak = 0;
+    double rms = 0;
+    double gain = 0;
+    double auto_gain = 0;
+    uint64_t render_us = 0;
+};
+
+static void put_u16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    put_u16(p, (uint16_t)(v & 0xFFFF));
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void wav_header(uint8_t h[44], uint32_t rate_hz, uint8_t bits, uint32_t samples) {
+    const uint32_t bytes = samples * (bits / 8);
+    memcpy(h, "RIFF", 4);
+    put_u32(h + 4, 36 + bytes);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_u32(h + 16, 16);
+    put_u16(h + 20, 1);
+    put_u16(h + 22, 1);
+    put_u32(h + 24, rate_hz);
+    put_u32(h + 28, rate_hz * (bits / 8));
+    put_u16(h + 32, bits / 8);
+    put_u16(h + 34, bits);
+    memcpy(h + 36, "data", 4);
+    put_u32(h + 40, bytes);
+}
+
+// Sequential writer: buffers output and hands it to the OS in large chunks.
+class PcmWriter {
+public:
+    PcmWriter(std::vector<uint8_t>* buf, uint32_t rate_hz, uint8_t bits)
+        : buf_(buf)
+        , rate_hz_(rate_hz)
+        , bits_(bits) {
+        buf_->clear();
+    }
+
+    ~PcmWriter() {
+        if(f_) fclose(f_);
+    }
+
+    bool open(const fs::path& path) {
+        std::error_code ec;
+        fs::create_directories(path.parent_path(), ec);
+        f_ = fopen(path.string().c_str(), "wb");
+        if(!f_) return false;
+        setvbuf(f_, NULL, _IONBF, 0);
+        uint8_t h[44];
+        wav_header(h, rate_hz_, bits_, 0);
+        buf_->insert(buf_->end(), h, h + sizeof(h));
+        return true;
+    }
+
+    bool write(const uint8_t* data, size_t size) {
+        if(!f_) return true;
+        buf_->insert(buf_->end(), data, data + size);
+        if(buf_->size() >= ATM_RENDER_WRITE_SIZE) return flush();
+        return true;
+    }
+
+    // Flushes the tail and patches the sizes in the header.
+    bool finish(uint32_t samples) {
+        if(!f_) return true;
+        if(!flush()) return false;
+        uint8_t h[44];
+        wav_header(h, rate_hz_, bits_, samples);
+        const bool ok = fseek(f_, 0, SEEK_SET) == 0 && fwrite(h, 1, sizeof(h), f_) == sizeof(h);
+        const bool closed = fclose(f_) == 0;
+        f_ = NULL;
+        return ok && closed;
+    }
+
+private:
+    std::vector<uint8_t>* buf_;
+    uint32_t rate_hz_;
+    uint8_t bits_;
+    FILE* f_ = NULL;
+
+    bool flush() {
+        const bool ok = fwrite(buf_->data(), 1, buf_->size(), f_) == buf_->size();
+        buf_->clear();
+        return ok;
+    }
+};
+
+// One song between render_begin() and render_end(): its image, where its output goes and the
+// statistics gathered so far.
+struct RenderJob {
+    RenderJob(RenderReport* report, std::vector<uint8_t>* write_buf, const RenderOptions& opt)
+        : r(report)
+        , out(write_buf, opt.rate_hz, opt.bits)
+        , unit(opt.bits == 16 ? 256 : 1) {
+    }
+
+    ~RenderJob() {
+        if(image) free(image);
+    }
+
+    RenderReport* r;
+    PcmWriter out;
+    uint8_t* image = NULL;
+    uint64_t total = 0;
+    uint64_t sum_sq = 0;
+    uint32_t peak = 0;
+    // Statistics are gathered in sample units and reported in 8-bit ones.
+    uint32_t unit;
+    bool ok = true;
+    // --verify: the same song rendered the scalar way, and whether it came out differently.
+    std::unique_ptr<AtmEngine> scalar;
+    bool differs = false;
+    Clock::time_point t0;
+};
+
+// Compiles the song and sets engine up to play it. On failure sets the report's status and
+// returns false.
+static bool render_begin(
+    AtmEngine* engine,
+    RenderJob* job,
+    const fs::path& root,
+    const fs::path& path,
+    const RenderOptions& opt) {
+    RenderReport& r = *job->r;
+    std::string text;
+    if(!read_text(path, &text)) {
+        r.status = "read-error";
+        return false;
+    }
+
+    size_t image_size = 0;
+    if(!atm_parse_song_text(text.c_str(), &job->image, &image_size, NULL, 0)) {
+        r.status = "compile-error";
+        return false;
+    }
+
+    AtmSongInfo info;
+    if(!atm_analyze_song(job->image, image_size, &info)) {
+        r.status = "invalid-flow";
+        return false;
+    }
+
+    uint64_t ms = info.duration_ms;
+    if(ms > (uint64_t)opt.max_seconds * 1000) ms = (uint64_t)opt.max_seconds * 1000;
+    job->total = ms * opt.rate_hz / 1000;
+
+    if(!opt.out_dir.empty()) {
+        fs::path dst = opt.out_dir / fs::relative(path, root);
+        dst.replace_extension(".wav");
+        if(!job->out.open(dst)) {
+            r.status = "write-error";
+            return false;
+        }
+    }
+
+    AtmLoudness loudness;
+    atm_engine_scan_loudness(engine, job->image, (uint32_t)(ms * ATM_LOGICAL_HZ / 1000), &loudness);
+    const uint16_t auto_q8 = atm_auto_gain_q8(&loudness);
+    r.auto_gain = (double)auto_q8 / 256.0;
+
+    atm_engine_init(engine);
+    atm_engine_set_output_rate(engine, opt.rate_hz);
+    engine->uniform_tone_mode = opt.uniform ? 1 : 0;
+    if(opt.auto_gain) engine->master_gain_q8 = auto_q8;
+    atm_engine_load(engine, job->image);
+    if(opt.verify) job->scalar.reset(new AtmEngine(*engine));
+
+    job->t0 = Clock::now();
+    return true;
+}
+
+static void render_consume(RenderJob* job, const uint8_t* block, size_t got) {
+    for(size_t i = 0; i < got; i++) {
+        const int32_t v = (int32_t)block[i] - 128;
+        const uint32_t a = (uint32_t)(v < 0 ? -v : v);
+        if(a > job->peak) job->peak = a;
+        job->sum_sq += (uint64_t)(v * v);
+    }
+    if(job->ok) job->ok = job->out.write(block, got);
+    job->r->samples += got;
+}
+
+static void render_consume(RenderJob* job, const int16_t* block, size_t got) {
+    uint8_t bytes[ATM_RENDER_BLOCK * 2];
+    for(size_t i = 0; i < got; i++) {
+        const int32_t v = block[i];
+        const uint32_t a = (uint32_t)(v < 0 ? -v : v);
+        if(a > job->peak) job->peak = a;
+        job->sum_sq += (uint64_t)((int64_t)v * v);
+        put_u16(bytes + i * 2, (uint16_t)v);
+    }
+    if(job->ok) job->ok = job->out.write(bytes, got * 2);
+    job->r->samples += got;
+}
+
+// --verify: renders what the lane just did the scalar way and compares.
+static void render_verify(RenderJob* job, const uint8_t* block, size_t got) {
+    uint8_t want[ATM_RENDER_BLOCK];
+    const size_t n = atm_engine_run(job->scalar.get(), want, got);
+    if(n != got || memcmp(want, block, got) != 0) job->differs = true;
+}
+
+static void render_end(RenderJob* job) {
+    RenderReport& r = *job->r;
+    if(job->ok) job->ok = job->out.finish((uint32_t)r.samples);
+
+    r.render_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                      Clock::now() - job->t0)
+                      .count();
+    r.status = job->differs ? "lanes-differ" : job->ok ? "ok" : "write-error";
+    const double peak = (double)job->peak / job->unit;
+    r.peak = (uint32_t)lround(peak);
+    r.rms = r.samples ? sqrt((double)job->sum_sq / (double)r.samples) / job->unit : 0.0;
+    r.gain = job->peak ? std::min<double>(ATM_RENDER_GAIN_MAX, 127.0 / peak) : ATM_RENDER_GAIN_MAX;
+}
+
+static RenderReport render_file(
+    AtmEngine* engine,
+    std::vector<uint8_t>* write_buf,
+    const fs::path& root,
+    const fs::path& path,
+    const RenderOptions& opt) {
+    RenderReport r;
+    RenderJob job(&r, write_buf, opt);
+    if(!render_begin(engine, &job, root, path, opt)) return r;
+
+    uint8_t block[ATM_RENDER_BLOCK];
+    int16_t block16[ATM_RENDER_BLOCK];
+    while(r.samples < job.total && job.ok) {
+        size_t want = ATM_RENDER_BLOCK;
+        if(want > job.total - r.samples) want = (size_t)(job.total - r.samples);
+        size_t got;
+        if(opt.bits == 16) {
+            got = atm_engine_run_s16(engine, block16, want);
+            render_consume(&job, block16, got);
+        } else {
+            got = atm_engine_run(engine, block, want);
+            render_consume(&job, block, got);
+        }
+        if(got < want) break;
+    }
+
+    render_end(&job);
+    return r;
+}
+
+// Worker loop of -l: keeps ATM_LANES songs in flight, refilling a lane from the pool as soon as
+// its song is done.
+static void render_lanes(
+    WorkStealingPool* pool,
+    size_t worker,
+    const std::vector<fs::path>& files,
+    std::vector<RenderReport>* reports,
+    const fs::path& root,
+    const RenderOptions& opt) {
+    AtmEngine engines[ATM_LANES];
+    std::vector<uint8_t> write_bufs[ATM_LANES];
+    std::unique_ptr<RenderJob> jobs[ATM_LANES];
+    static thread_local uint8_t blocks[ATM_LANES][ATM_RENDER_BLOCK];
+    uint8_t* out[ATM_LANES];
+
+    AtmLanes lanes = {};
+    lanes.uniform = opt.uniform;
+    for(size_t l = 0; l < ATM_LANES; l++) {
+        out[l] = blocks[l];
+    }
+
+    bool pool_empty = false;
+    while(true) {
+        for(size_t l = 0; l < ATM_LANES && !pool_empty; l++) {
+            size_t job;
+            while(!jobs[l] && !pool_empty) {
+                if(!pool->take(worker, &job)) {
+                    pool_empty = true;
+                    break;
+                }
+                jobs[l].reset(new RenderJob(&(*reports)[job], &write_bufs[l], opt));
+                if(!render_begin(&engines[l], jobs[l].get(), root, files[job], opt)) {
+                    jobs[l].reset();
+                }
+            }
+        }
+
+        size_t limit[ATM_LANES];
+        size_t done[ATM_LANES];
+        bool any = false;
+        for(size_t l = 0; l < ATM_LANES; l++) {
+            lanes.engine[l] = jobs[l] ? &engines[l] : NULL;
+            limit[l] = 0;
+            if(!jobs[l]) continue;
+            const uint64_t left = jobs[l]->total - jobs[l]->r->samples;
+            limit[l] = left < ATM_RENDER_BLOCK ? (size_t)left : ATM_RENDER_BLOCK;
+            any = true;
+        }
+        if(!any) break;
+
+        atm_lanes_run(&lanes, out, limit, done);
+
+        for(size_t l = 0; l < ATM_LANES; l++) {
+            if(!jobs[l]) continue;
+            render_consume(jobs[l].get(), blocks[l], done[l]);
+            if(jobs[l]->scalar) render_verify(jobs[l].get(), blocks[l], done[l]);
+            if(done[l] < limit[l] || jobs[l]->r->samples >= jobs[l]->total || !jobs[l]->ok ||
+               jobs[l]->differs) {
+                render_end(jobs[l].get());
+                jobs[l].reset();
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    RenderOptions opt;
+    fs::path root;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = std::max(1, atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            opt.max_seconds = (uint32_t)std::max(1, atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "-r") && i + 1 < argc) {
+            opt.rate_hz = (uint32_t)atoi(argv[++i]);
+        } else if(!strcmp(argv[i], "-u")) {
+            opt.uniform = true;
+        } else if(!strcmp(argv[i], "-a")) {
+            opt.auto_gain = true;
+        } else if(!strcmp(argv[i], "-b") && i + 1 < argc) {
+            opt.bits = (uint8_t)atoi(argv[++i]);
+        } else if(!strcmp(argv[i], "-l")) {
+            opt.lanes = true;
+        } else if(!strcmp(argv[i], "--verify")) {
+            opt.lanes = true;
+            opt.verify = true;
+        } else if(!strcmp(argv[i], "-o") && i + 1 < argc) {
+            opt.out_dir = argv[++i];
+        } else if(root.empty()) {
+            root = argv[i];
+        } else {
+            root.clear();
+            break;
+        }
+    }
+    if(root.empty() || (opt.bits != 8 && opt.bits != 16) || (opt.lanes && opt.bits != 8)) {
+        fprintf(
+            stderr,
+            "usage: %s [-j threads] [-t max_seconds] [-r hz] [-b 8|16] [-u] [-a] [-l] [--verify] "
+            "[-o out_dir] <song dir>\n"
+            "-l and --verify render 8-bit only\n",
+            argv[0]);
+        return 2;
+    }
+
+    AtmEngine probe;
+    atm_engine_init(&probe);
+    if(!atm_engine_set_output_rate(&probe, opt.rate_hz)) {
+        fprintf(stderr, "unsupported output rate %u\n", opt.rate_hz);
+        return 2;
+    }
+
+    const std::vector<fs::path> files = find_atm_files(root);
+    if(threads > files.size()) threads = std::max<size_t>(1, files.size());
+
+    WorkStealingPool pool(threads);
+    for(size_t i = 0; i < files.size(); i++) {
+        pool.push(i % threads, i);
+    }
+
+    std::vector<RenderReport> reports(files.size());
+    const Clock::time_point start = Clock::now();
+
+    std::vector<std::thread> workers;
+    for(size_t w = 0; w < threads; w++) {
+        workers.emplace_back([&, w]() {
+            if(opt.lanes) {
+                render_lanes(&pool, w, files, &reports, root, opt);
+                return;
+            }
+
+            AtmEngine engine;
+            std::vector<uint8_t> write_buf;
+            write_buf.reserve(ATM_RENDER_WRITE_SIZE + ATM_RENDER_BLOCK);
+            size_t job;
+            while(pool.take(w, &job)) {
+                reports[job] = render_file(&engine, &write_buf, root, files[job], opt);
+            }
+        });
+    }
+    for(auto& t : workers)
+        t.join();
+
+    const double wall_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+    size_t failed = 0;
+    uint64_t samples = 0;
+    printf("status\tsamples\tpeak\trms\tgain\tauto\trender_us\tpath\n");
+    for(size_t i = 0; i < files.size(); i++) {
+        const RenderReport& r = reports[i];
+        if(r.status != "ok") failed++;
+        samples += r.samples;
+        printf(
+            "%s\t%llu\t%u\t%.2f\t%.2f\t%.2f\t%llu\t%s\n",
+            r.status.c_str(),
+            (unsigned long long)r.samples,
+            r.peak,
+            r.rms,
+            r.gain,
+            r.auto_gain,
+            (unsigned long long)r.render_us,
+            files[i].string().c_str());
+    }
+
+    const double rate = wall_s > 0 ? (double)samples / wall_s : 0.0;
+    fprintf(
+        stderr,
+        "%zu files, %zu failed, %zu threads, %.3f s wall, %.2f Msamples/s, "
+        "%.2f Msamples/s per thread, %.0fx realtime\n",
+        files.size(),
+        failed,
+        threads,
+        wall_s,
+        rate / 1e6,
+        rate / 1e6 / (double)threads,
+        rate / (double)opt.rate_hz);
+
+    return failed ? 1 : 0;
+}
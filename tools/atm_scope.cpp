@@ -0,0 +1,195 @@
+// Host tool: measures what the visualizer tap (lib/Scope.h) adds to the audio interrupt and
+// checks the tap.
+//
+//   g++ -std=c++17 -O2 -pthread -o atm_scope tools/atm_scope.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp
+//   ./atm_scope [-t seconds] <song dir>
+//
+// Cost: every song under the directory is rendered block by block with the ticks in between,
+// as the device does with the tap off, for seconds (30 by default) or to its end, CHUNK_BLOCKS
+// at a time; each chunk, still in the cache as a block the interrupt just rendered is, is then
+// fed to the tap the way atm_fill_half() does, notes included. Prints both per block and the
+// share the tap adds.
+//
+// Checks, each of which fails the run:
+//   - decimation: each scope sample is the first of its ATM_SCOPE_DECIMATE samples, over
+//     DECIMATE_BLOCKS random blocks;
+//   - handover: a writer thread publishes frames whose samples and notes all hold the frame's
+//     sequence number while a reader polls for HANDOVER_MS; a frame the reader gets must be
+//     whole and newer than the last one it got.
+
+#include "atm_host.h"
+
+#include "../lib/Blocks.h"
+#include "../lib/ATMengine.h"
+#include "../lib/Scope.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t DECIMATE_BLOCKS = 200000;
+static constexpr size_t CHUNK_BLOCKS = 64;
+static constexpr int HANDOVER_MS = 2000;
+
+static volatile uint8_t sink;
+
+// atm_scope_feed() in ATMlib.cpp.
+static void feed(AtmScopeTap* t, const AtmEngine* e, const uint8_t* block) {
+    AtmScopeFrame* f = atm_scope_write(t, block, ATM_BLOCK_SAMPLES);
+    if(!f) return;
+    for(uint8_t i = 0; i < 4; i++) {
+        const uint8_t o = atm_sfx_osc(i);
+        if(e->sfx[i].active && e->osc[o].vol) {
+            f->notes[i] = e->sfx[i].ch.note;
+        } else {
+            f->notes[i] = e->osc[i].vol && (o != i || !e->sfx[i].active) ? e->channel_state[i].note : 0;
+        }
+    }
+    atm_scope_publish(t);
+}
+
+static uint32_t check_decimation() {
+    static AtmScopeTap t;
+    atm_scope_init(&t);
+    uint32_t rng = 1;
+    uint32_t bad = 0;
+    AtmBlock block;
+    for(size_t b = 0; b < DECIMATE_BLOCKS; b++) {
+        for(uint8_t& s : block) {
+            rng = rng * 1664525u + 1013904223u;
+            s = (uint8_t)(rng >> 24);
+        }
+        const uint8_t fill = t.fill;
+        AtmScopeFrame* f = atm_scope_write(&t, block, ATM_BLOCK_SAMPLES);
+        const AtmScopeFrame* back = &t.frames[t.back];
+        for(size_t i = 0; i < ATM_BLOCK_SAMPLES / ATM_SCOPE_DECIMATE; i++) {
+            if(back->samples[fill + i] != block[i * ATM_SCOPE_DECIMATE]) bad++;
+        }
+        if(f) atm_scope_publish(&t);
+    }
+    return bad;
+}
+
+static uint32_t check_handover(uint32_t* frames) {
+    static AtmScopeTap t;
+    atm_scope_init(&t);
+    std::atomic<bool> quit(false);
+    std::thread writer([&] {
+        uint8_t v = 0;
+        AtmBlock block;
+        while(!quit.load(std::memory_order_relaxed)) {
+            v++;
+            memset(block, v, sizeof(block));
+            while(true) {
+                AtmScopeFrame* f = atm_scope_write(&t, block, ATM_BLOCK_SAMPLES);
+                if(!f) continue;
+                memset(f->notes, v, sizeof(f->notes));
+                atm_scope_publish(&t);
+                break;
+            }
+        }
+    });
+
+    uint32_t bad = 0;
+    uint32_t last_seq = 0;
+    *frames = 0;
+    const Clock::time_point end = Clock::now() + std::chrono::milliseconds(HANDOVER_MS);
+    while(Clock::now() < end) {
+        const AtmScopeFrame* f = atm_scope_read(&t);
+        if(!f) continue;
+        (*frames)++;
+        bool whole = true;
+        for(size_t i = 0; i < ATM_SCOPE_SAMPLES; i++) whole = whole && f->samples[i] == f->samples[0];
+        for(uint8_t c = 0; c < 4; c++) whole = whole && f->notes[c] == f->samples[0];
+        if(!whole || f->seq <= last_seq) bad++;
+        last_seq = f->seq;
+    }
+    quit.store(true, std::memory_order_relaxed);
+    writer.join();
+    return bad;
+}
+
+int main(int argc, char** argv) {
+    double seconds = 30;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-'; i++) {
+        if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else {
+            break;
+        }
+    }
+    if(argc - i != 1) {
+        fprintf(stderr, "usage: %s [-t seconds] <song dir>\n", argv[0]);
+        return 2;
+    }
+
+    const size_t limit = (size_t)(seconds * ATM_LOGICAL_HZ / ATM_BLOCK_SAMPLES);
+    double render_ns = 0;
+    double tap_ns = 0;
+    size_t blocks = 0;
+    for(const auto& path : find_atm_files(argv[i])) {
+        std::string text;
+        uint8_t* song = NULL;
+        size_t song_size = 0;
+        if(!read_text(path, &text) || !atm_parse_song_text(text.c_str(), &song, &song_size, NULL, 0)) {
+            printf("%s: cannot read or compile\n", path.string().c_str());
+            continue;
+        }
+
+        static AtmEngine e;
+        atm_engine_init(&e);
+        atm_engine_load(&e, song);
+        static AtmScopeTap t;
+        atm_scope_init(&t);
+        // A chunk at a time, so the tap reads blocks still in the cache as the interrupt does.
+        AtmBlock pcm[CHUNK_BLOCKS];
+        size_t n = 0;
+        while(n < limit && !e.song_ended) {
+            size_t c = 0;
+            Clock::time_point t0 = Clock::now();
+            for(; c < CHUNK_BLOCKS && n + c < limit && !e.song_ended; c++) {
+                atm_engine_render(&e, pcm[c], ATM_BLOCK_SAMPLES);
+                while(e.tick_pending && !e.song_ended) {
+                    e.tick_pending--;
+                    atm_engine_tick(&e);
+                }
+            }
+            render_ns += std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+
+            t0 = Clock::now();
+            for(size_t b = 0; b < c; b++) feed(&t, &e, pcm[b]);
+            tap_ns += std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+            n += c;
+        }
+        sink = t.frames[0].samples[0];
+
+        blocks += n;
+        free(song);
+    }
+    if(!blocks) {
+        fprintf(stderr, "no songs rendered\n");
+        return 1;
+    }
+    printf(
+        "%zu blocks: render and ticks %.0f ns per block, tap %.0f ns per block, +%.1f%%\n",
+        blocks,
+        render_ns / blocks,
+        tap_ns / blocks,
+        100.0 * tap_ns / render_ns);
+
+    const uint32_t bad_decimation = check_decimation();
+    printf("decimation: %zu blocks, %u samples off\n", DECIMATE_BLOCKS, bad_decimation);
+    uint32_t frames = 0;
+    const uint32_t bad_handover = check_handover(&frames);
+    printf("handover: %u frames read in %d ms, %u torn or out of order\n", frames, HANDOVER_MS, bad_handover);
+    return bad_decimation || bad_handover ? 1 : 0;
+}
@@ -0,0 +1,420 @@
+// Host tool: writes synthetic songs at the extremes of the format, for judging the player on
+// worst cases rather than on the gentle bundled songs.
+//
+//   g++ -std=c++17 -O2 -o atm_stress tools/atm_stress.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp ATManalyze.cpp
+//   ./atm_stress [-s seed] <out dir>
+//   ./atm_render -o wav/ <out dir>
+//
+// One song per profile, each as ATM1 text (<name>.atm, what atm_render, atm_batch and atm_page
+// read) and as a compiled image (<name>.atmc, what ATMsynth::play() takes):
+//
+//   tempo    SET_TEMPO 255 and a note on every channel every tick
+//   nesting  every channel seven calls deep, the most its stack holds
+//   effects  slides, arpeggio, note cut, vibrato, tremolo, glissando, retrigger and
+//            transposition, as many at once as a channel can hold, on all four channels
+//   tracks   255 tracks
+//   size     the largest image the player takes (ATM_BANK_MAX_SONG_SIZE, 64 KB)
+//   vle      delays in the variable-length form, up to the longest one (65534 ticks)
+//   all      all of the above in one song
+//
+// Every song terminates and passes the load-time loop check. The report gives, per song, the
+// track count, image size, analyzed length, and the most and the mean commands per tick the
+// engine ran, and what a tick costs on this machine, the best of BENCH_ROUNDS plays. The same
+// seed always writes the same songs.
+
+#include "atm_host.h"
+
+#include "../lib/ATManalyze.h"
+#include "../lib/ATMbank.h"
+#include "../lib/ATMengine.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static constexpr uint8_t MAX_TRACKS = 255;
+// Track data of the largest image the player and the tools take, with MAX_TRACKS tracks.
+static constexpr size_t MAX_DATA = ATM_BANK_MAX_SONG_SIZE - (1 + MAX_TRACKS * 2 + 4);
+// Calls a channel can nest (AtmCallStack).
+static constexpr uint8_t MAX_DEPTH = 7;
+// 0xFFFF ticks means forever to the engine.
+static constexpr uint32_t MAX_DELAY = 0xFFFE;
+static constexpr uint32_t BENCH_ROUNDS = 5;
+
+static uint64_t rng_state;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 32);
+}
+
+static uint32_t rng_range(uint32_t lo, uint32_t hi) {
+    return lo + rng() % (hi - lo + 1);
+}
+
+// The text of one track and the bytes it compiles to.
+struct TrackText {
+    std::string text;
+    size_t bytes;
+};
+
+static void emit(TrackText* t, size_t bytes, const char* fmt, ...) {
+    char line[96];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    t->text += line;
+    t->text += '\n';
+    t->bytes += bytes;
+}
+
+static size_t delay_bytes(uint32_t ticks) {
+    if(ticks <= 64) return 1;
+    size_t n = 2;
+    for(uint32_t v = (ticks - 65) >> 7; v; v >>= 7)
+        n++;
+    return n;
+}
+
+static void note(TrackText* t, uint32_t delay) {
+    emit(t, 1, "NOTE %u", rng_range(12, 52));
+    emit(t, delay_bytes(delay), "DELAY %u", delay);
+}
+
+static void call(TrackText* t, uint8_t track, uint8_t times) {
+    if(times <= 1) {
+        emit(t, 2, "GOTO %u", track);
+    } else {
+        emit(t, 3, "REPEAT %u %u", times - 1, track);
+    }
+}
+
+// One of each group of effects that share channel state, picked at random, plus the ones that
+// have state of their own. Raw opcodes where the text format has no name.
+static void effects(TrackText* t) {
+    if(rng() & 1) {
+        emit(t, 3, "DB 66\nDB %u\nDB %u # volume slide, advanced", rng_range(1, 4), rng_range(0, 7));
+    } else {
+        emit(t, 3, "DB 69\nDB %u\nDB %u # frequency slide, advanced", rng_range(1, 8), rng_range(0, 7));
+    }
+    if(rng() & 1) {
+        emit(t, 3, "DB 71\nDB %u\nDB %u # arpeggio", rng_range(0x11, 0x77), rng_range(0x20, 0x27));
+    } else {
+        emit(t, 2, "SET_NOTE_CUT %u", rng_range(1, 6));
+    }
+    if(rng() & 1) {
+        emit(t, 3, "SET_VIBRATO %u %u", rng_range(1, 12), rng_range(1, 15));
+    } else {
+        emit(t, 3, "DB 80\nDB %u\nDB %u # tremolo", rng_range(1, 12), rng_range(1, 15));
+    }
+    emit(t, 2, "DB 82\nDB %u # glissando", rng_range(1, 4));
+    emit(t, 2, "DB 73\nDB %u # retrigger", rng_range(0x01, 0x3F));
+    emit(t, 2, "SET_TRANSPOSITION %u", rng_range(0, 5));
+}
+
+struct SongText {
+    std::vector<TrackText> tracks;
+    uint8_t entry[4];
+};
+
+static std::string song_text(const SongText& s, const char* name) {
+    std::string text = "ATM1\nNAME stress ";
+    text += name;
+    char line[64];
+    snprintf(line, sizeof(line), "\nENTRY %u %u %u %u\n", s.entry[0], s.entry[1], s.entry[2], s.entry[3]);
+    text += line;
+    for(size_t i = 0; i < s.tracks.size(); i++) {
+        text += "\nTRACK # " + std::to_string(i) + "\n" + s.tracks[i].text + "ENDTRACK\n";
+    }
+    return text + "\nEND\n";
+}
+
+// Tracks 0-3 are the channels' entry tracks; the profiles add theirs after them.
+static SongText song_new(uint8_t tempo) {
+    SongText s;
+    s.tracks.resize(4);
+    for(uint8_t n = 0; n < 4; n++) {
+        s.entry[n] = n;
+        emit(&s.tracks[n], 2, "SET_VOLUME %u", 40 + n * 4);
+    }
+    emit(&s.tracks[0], 2, "SET_TEMPO %u", tempo);
+    return s;
+}
+
+static uint8_t track_new(SongText* s) {
+    s->tracks.emplace_back();
+    return (uint8_t)(s->tracks.size() - 1);
+}
+
+static void song_stop(SongText* s) {
+    for(uint8_t n = 0; n < 4; n++) {
+        emit(&s->tracks[n], 1, "STOP");
+    }
+}
+
+// About a minute of one-tick notes at the highest tempo.
+static SongText profile_tempo(void) {
+    SongText s = song_new(255);
+    for(uint8_t n = 0; n < 4; n++) {
+        const uint8_t t = track_new(&s);
+        for(uint8_t i = 0; i < 64; i++) {
+            if(i % 16 == 0) emit(&s.tracks[t], 2, "SET_VOLUME %u", rng_range(20, 63));
+            note(&s.tracks[t], 1);
+        }
+        emit(&s.tracks[t], 1, "RETURN");
+        call(&s.tracks[n], t, 240);
+    }
+    song_stop(&s);
+    return s;
+}
+
+// Each level plays a note and calls the next one twice, so the deepest level is reached over
+// and over and every return unwinds through the chain.
+static SongText profile_nesting(void) {
+    SongText s = song_new(200);
+    for(uint8_t n = 0; n < 4; n++) {
+        uint8_t level[MAX_DEPTH];
+        for(uint8_t d = 0; d < MAX_DEPTH; d++)
+            level[d] = track_new(&s);
+        for(uint8_t d = 0; d < MAX_DEPTH; d++) {
+            TrackText* t = &s.tracks[level[d]];
+            note(t, 1);
+            if(d + 1 < MAX_DEPTH) call(t, level[d + 1], 2);
+            emit(t, 1, "RETURN");
+        }
+        call(&s.tracks[n], level[0], 64);
+    }
+    song_stop(&s);
+    return s;
+}
+
+static SongText profile_effects(void) {
+    SongText s = song_new(50);
+    for(uint8_t n = 0; n < 4; n++) {
+        const uint8_t t = track_new(&s);
+        for(uint8_t i = 0; i < 32; i++) {
+            effects(&s.tracks[t]);
+            note(&s.tracks[t], rng_range(2, 6));
+        }
+        emit(&s.tracks[t], 1, "RETURN");
+        call(&s.tracks[n], t, 24);
+    }
+    song_stop(&s);
+    return s;
+}
+
+// Fills the free track slots with short patterns, each channel calling every fourth one.
+static SongText profile_tracks(void) {
+    SongText s = song_new(60);
+    while(s.tracks.size() < MAX_TRACKS) {
+        const uint8_t t = track_new(&s);
+        if(t % 3 == 0) effects(&s.tracks[t]);
+        for(uint8_t i = 0; i < 4; i++)
+            note(&s.tracks[t], 2);
+        emit(&s.tracks[t], 1, "RETURN");
+        call(&s.tracks[t % 4], t, 8);
+    }
+    song_stop(&s);
+    return s;
+}
+
+// Patterns over every free track slot, filled with notes and effects until the track data is
+// exactly as big as the format allows. Entry tracks call them through a chain of depth levels
+// (just the entry track if depth is 0), so with depth the patterns run with the stack full.
+static SongText profile_fill(uint8_t tempo, uint8_t depth, bool vle) {
+    SongText s = song_new(tempo);
+    uint8_t caller[4];
+    for(uint8_t n = 0; n < 4; n++) {
+        caller[n] = n;
+        for(uint8_t d = 0; d < depth; d++) {
+            const uint8_t t = track_new(&s);
+            note(&s.tracks[t], 1);
+            call(&s.tracks[caller[n]], t, 1);
+            caller[n] = t;
+        }
+    }
+    const size_t first = s.tracks.size();
+    while(s.tracks.size() < MAX_TRACKS) {
+        const uint8_t t = track_new(&s);
+        call(&s.tracks[caller[t % 4]], t, 1);
+    }
+    for(size_t i = 4; i < first; i++)
+        emit(&s.tracks[i], 1, "RETURN");
+    song_stop(&s);
+
+    size_t used = 0;
+    for(size_t i = 0; i < first; i++)
+        used += s.tracks[i].bytes;
+    // Room for RETURN in every pattern.
+    size_t left = MAX_DATA - used - (MAX_TRACKS - first);
+    for(size_t i = first; i < MAX_TRACKS; i++) {
+        TrackText* t = &s.tracks[i];
+        const size_t share = left / (MAX_TRACKS - i);
+        const size_t start = left;
+        // Whole note groups while they fit, then single commands down to the last byte.
+        while(start - left + 20 <= share) {
+            const size_t before = t->bytes;
+            effects(t);
+            note(t, vle && rng() % 8 == 0 ? rng_range(65, 400) : 1);
+            left -= t->bytes - before;
+        }
+        while(start - left < share) {
+            emit(t, 1, "NOTE %u", rng_range(12, 52));
+            left--;
+        }
+        emit(t, 1, "RETURN");
+    }
+    return s;
+}
+
+static SongText profile_size(void) {
+    return profile_fill(255, 0, false);
+}
+
+static SongText profile_all(void) {
+    return profile_fill(255, MAX_DEPTH - 1, true);
+}
+
+// The boundaries of the encoding (one, two and three VLE bytes) and a spread between them; the
+// last channel ends on the longest delay there is.
+static SongText profile_vle(void) {
+    static const uint32_t edges[] = {65, 66, 192, 193, 194, 16448, 16449, 16450};
+    SongText s = song_new(255);
+    for(uint8_t n = 0; n < 4; n++) {
+        const uint8_t t = track_new(&s);
+        uint32_t total = 0;
+        for(const uint32_t d : edges) {
+            note(&s.tracks[t], d);
+            total += d;
+        }
+        while(total < 52000) {
+            const uint32_t d = rng_range(65, 3000);
+            note(&s.tracks[t], d);
+            total += d;
+        }
+        if(n == 3) note(&s.tracks[t], MAX_DELAY);
+        emit(&s.tracks[t], 1, "RETURN");
+        call(&s.tracks[n], t, 1);
+    }
+    song_stop(&s);
+    return s;
+}
+
+struct Profile {
+    const char* name;
+    SongText (*make)(void);
+};
+
+static const Profile profiles[] = {
+    {"tempo", profile_tempo},
+    {"nesting", profile_nesting},
+    {"effects", profile_effects},
+    {"tracks", profile_tracks},
+    {"size", profile_size},
+    {"vle", profile_vle},
+    {"all", profile_all},
+};
+
+static bool write_file(const fs::path& path, const void* data, size_t size) {
+    FILE* f = fopen(path.string().c_str(), "wb");
+    if(!f) return false;
+    const bool ok = fwrite(data, 1, size, f) == size;
+    return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char** argv) {
+    uint64_t seed = 1;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-'; i++) {
+        if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            break;
+        }
+    }
+    if(argc - i != 1) {
+        fprintf(stderr, "usage: %s [-s seed] <out dir>\n", argv[0]);
+        return 2;
+    }
+    const fs::path out_dir = argv[i];
+    std::error_code ec;
+    fs::create_directories(out_dir, ec);
+
+    static AtmEngine e;
+    int failed = 0;
+    printf("song\ttracks\tbytes\tseconds\tticks\tmax cmds/tick\tmean cmds/tick\tns/tick\n");
+    for(const Profile& p : profiles) {
+        rng_state = seed * 0x9E3779B97F4A7C15ull + 1;
+        const std::string text = song_text(p.make(), p.name);
+
+        uint8_t* image = NULL;
+        size_t image_size = 0;
+        AtmSongInfo info;
+        uint8_t track;
+        const char* error = NULL;
+        if(!atm_parse_song_text(text.c_str(), &image, &image_size, NULL, 0)) {
+            error = "compile error";
+        } else if(atm_find_delay_free_cycle(image, image_size, &track)) {
+            error = "loop without delay";
+        } else if(!atm_analyze_song(image, image_size, &info) || !info.terminates) {
+            error = "does not terminate";
+        } else if(
+            !write_file(out_dir / (std::string(p.name) + ".atm"), text.data(), text.size()) ||
+            !write_file(out_dir / (std::string(p.name) + ".atmc"), image, image_size)) {
+            error = "write error";
+        }
+        if(error) {
+            fprintf(stderr, "%s: %s\n", p.name, error);
+            free(image);
+            failed++;
+            continue;
+        }
+
+        atm_engine_init(&e);
+        atm_engine_load(&e, image);
+        uint64_t ticks = 0;
+        uint64_t commands = 0;
+        uint32_t worst = 0;
+        while(!e.song_ended) {
+            atm_engine_tick(&e);
+            ticks++;
+            commands += e.tick_commands;
+            if(e.tick_commands > worst) worst = e.tick_commands;
+        }
+
+        // Tick cost: the fastest of a few plays of the whole song, ticks only.
+        double best_ns = 0;
+        for(uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+            atm_engine_load(&e, image);
+            const Clock::time_point t0 = Clock::now();
+            while(!e.song_ended) atm_engine_tick(&e);
+            const double ns =
+                std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (double)ticks;
+            if(round == 0 || ns < best_ns) best_ns = ns;
+        }
+        printf(
+            "%s\t%u\t%zu\t%.1f\t%llu\t%u\t%.2f\t%.0f\n",
+            p.name,
+            image[0],
+            image_size,
+            info.duration_ms / 1000.0,
+            (unsigned long long)ticks,
+            worst,
+            (double)commands / (double)ticks,
+            best_ns);
+        free(image);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+// Host tool: checks that songs keep time at every output rate, tick rate and tempo scale,
+// down to the slowest tick rate at the lowest tempo the engine allows.
+//
+//   g++ -std=c++17 -O2 -o atm_tempo tools/atm_tempo.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp
+//   ./atm_tempo
+//
+// For each combination a song that only sets its tick rate (SET_TEMPO) and waits is rendered
+// block by block with the ticks in between, as the device plays it, for at least TICKS ticks
+// after the first and at least MIN_SAMPLES samples. The samples that took are compared with
+// what the tick rate and tempo scale ask for: tick_div * 256 / q8 samples per tick. Ticks are
+// counted to the block, so up to one block of error is allowed.
+//
+// Prints the combinations that are off and the worst error; exits non-zero if any is.
+
+#include "atm_host.h"
+
+#include "../lib/Blocks.h"
+#include "../lib/ATMengine.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+static const uint32_t rates[] = {ATM_LOGICAL_HZ, 62500, 48000, 44100, 22050};
+static const uint8_t tick_rates[] = {1, 2, 3, 4, 7, 16, 25, 32, 64, 128, 255};
+// The engine's minimum (ATM_TEMPO_MIN_Q8), slower and faster than written, and as written.
+static const uint16_t tempos_q8[] = {16, 64, 255, 256, 257, 1024};
+static constexpr uint32_t TICKS = 4;
+static constexpr double MIN_SAMPLES = 64.0 * ATM_BLOCK_SAMPLES;
+// Enough DELAY 255 for the shortest ticks: 22050 / 255 * 256 / 1024 samples each.
+static constexpr uint32_t DELAYS = 4;
+
+static uint8_t* compile_song(uint8_t tick_rate) {
+    std::string text = "ATM1\nENTRY 0 0 0 0\nTRACK # 0\nSET_TEMPO " + std::to_string(tick_rate) +
+                       "\nSET_VOLUME 30\nNOTE 22\n";
+    for(uint32_t i = 0; i < DELAYS; i++) text += "DELAY 255\n";
+    text += "STOP\nENDTRACK\nEND\n";
+    uint8_t* song = NULL;
+    size_t size = 0;
+    if(!atm_parse_song_text(text.c_str(), &song, &size, NULL, 0)) return NULL;
+    return song;
+}
+
+// Samples from the end of the first tick to the end of tick count + 1.
+static uint64_t measure(const uint8_t* song, uint32_t hz, uint16_t q8, uint32_t count) {
+    static AtmEngine e;
+    atm_engine_init(&e);
+    atm_engine_set_output_rate(&e, hz);
+    atm_engine_load(&e, song);
+    atm_engine_set_tempo_q8(&e, q8);
+
+    AtmBlock block;
+    uint64_t samples = 0;
+    uint64_t start = 0;
+    uint32_t ticks = 0;
+    while(ticks < count + 1) {
+        atm_engine_render(&e, block, ATM_BLOCK_SAMPLES);
+        samples += ATM_BLOCK_SAMPLES;
+        while(e.tick_pending && ticks < count + 1) {
+            e.tick_pending--;
+            atm_engine_tick(&e);
+            if(ticks++ == 0) start = samples;
+        }
+    }
+    return samples - start;
+}
+
+int main() {
+    int failed = 0;
+    double worst = 0;
+    for(uint8_t tr : tick_rates) {
+        uint8_t* song = compile_song(tr);
+        if(!song) {
+            fprintf(stderr, "cannot compile the test song\n");
+            return 1;
+        }
+        for(uint32_t hz : rates) {
+            for(uint16_t q8 : tempos_q8) {
+                const double per_tick = atm_tick_div_from_rate(hz, tr) * 256.0 / (double)q8;
+                uint32_t count = TICKS;
+                if(count * per_tick < MIN_SAMPLES) count = (uint32_t)ceil(MIN_SAMPLES / per_tick);
+                const double want = count * per_tick;
+                const double got = (double)measure(song, hz, q8, count);
+                const double off = fabs(got - want);
+                if(off > worst) worst = off;
+                if(off > ATM_BLOCK_SAMPLES) {
+                    printf(
+                        "%u Hz, tick rate %u, tempo %u/256: %.0f samples for %u ticks, want %.0f\n",
+                        hz,
+                        tr,
+                        q8,
+                        got,
+                        count,
+                        want);
+                    failed++;
+                }
+            }
+        }
+        free(song);
+    }
+    printf(
+        "%zu combinations, %d off, worst error %.0f samples\n",
+        sizeof(tick_rates) * (sizeof(rates) / sizeof(rates[0])) *
+            (sizeof(tempos_q8) / sizeof(tempos_q8[0])),
+        failed,
+        worst);
+    return failed ? 1 : 0;
+}
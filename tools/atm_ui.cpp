@@ -0,0 +1,143 @@
+// Host tool: counts the player view's wakeups and redraws with the adaptive refresh (lib/Ui.h)
+// against the fixed 33 ms refresh it replaced.
+//
+//   g++ -std=c++17 -O2 -o atm_ui tools/atm_ui.cpp ATMengine.cpp ATMpager.cpp ATMparse.cpp ATManalyze.cpp
+//   ./atm_ui [-t seconds] <song.atm>...
+//
+// Stands in for the view layer and the UI timer: the song plays in 4 ms steps of audio, and
+// whenever the timer is due the player's refresh runs as atm_update_levels() does it, from the
+// engine's meter levels and song position. A refresh that changes what the view shows is a
+// redraw (the model committed with update); the timer then rearms with the period the refresh
+// picks. Each song is played, paused and stopped for seconds (20 by default) each.
+//
+// Prints the wakeups and redraws of each state against the old ones, which were one of each
+// every 33 ms in every state.
+
+#include "atm_host.h"
+
+#include "../lib/ATManalyze.h"
+#include "../lib/ATMengine.h"
+#include "../lib/Ui.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+// Audio between two looks at the timer.
+static constexpr uint32_t STEP_MS = 4;
+static constexpr size_t STEP_SAMPLES = ATM_LOGICAL_HZ * STEP_MS / 1000;
+
+struct MockView {
+    uint32_t wakeups;
+    uint32_t redraws;
+};
+
+static uint8_t progress_fill(uint32_t elapsed_ms, uint32_t total_ms) {
+    if(!total_ms) return 0;
+    if(elapsed_ms > total_ms) elapsed_ms = total_ms;
+    return (uint8_t)(((uint64_t)elapsed_ms * 50) / total_ms);
+}
+
+// One timer wakeup; returns the period to the next. A stopped song shows no position.
+static uint32_t refresh(
+    AtmUiState* ui,
+    AtmEngine* e,
+    const AtmSongInfo* info,
+    bool playing,
+    bool live,
+    MockView* v) {
+    v->wakeups++;
+    uint8_t levels[4];
+    uint8_t widths[4];
+    atm_engine_read_levels(e, levels);
+    atm_ui_meter_widths(ui, levels, live, widths);
+
+    uint32_t elapsed_ms = playing ? (uint32_t)((uint64_t)e->song_pos * 1000 / ATM_LOGICAL_HZ) : 0;
+    if(info->looped && elapsed_ms >= info->loop_end_ms && info->loop_end_ms > info->loop_start_ms) {
+        elapsed_ms = info->loop_start_ms +
+                     (elapsed_ms - info->loop_start_ms) % (info->loop_end_ms - info->loop_start_ms);
+    }
+    if(elapsed_ms > info->duration_ms) elapsed_ms = info->duration_ms;
+
+    const bool changed =
+        atm_ui_update(ui, widths, elapsed_ms / 1000, progress_fill(elapsed_ms, info->duration_ms));
+    if(changed) v->redraws++;
+    return atm_ui_next_period(ui, changed, live);
+}
+
+int main(int argc, char** argv) {
+    double seconds = 20;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-'; i++) {
+        if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else {
+            break;
+        }
+    }
+    if(i >= argc) {
+        fprintf(stderr, "usage: %s [-t seconds] <song.atm>...\n", argv[0]);
+        return 2;
+    }
+
+    const uint32_t span_ms = (uint32_t)(seconds * 1000);
+    const uint32_t old = (span_ms + ATM_UI_FAST_MS - 1) / ATM_UI_FAST_MS;
+    static const char* const states[] = {"playing", "paused", "stopped"};
+    int failed = 0;
+    for(; i < argc; i++) {
+        std::string text;
+        uint8_t* song = NULL;
+        size_t song_size = 0;
+        AtmSongInfo info;
+        if(!read_text(argv[i], &text) || !atm_parse_song_text(text.c_str(), &song, &song_size, NULL, 0) ||
+           !atm_analyze_song(song, song_size, &info)) {
+            printf("%s: cannot read or compile\n", argv[i]);
+            failed++;
+            continue;
+        }
+
+        static AtmEngine e;
+        atm_engine_init(&e);
+        atm_engine_load(&e, song);
+        AtmUiState ui;
+        memset(&ui, 0, sizeof(ui));
+        uint8_t block[STEP_SAMPLES];
+        printf("%s\n", argv[i]);
+        for(uint8_t s = 0; s < 3; s++) {
+            const bool live = s == 0;
+            if(s == 2) {
+                // Stopping clears the meters, as the player does.
+                atm_engine_reset_meters(&e);
+                atm_ui_reset_meters(&ui);
+            }
+            // A state change redraws and snaps the refresh back to fast, as
+            // atm_set_player_status() does.
+            atm_ui_next_period(&ui, true, live);
+
+            MockView v = {0, 0};
+            uint32_t due = 0;
+            for(uint32_t t = 0; t < span_ms; t += STEP_MS) {
+                if(live && !e.song_ended) {
+                    atm_engine_render(&e, block, STEP_SAMPLES);
+                    while(e.tick_pending && !e.song_ended) {
+                        e.tick_pending--;
+                        atm_engine_tick(&e);
+                    }
+                }
+                if(t >= due) {
+                    due = t + refresh(&ui, &e, &info, s < 2, live, &v);
+                }
+            }
+            printf(
+                "  %-8s %5u wakeups, %5u redraws (fixed refresh: %u of each)\n",
+                states[s],
+                v.wakeups,
+                v.redraws,
+                old);
+        }
+        free(song);
+    }
+    return failed ? 1 : 0;
+}